@@ -79,6 +79,25 @@ int ber_enclen(ODR o, int len, int lenlen, int exact)
     return odr_tell(o) - lenpos;
 }
 
+/**
+ * ber_lenlen:
+ * Returns number of octets of the definite minimal encoding of len.
+ */
+int ber_lenlen(int len)
+{
+    int n = 1;
+
+    if (len <= 127)
+        return 1;
+    do
+    {
+        n++;
+        len >>= 8;
+    }
+    while (len);
+    return n;
+}
+
 /**
  * ber_declen:
  * Decode BER length octets. Returns
@@ -20,6 +20,11 @@
 #include <assert.h>
 
 int ber_octetstring(ODR o, Odr_oct *p, int cons)
+{
+    return ber_octetstring_x(o, p, cons, 0);
+}
+
+int ber_octetstring_x(ODR o, Odr_oct *p, int cons, int borrow)
 {
     int res, len;
     const char *base;
@@ -53,7 +58,10 @@ int ber_octetstring(ODR o, Odr_oct *p, int cons)
             return 0;
         }
         p->len = len;
-        p->buf = odr_strdupn(o, o->op->bp, len);
+        if (borrow)
+            p->buf = (char *) o->op->bp;
+        else
+            p->buf = odr_strdupn(o, o->op->bp, len);
         o->op->bp += len;
         return 1;
     case ODR_ENCODE:
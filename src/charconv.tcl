@@ -1,7 +1,7 @@
 #!/usr/bin/tclsh
 
 proc usage {} {
-    puts {charconv.tcl: [-p prefix] [-s split] [-o ofile] file ... }
+    puts {charconv.tcl: [-p prefix] [-s split] [-o ofile] [-r] [-O set] file ... }
     exit 1
 }
 
@@ -95,6 +95,101 @@ proc preamble_trie {ofilehandle ifiles ofile} {
     }
 }
 
+proc preamble_rev {ofilehandle ifiles ofile} {
+    set f $ofilehandle
+
+    puts $f "/** \\file $ofile"
+    puts $f "    \\brief Character conversion, generated from [lindex $ifiles 0]"
+    puts $f ""
+    puts $f "    Generated automatically by charconv.tcl"
+    puts $f "*/"
+
+    puts $f "\#if HAVE_CONFIG_H"
+    puts $f "\#include <config.h>"
+    puts $f "\#endif"
+    puts $f "\#include <stddef.h>"
+
+    puts $f "
+        struct yaz_iconv_rev_entry {
+            unsigned ucs : 24;
+            unsigned set : 7;
+            unsigned combining : 1;
+            unsigned to : 24;
+        };
+    "
+}
+
+proc utf8_to_ucs {hex} {
+    set b [scan [lindex $hex 0] %x]
+    if {$b < 0x80} {
+        set n 0
+    } elseif {$b < 0xE0} {
+        set n 1
+        set b [expr $b & 0x1F]
+    } elseif {$b < 0xF0} {
+        set n 2
+        set b [expr $b & 0x0F]
+    } else {
+        set n 3
+        set b [expr $b & 0x07]
+    }
+    if {[llength $hex] != $n + 1} {
+        return 0
+    }
+    for {set i 1} {$i <= $n} {incr i} {
+        set b [expr ($b << 6) | ([scan [lindex $hex $i] %x] & 0x3F)]
+    }
+    return $b
+}
+
+# first mapping for a code point wins, as in the trie
+proc ins_rev {hex to combining codename set} {
+    global rev
+
+    set ucs [utf8_to_ucs $hex]
+    if {$ucs && ![info exists rev($ucs)]} {
+        set rev($ucs) [list $set $combining $to $codename]
+    }
+}
+
+proc dump_rev {ofilehandle prefix} {
+    global rev
+
+    set f $ofilehandle
+    set codes [lsort -integer [array names rev]]
+
+    puts $f "/* REVERSE: size [llength $codes] */"
+    puts $f "static struct yaz_iconv_rev_entry ${prefix}_rev\[\] = \{"
+    foreach ucs $codes {
+        set e $rev($ucs)
+        puts $f "  \{0x[format %04X $ucs], 0x[lindex $e 0], [lindex $e 1], 0x[lindex $e 2]\}, /* [lindex $e 3] */"
+    }
+    puts $f "  \{0, 0, 0, 0\}"
+    puts $f "\};"
+    puts $f ""
+    puts $f "unsigned long yaz_${prefix}_lookup(unsigned long ucs, int *combining, int *set)
+        {
+            size_t lo = 0, hi = [llength $codes];
+
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (${prefix}_rev\[mid\].ucs < ucs)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo < [llength $codes] && ${prefix}_rev\[lo\].ucs == ucs)
+            {
+                *combining = ${prefix}_rev\[lo\].combining;
+                *set = ${prefix}_rev\[lo\].set;
+                return ${prefix}_rev\[lo\].to;
+            }
+            return 0;
+        }
+    "
+}
+
 proc reset_trie {} {
     global trie
 
@@ -297,6 +392,7 @@ proc readfile {fname ofilehandle prefix omits reverse} {
     set combining 0
     set codename {}
     set altutf {}
+    set omit 0
     while {1} {
         incr lineno
         set cnt [gets $f line]
@@ -304,19 +400,24 @@ proc readfile {fname ofilehandle prefix omits reverse} {
             break
         }
 	if {[regexp {</characterSet>} $line s]} {
-	    dump_trie $ofilehandle
+	    if {!$reverse} {
+		dump_trie $ofilehandle
+	    }
+	    set omit 0
 	} elseif {[regexp {<characterSet .*ISOcode="([0-9A-Fa-f]+)"} $line s tablenumber]} {
 	    reset_trie
 	    set trie(prefix) "${prefix}_$tablenumber"
 	    set combining 0
+	    set omit [expr [lsearch -exact $omits $tablenumber] >= 0]
+	} elseif {$omit} {
+	    continue
 	} elseif {[regexp {</code>} $line s]} {
 	    if {[string length $ucs]} {
 		if {$reverse} {
 		    for {set i 0} {$i < [string length $utf]} {incr i 2} {
 			lappend hex [string range $utf $i [expr $i+1]]
 		    }
-		    # puts "ins_trie $hex $marc
-		    ins_trie $hex $marc $combining $codename
+		    ins_rev $hex $marc $combining $codename $tablenumber
 		    unset hex
 
 		} else {
@@ -333,7 +434,7 @@ proc readfile {fname ofilehandle prefix omits reverse} {
 		    lappend hex [string range $altutf $i [expr $i+1]]
 		}
 		if {[info exists hex]} {
-		    ins_trie $hex $marc $combining $codename
+		    ins_rev $hex $marc $combining $codename $tablenumber
 		    unset hex
 		}
 	    }
@@ -423,11 +524,18 @@ if {![info exists ifiles]} {
 }
 
 set ofilehandle [open ${ofile}.tmp w]
-preamble_trie $ofilehandle $ifiles $ofile
+if {$reverse_map} {
+    preamble_rev $ofilehandle $ifiles $ofile
+} else {
+    preamble_trie $ofilehandle $ifiles $ofile
+}
 
 foreach ifile $ifiles {
     readfile $ifile $ofilehandle $prefix $omits $reverse_map
 }
+if {$reverse_map} {
+    dump_rev $ofilehandle $prefix
+}
 close $ofilehandle
 
 file rename -force ${ofile}.tmp ${ofile}
@@ -23,6 +23,10 @@
 #include <yaz/matchstr.h>
 #include <yaz/atoi.h>
 
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
 static const char *cs_errlist[] =
 {
     "No error or unspecified error",
@@ -282,6 +286,24 @@ int cs_look (COMSTACK cs)
     return cs->event;
 }
 
+int cs_put_iov_f_put(COMSTACK cs, const struct cs_iovec *iov, int iovcnt)
+{
+    while (cs->put_iov_next < iovcnt)
+    {
+        const struct cs_iovec *v = iov + cs->put_iov_next;
+        int r = cs_put(cs, v->buf, v->len);
+        if (r)
+        {
+            if (r < 0)
+                cs->put_iov_next = 0;
+            return r; /* 1: segment incomplete; called again later */
+        }
+        cs->put_iov_next++;
+    }
+    cs->put_iov_next = 0;
+    return 0;
+}
+
 static int skip_crlf(const char *buf, int len, int *i)
 {
     if (*i < len)
@@ -300,7 +322,8 @@ static int skip_crlf(const char *buf, int len, int *i)
     return 0;
 }
 
-static int cs_read_chunks(const char *buf, int i, int len)
+static int cs_read_chunks(const char *buf, int i, int len,
+                          struct cs_complete_state *st)
 {
     /* inside chunked body .. */
     while (1)
@@ -308,6 +331,8 @@ static int cs_read_chunks(const char *buf, int i, int len)
         int chunk_len = 0;
         if (i >= len)
             return 0;
+        if (st)
+            st->resume = i; /* chunks before this one are complete */
         /* read chunk length */
         int ret = yaz_atoi(16, buf + i, len - i, &chunk_len);
         if (ret <= 0)
@@ -346,11 +371,14 @@ static int cs_read_chunks(const char *buf, int i, int len)
     return 0;
 }
 
-static int cs_complete_http(const char *buf, int len, int head_only)
+static int cs_complete_http(const char *buf, int len, int head_only,
+                            struct cs_complete_state *st)
 {
     /* deal with HTTP request/response */
     int i, content_len = 0, chunked = 0;
 
+    if (st && st->resume)
+        return cs_read_chunks(buf, st->resume, len, st);
     /* need at least one line followed by \n or \r .. */
     for (i = 0; ; i++)
         if (i == len)
@@ -392,11 +420,13 @@ static int cs_complete_http(const char *buf, int len, int head_only)
             if (head_only)
                 return i;
             if (chunked)
-                return cs_read_chunks(buf, i, len);
+                return cs_read_chunks(buf, i, len, st);
             if (content_len == -1)
                 return 0;   /* no content length */
             if (content_len > (unsigned)(INT_MAX - i))
                 return -1;
+            if (st)
+                st->length = i + content_len;
             if (len >= i + content_len)
                 return i + content_len;
             break;
@@ -441,27 +471,97 @@ static int cs_complete_http(const char *buf, int len, int head_only)
     return 0;
 }
 
-static int cs_complete_auto_x(const char *buf, int len, int head_only)
+static int cs_complete_ber(const char *buf, int len,
+                           struct cs_complete_state *st)
+{
+    int res, ll, zclass, tag, cons;
+
+    if (!st->resume)
+    {
+        /* outer tag and length: same checks as completeBER_n */
+        if (buf[0] == 0 && buf[1] == 0)
+            return -1;
+        if ((res = ber_dectag(buf, &zclass, &tag, &cons, len)) <= 0)
+            return 0;
+        if (res > len)
+            return -1;
+        st->resume = res;
+        res = ber_declen(buf + st->resume, &ll, len - st->resume);
+        if (res == -2)
+            return -1;
+        if (res == -1)
+        {
+            st->resume = 0;
+            return 0;  /* incomplete length */
+        }
+        st->resume += res;
+        if (ll >= 0)
+        {   /* definite length */
+            st->length = st->resume + ll;
+            st->resume = 0;
+            return len >= st->length ? st->length : 0;
+        }
+        if (!cons)
+            return -1;
+    }
+    /* indefinite length: check members not checked before */
+    while (len - st->resume >= 2)
+    {
+        if (buf[st->resume] == 0 && buf[st->resume + 1] == 0)
+            return st->resume + 2;
+        res = completeBER_n(buf + st->resume, len - st->resume, 1);
+        if (res <= 0)
+            return res;
+        st->resume += res;
+    }
+    return 0;
+}
+
+static int cs_complete_auto_x(const char *buf, int len, int head_only,
+                              struct cs_complete_state *st)
 {
+    if (st && st->length)
+        return len >= st->length ? st->length : 0;
     if (len > 5 && buf[0] >= 0x20 && buf[0] < 0x7f
                 && buf[1] >= 0x20 && buf[1] < 0x7f
                 && buf[2] >= 0x20 && buf[2] < 0x7f
                 && buf[3] >= 0x20 && buf[3] < 0x7f)
     {
-        int r = cs_complete_http(buf, len, head_only);
+        int r = cs_complete_http(buf, len, head_only, st);
         return r;
     }
+    /* for short buffers HTTP and BER can not be told apart yet */
+    if (st && len > 5)
+        return cs_complete_ber(buf, len, st);
     return completeBER_n(buf, len, 0);
 }
 
+void cs_complete_reset(struct cs_complete_state *st)
+{
+    st->length = 0;
+    st->resume = 0;
+}
+
 int cs_complete_auto(const char *buf, int len)
 {
-    return cs_complete_auto_x(buf, len, 0);
+    return cs_complete_auto_x(buf, len, 0, 0);
 }
 
 int cs_complete_auto_head(const char *buf, int len)
 {
-    return cs_complete_auto_x(buf, len, 1);
+    return cs_complete_auto_x(buf, len, 1, 0);
+}
+
+int cs_complete_auto_r(const char *buf, int len,
+                       struct cs_complete_state *st)
+{
+    return cs_complete_auto_x(buf, len, 0, st);
+}
+
+int cs_complete_auto_head_r(const char *buf, int len,
+                            struct cs_complete_state *st)
+{
+    return cs_complete_auto_x(buf, len, 1, st);
 }
 
 void cs_set_max_recv_bytes(COMSTACK cs, int max_recv_bytes)
@@ -469,6 +569,104 @@ void cs_set_max_recv_bytes(COMSTACK cs, int max_recv_bytes)
     cs->max_recv_bytes = max_recv_bytes;
 }
 
+/* receive buffer pool: size classes CS_BUF_MIN << n up to CS_BUF_MAX.
+   Each class keeps at most CS_BUF_CLASS_BYTES in free buffers */
+#define CS_BUF_MIN 4096
+#define CS_BUF_CLASSES 7
+#define CS_BUF_MAX (CS_BUF_MIN << (CS_BUF_CLASSES - 1))
+#define CS_BUF_CLASS_BYTES (1024*1024)
+
+struct cs_buf_free {
+    struct cs_buf_free *next;
+};
+
+static struct cs_buf_free *cs_buf_list[CS_BUF_CLASSES];
+static int cs_buf_no[CS_BUF_CLASSES];
+static struct cs_buf_stat cs_buf_counters;
+
+#if YAZ_POSIX_THREADS
+static pthread_mutex_t cs_buf_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void cs_buf_lock(void)
+{
+#if YAZ_POSIX_THREADS
+    pthread_mutex_lock(&cs_buf_mutex);
+#endif
+}
+
+static void cs_buf_unlock(void)
+{
+#if YAZ_POSIX_THREADS
+    pthread_mutex_unlock(&cs_buf_mutex);
+#endif
+}
+
+/* returns size class for size, -1 if size is not pooled */
+static int cs_buf_class(int size)
+{
+    int i, class_size = CS_BUF_MIN;
+
+    for (i = 0; i < CS_BUF_CLASSES; i++, class_size <<= 1)
+        if (size == class_size)
+            return i;
+    return -1;
+}
+
+char *cs_buf_get(int size)
+{
+    int c = cs_buf_class(size);
+    struct cs_buf_free *b = 0;
+
+    cs_buf_lock();
+    if (c >= 0 && (b = cs_buf_list[c]))
+    {
+        cs_buf_list[c] = b->next;
+        cs_buf_no[c]--;
+        cs_buf_counters.bytes_free -= size;
+        cs_buf_counters.hits++;
+    }
+    else
+        cs_buf_counters.misses++;
+    cs_buf_unlock();
+    if (b)
+        return (char *) b;
+    return (char *) xmalloc(size);
+}
+
+void cs_buf_release(char **buf, int *size)
+{
+    int c;
+
+    if (!*buf)
+        return;
+    c = cs_buf_class(*size);
+    cs_buf_lock();
+    if (c >= 0 && (cs_buf_no[c] + 1) * *size <= CS_BUF_CLASS_BYTES)
+    {
+        struct cs_buf_free *b = (struct cs_buf_free *) *buf;
+        b->next = cs_buf_list[c];
+        cs_buf_list[c] = b;
+        cs_buf_no[c]++;
+        cs_buf_counters.bytes_free += *size;
+        cs_buf_counters.released++;
+        *buf = 0;
+    }
+    else
+        cs_buf_counters.freed++;
+    cs_buf_unlock();
+    xfree(*buf);
+    *buf = 0;
+    *size = 0;
+}
+
+void cs_buf_get_stat(struct cs_buf_stat *st)
+{
+    cs_buf_lock();
+    *st = cs_buf_counters;
+    cs_buf_unlock();
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
@@ -7,7 +7,13 @@
  * \brief Implements event loop handling for GFS.
  *
  * This source implements the main event loop for the Generic Frontend
- * Server.
+ * Server. Readiness is obtained from a backend: with epoll each channel
+ * stays registered between iterations and is only updated when it changes;
+ * otherwise yaz_poll is called for all channels on every iteration.
+ * Idle timeouts are kept in a binary heap ordered by due time. Activity
+ * on a channel only records the time of the event; the heap entry is
+ * rescheduled when it reaches the top, so each iteration costs
+ * O(changed + ready + expired) rather than O(channels).
  */
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -25,6 +31,12 @@
 #if HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <yaz/poll.h>
 
@@ -32,6 +44,7 @@
 #include <yaz/comstack.h>
 #include <yaz/xmalloc.h>
 #include <yaz/errno.h>
+#include <yaz/gettimeofday.h>
 #include "eventl.h"
 #include "session.h"
 #include <yaz/statserv.h>
@@ -39,6 +52,511 @@
 static int log_level=0;
 static int log_level_initialized=0;
 
+/* ready_mask bit: channel is on the ready list */
+#define IOCHAN_QUEUED 0x100
+
+#define IOCHAN_MAX_EVENTS 128
+
+struct iochan_loop;
+
+/** \brief readiness backend */
+struct iochan_backend {
+    const char *name;
+    /** set up backend. Returns 0 on success, -1 on failure */
+    int (*init)(struct iochan_loop *loop);
+    void (*destroy)(struct iochan_loop *loop);
+    /** returns 1 if registrations were lost and must be redone (fork) */
+    int (*check)(struct iochan_loop *loop);
+    /** registers events for channel. mask = -1 removes registration */
+    int (*update)(struct iochan_loop *loop, IOCHAN p, int mask);
+    /** waits for events and adds ready channels to ready list */
+    int (*wait)(struct iochan_loop *loop, IOCHAN iochans, int msec,
+                IOCHAN *ready);
+    /** non-zero if only changed channels are passed to update */
+    int track_changes;
+};
+
+struct iochan_loop {
+    const struct iochan_backend *backend;
+    IOCHAN dirty;
+    IOCHAN *timers;   /* heap of channels with idle timeout */
+    int num_timers;
+    int timers_size;
+#if HAVE_SYS_EPOLL_H
+    int epoll_fd;
+    pid_t pid;
+    IOCHAN *fd_chans;
+    int fd_chans_size;
+    struct epoll_event events[IOCHAN_MAX_EVENTS];
+#endif
+    struct yaz_poll_fd *fds;
+    int fds_size;
+};
+
+static void iochan_ready(IOCHAN *ready, IOCHAN p, int mask)
+{
+    if (!(p->ready_mask & IOCHAN_QUEUED))
+    {
+        p->ready_next = *ready;
+        *ready = p;
+    }
+    p->ready_mask |= mask | IOCHAN_QUEUED;
+}
+
+static int poll_init(struct iochan_loop *loop)
+{
+    loop->fds = 0;
+    loop->fds_size = 0;
+    return 0;
+}
+
+static void poll_destroy(struct iochan_loop *loop)
+{
+    xfree(loop->fds);
+}
+
+static int poll_update(struct iochan_loop *loop, IOCHAN p, int mask)
+{
+    p->poll_fd = p->fd;
+    p->poll_mask = mask;
+    return 0;
+}
+
+static int poll_wait(struct iochan_loop *loop, IOCHAN iochans, int msec,
+                     IOCHAN *ready)
+{
+    IOCHAN p;
+    int i, res, no_fds = 0;
+
+    for (p = iochans; p; p = p->next)
+        no_fds++;
+    if (no_fds > loop->fds_size)
+    {
+        loop->fds_size = no_fds + no_fds / 2;
+        loop->fds = (struct yaz_poll_fd *)
+            xrealloc(loop->fds, loop->fds_size * sizeof(*loop->fds));
+    }
+    for (i = 0, p = iochans; p; p = p->next, i++)
+    {
+        enum yaz_poll_mask input_mask = yaz_poll_none;
+        if (p->flags & EVENT_INPUT)
+            yaz_poll_add(input_mask, yaz_poll_read);
+        if (p->flags & EVENT_OUTPUT)
+            yaz_poll_add(input_mask, yaz_poll_write);
+        if (p->flags & EVENT_EXCEPT)
+            yaz_poll_add(input_mask, yaz_poll_except);
+        loop->fds[i].fd = p->fd;
+        loop->fds[i].input_mask = input_mask;
+        loop->fds[i].client_data = p;
+    }
+    res = yaz_poll(loop->fds, no_fds, msec / 1000, (msec % 1000) * 1000000);
+    for (i = 0; res > 0 && i < no_fds; i++)
+    {
+        enum yaz_poll_mask output_mask = loop->fds[i].output_mask;
+        int mask = 0;
+
+        if (output_mask & yaz_poll_read)
+            mask |= EVENT_INPUT;
+        if (output_mask & yaz_poll_write)
+            mask |= EVENT_OUTPUT;
+        if (output_mask & yaz_poll_except)
+            mask |= EVENT_EXCEPT;
+        if (mask)
+            iochan_ready(ready, (IOCHAN) loop->fds[i].client_data, mask);
+    }
+    return res;
+}
+
+static const struct iochan_backend poll_backend = {
+    "poll", poll_init, poll_destroy, 0, poll_update, poll_wait, 0
+};
+
+#if HAVE_SYS_EPOLL_H
+static int epoll_init(struct iochan_loop *loop)
+{
+    loop->fd_chans = 0;
+    loop->fd_chans_size = 0;
+    loop->pid = getpid();
+    loop->epoll_fd = epoll_create(IOCHAN_MAX_EVENTS);
+    if (loop->epoll_fd < 0)
+    {
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_create");
+        return -1;
+    }
+    return 0;
+}
+
+static void epoll_destroy(struct iochan_loop *loop)
+{
+    close(loop->epoll_fd);
+    xfree(loop->fd_chans);
+}
+
+static int epoll_check(struct iochan_loop *loop)
+{
+    /* a forked child shares the epoll instance with its parent and
+       must not touch it. Start over with an instance of its own */
+    if (loop->pid == getpid())
+        return 0;
+    epoll_destroy(loop);
+    if (epoll_init(loop))
+    {
+        loop->backend = &poll_backend;
+        poll_init(loop);
+    }
+    return 1;
+}
+
+static int epoll_update(struct iochan_loop *loop, IOCHAN p, int mask)
+{
+    struct epoll_event ev;
+    int op = EPOLL_CTL_MOD;
+
+    memset(&ev, 0, sizeof(ev));
+    if (p->poll_mask != -1 && (mask == -1 || p->poll_fd != p->fd))
+    {
+        /* fails harmlessly if descriptor was closed already */
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, p->poll_fd, &ev);
+        if (p->poll_fd < loop->fd_chans_size &&
+            loop->fd_chans[p->poll_fd] == p)
+            loop->fd_chans[p->poll_fd] = 0;
+        p->poll_mask = -1;
+    }
+    if (mask == -1)
+        return 0;
+    if (p->fd >= loop->fd_chans_size)
+    {
+        int i, old_size = loop->fd_chans_size;
+
+        loop->fd_chans_size = 2 * p->fd + 16;
+        loop->fd_chans = (IOCHAN *)
+            xrealloc(loop->fd_chans, loop->fd_chans_size * sizeof(IOCHAN));
+        for (i = old_size; i < loop->fd_chans_size; i++)
+            loop->fd_chans[i] = 0;
+    }
+    if (mask & EVENT_INPUT)
+        ev.events |= EPOLLIN;
+    if (mask & EVENT_OUTPUT)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = p->fd;
+    if (p->poll_mask == -1)
+        op = EPOLL_CTL_ADD;
+    if (epoll_ctl(loop->epoll_fd, op, p->fd, &ev) < 0)
+    {
+        if (op != EPOLL_CTL_ADD || errno != EEXIST ||
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, p->fd, &ev) < 0)
+        {
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_ctl fd=%d", p->fd);
+            return -1;
+        }
+    }
+    loop->fd_chans[p->fd] = p;
+    p->poll_fd = p->fd;
+    p->poll_mask = mask;
+    return 0;
+}
+
+static int epoll_wait_ready(struct iochan_loop *loop, IOCHAN iochans,
+                            int msec, IOCHAN *ready)
+{
+    int i;
+    int res = epoll_wait(loop->epoll_fd, loop->events, IOCHAN_MAX_EVENTS,
+                         msec);
+
+    for (i = 0; i < res; i++)
+    {
+        unsigned events = loop->events[i].events;
+        int fd = loop->events[i].data.fd;
+        int mask = 0;
+
+        /* registration may be stale if the descriptor is shared with
+           another process. Ignore events for unknown descriptors */
+        if (fd >= loop->fd_chans_size || !loop->fd_chans[fd])
+            continue;
+        if (events & EPOLLIN)
+            mask |= EVENT_INPUT;
+        if (events & EPOLLOUT)
+            mask |= EVENT_OUTPUT;
+        if (events & ~(EPOLLIN | EPOLLOUT))
+            mask |= EVENT_EXCEPT;
+        iochan_ready(ready, loop->fd_chans[fd], mask);
+    }
+    return res;
+}
+
+static const struct iochan_backend epoll_backend = {
+    "epoll", epoll_init, epoll_destroy, epoll_check, epoll_update,
+    epoll_wait_ready, 1
+};
+#endif
+
+static double iochan_now(void)
+{
+    struct timeval tv;
+
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void timer_set(struct iochan_loop *loop, int i, IOCHAN p)
+{
+    loop->timers[i] = p;
+    p->timer_index = i;
+}
+
+static void timer_sift_up(struct iochan_loop *loop, int i)
+{
+    IOCHAN p = loop->timers[i];
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (loop->timers[parent]->timer_due <= p->timer_due)
+            break;
+        timer_set(loop, i, loop->timers[parent]);
+        i = parent;
+    }
+    timer_set(loop, i, p);
+}
+
+static void timer_sift_down(struct iochan_loop *loop, int i)
+{
+    IOCHAN p = loop->timers[i];
+
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= loop->num_timers)
+            break;
+        if (child + 1 < loop->num_timers &&
+            loop->timers[child + 1]->timer_due < loop->timers[child]->timer_due)
+            child++;
+        if (p->timer_due <= loop->timers[child]->timer_due)
+            break;
+        timer_set(loop, i, loop->timers[child]);
+        i = child;
+    }
+    timer_set(loop, i, p);
+}
+
+/* inserts channel in timer heap or moves it according to timer_due */
+static void timer_update(struct iochan_loop *loop, IOCHAN p)
+{
+    if (p->timer_index == -1)
+    {
+        if (loop->num_timers == loop->timers_size)
+        {
+            loop->timers_size = 2 * loop->timers_size + 16;
+            loop->timers = (IOCHAN *)
+                xrealloc(loop->timers, loop->timers_size * sizeof(IOCHAN));
+        }
+        timer_set(loop, loop->num_timers++, p);
+        timer_sift_up(loop, p->timer_index);
+    }
+    else
+    {
+        timer_sift_up(loop, p->timer_index);
+        timer_sift_down(loop, p->timer_index);
+    }
+}
+
+static void timer_remove(struct iochan_loop *loop, IOCHAN p)
+{
+    int i = p->timer_index;
+
+    p->timer_index = -1;
+    if (--loop->num_timers > i)
+    {
+        timer_set(loop, i, loop->timers[loop->num_timers]);
+        timer_update(loop, loop->timers[i]);
+    }
+}
+
+static struct iochan_loop *iochan_loop_create(void)
+{
+    struct iochan_loop *loop = (struct iochan_loop *) xmalloc(sizeof(*loop));
+
+    loop->dirty = 0;
+    loop->timers = 0;
+    loop->num_timers = 0;
+    loop->timers_size = 0;
+#if HAVE_SYS_EPOLL_H
+    loop->backend = &epoll_backend;
+    if (loop->backend->init(loop) == 0)
+        return loop;
+#endif
+    loop->backend = &poll_backend;
+    loop->backend->init(loop);
+    return loop;
+}
+
+static void iochan_loop_destroy(struct iochan_loop *loop, IOCHAN iochans)
+{
+    IOCHAN p;
+
+    /* channels left behind may be destroyed later by others */
+    for (p = iochans; p; p = p->next)
+    {
+        p->loop = 0;
+        p->dirty = 0;
+        p->poll_mask = -1;
+        p->ready_mask = 0;
+        p->timer_index = -1;
+        p->timer_pending = 1;
+    }
+    loop->backend->destroy(loop);
+    xfree(loop->timers);
+    xfree(loop);
+}
+
+void iochan_settimeout(IOCHAN chan, double sec)
+{
+    chan->max_idle = sec;
+    chan->last_event = iochan_now();
+    chan->timer_pending = 1;
+    iochan_changed(chan);
+}
+
+void iochan_changed(IOCHAN chan)
+{
+    struct iochan_loop *loop = chan->loop;
+
+    if (loop && loop->backend->track_changes && !chan->dirty)
+    {
+        chan->dirty = 1;
+        chan->dirty_next = loop->dirty;
+        loop->dirty = chan;
+    }
+}
+
+static void iochan_mark_dirty(struct iochan_loop *loop, IOCHAN p)
+{
+    if (!p->dirty)
+    {
+        p->dirty = 1;
+        p->dirty_next = loop->dirty;
+        loop->dirty = p;
+    }
+}
+
+/* brings backend up to date with channel list. Channels with forced
+   events are put on the ready list */
+static void iochan_loop_sync(struct iochan_loop *loop, IOCHAN *iochans,
+                             IOCHAN *ready)
+{
+    IOCHAN p, nextp, prev = 0, changed = 0, detached = 0;
+
+    if (loop->backend->check && loop->backend->check(loop))
+    {
+        loop->dirty = 0;
+        for (p = *iochans; p; p = p->next)
+        {
+            p->loop = 0;
+            p->dirty = 0;
+        }
+    }
+    /* channels are added to the head of the list */
+    for (p = *iochans; p && p->loop != loop; p = p->next)
+    {
+        p->loop = loop;
+        p->prev = prev;
+        p->poll_mask = -1;
+        p->ready_mask = 0;
+        prev = p;
+        iochan_mark_dirty(loop, p);
+    }
+    if (p)
+        p->prev = prev;
+    if (!loop->backend->track_changes)
+    {
+        for (; p; p = p->next)
+            iochan_mark_dirty(loop, p);
+    }
+    /* remove destroyed channels before registering others, so that
+       a descriptor reused by a new channel is not unregistered */
+    for (p = loop->dirty; p; p = nextp)
+    {
+        nextp = p->dirty_next;
+        p->dirty = 0;
+        if (p->destroyed)
+        {
+            if (p->poll_mask != -1)
+                loop->backend->update(loop, p, -1);
+            if (p->timer_index != -1)
+                timer_remove(loop, p);
+
+            /* We need to inform the threadlist that this channel has been destroyed */
+            statserv_remove(p);
+
+            if (p->prev)
+                p->prev->next = p->next;
+            else
+                *iochans = p->next;
+            if (p->next)
+                p->next->prev = p->prev;
+            xfree(p);
+        }
+        else if (p->detached)
+        {
+            if (p->poll_mask != -1)
+                loop->backend->update(loop, p, -1);
+            if (p->timer_index != -1)
+                timer_remove(loop, p);
+            if (p->prev)
+                p->prev->next = p->next;
+            else
+                *iochans = p->next;
+            if (p->next)
+                p->next->prev = p->prev;
+            p->dirty_next = detached;
+            detached = p;
+        }
+        else
+        {
+            p->dirty_next = changed;
+            changed = p;
+        }
+    }
+    loop->dirty = 0;
+    for (p = changed; p; p = p->dirty_next)
+    {
+        int mask = p->flags & (EVENT_INPUT | EVENT_OUTPUT | EVENT_EXCEPT);
+
+        yaz_log(log_level, "fd=%d flags=%d force_event=%d",
+                p->fd, p->flags, p->force_event);
+        if (p->timer_pending)
+        {
+            p->timer_pending = 0;
+            if (p->max_idle > 0)
+            {
+                p->timer_due = p->last_event + p->max_idle;
+                timer_update(loop, p);
+            }
+            else if (p->timer_index != -1)
+                timer_remove(loop, p);
+        }
+        if (mask != p->poll_mask || p->fd != p->poll_fd)
+        {
+            if (loop->backend->update(loop, p, mask))
+                iochan_ready(ready, p, EVENT_EXCEPT);
+        }
+        if (p->force_event)
+            iochan_ready(ready, p, 0);
+    }
+    /* the owner may hand a detached channel to another thread, so
+       it must not be touched after its callback */
+    for (p = detached; p; p = nextp)
+    {
+        nextp = p->dirty_next;
+        p->detached = 0;
+        p->loop = 0;
+        p->next = p->prev = 0;
+        p->poll_mask = -1;
+        p->timer_pending = p->max_idle > 0;
+        (*p->fun)(p, EVENT_DETACHED);
+    }
+}
+
 IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int chan_id)
 {
     IOCHAN new_iochan;
@@ -52,6 +570,7 @@ IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int chan_id)
     if (!(new_iochan = (IOCHAN)xmalloc(sizeof(*new_iochan))))
         return 0;
     new_iochan->destroyed = 0;
+    new_iochan->detached = 0;
     new_iochan->fd = fd;
     new_iochan->flags = flags;
     new_iochan->fun = cb;
@@ -59,6 +578,17 @@ IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int chan_id)
     new_iochan->last_event = new_iochan->max_idle = 0;
     new_iochan->next = NULL;
     new_iochan->chan_id = chan_id;
+    new_iochan->loop = 0;
+    new_iochan->prev = 0;
+    new_iochan->dirty_next = 0;
+    new_iochan->ready_next = 0;
+    new_iochan->dirty = 0;
+    new_iochan->poll_fd = -1;
+    new_iochan->poll_mask = -1;
+    new_iochan->ready_mask = 0;
+    new_iochan->timer_due = 0.0;
+    new_iochan->timer_index = -1;
+    new_iochan->timer_pending = 0;
     return new_iochan;
 }
 
@@ -80,126 +610,99 @@ int iochan_is_alive(IOCHAN chan)
 
 int iochan_event_loop(IOCHAN *iochans, int *watch_sig)
 {
-    do /* loop as long as there are active associations to process */
+    struct iochan_loop *loop = iochan_loop_create();
+
+    yaz_log(log_level, "event loop using %s", loop->backend->name);
+    while (1) /* loop as long as there are active associations to process */
     {
-        IOCHAN p, nextp;
-        int i;
-        int tv_sec = 3600;
-        int no_fds = 0;
-        struct yaz_poll_fd *fds = 0;
+        IOCHAN p, nextp, ready = 0;
+        int timeout = 3600000; /* milliseconds */
         int res;
-        time_t now = time(0);
+        double now;
 
-        for (p = *iochans; p; p = p->next)
-            no_fds++;
-        fds = (struct yaz_poll_fd *) xmalloc(no_fds * sizeof(*fds));
-        for (i = 0, p = *iochans; p; p = p->next, i++)
+        iochan_loop_sync(loop, iochans, &ready);
+        if (!*iochans)
+            break;
+        now = iochan_now();
+        if (ready)
+            timeout = 0;          /* polling select */
+        else if (loop->num_timers)
         {
-            time_t w, ftime;
-            enum yaz_poll_mask input_mask = yaz_poll_none;
-            yaz_log(log_level, "fd=%d flags=%d force_event=%d",
-                    p->fd, p->flags, p->force_event);
-            if (p->force_event)
-                tv_sec = 0;          /* polling select */
-            if (p->flags & EVENT_INPUT)
-                yaz_poll_add(input_mask, yaz_poll_read);
-            if (p->flags & EVENT_OUTPUT)
-                yaz_poll_add(input_mask, yaz_poll_write);
-            if (p->flags & EVENT_EXCEPT)
-                yaz_poll_add(input_mask, yaz_poll_except);
-            if (p->max_idle && p->last_event)
-            {
-                ftime = p->last_event + p->max_idle;
-                if (ftime < now)
-                    w = p->max_idle;
-                else
-                    w = ftime - now;
-                /* tv_sec will be minimum wait.. */
-                if (w < tv_sec)
-                    tv_sec = (int) w; /* can hold it because w < tv_sec */
-            }
-            fds[i].fd = p->fd;
-            fds[i].input_mask = input_mask;
+            double w = loop->timers[0]->timer_due - now;
+            if (w <= 0.0)
+                timeout = 0;
+            else if (w < 3600.0)
+                timeout = (int) (w * 1000.0) + 1; /* round up */
         }
-        res = yaz_poll(fds, no_fds, tv_sec, 0);
+        res = loop->backend->wait(loop, *iochans, timeout, &ready);
         if (res < 0)
         {
             if (yaz_errno() == EINTR)
             {
-                xfree(fds);
                 if (watch_sig && *watch_sig)
                     break;
-                continue;
             }
             else
-            {
-                yaz_log(YLOG_WARN|YLOG_ERRNO, "yaz_poll");
-                xfree(fds);
-                continue;
-            }
+                yaz_log(YLOG_WARN|YLOG_ERRNO, "%s", loop->backend->name);
         }
-        now = time(0);
-        for (i = 0, p = *iochans; p; p = p->next, i++)
+        now = iochan_now();
+        for (p = ready; p; p = nextp)
         {
             int force_event = p->force_event;
-            enum yaz_poll_mask output_mask = fds[i].output_mask;
+            int mask = p->ready_mask;
 
+            nextp = p->ready_next;
             p->force_event = 0;
-            if (!p->destroyed && ((output_mask & yaz_poll_read) ||
-                                  force_event == EVENT_INPUT))
+            p->ready_mask = 0;
+            if (!p->destroyed && !p->detached &&
+                ((mask & EVENT_INPUT) || force_event == EVENT_INPUT))
             {
                 p->last_event = now;
                 (*p->fun)(p, EVENT_INPUT);
             }
-            if (!p->destroyed && ((output_mask & yaz_poll_write) ||
-                                  force_event == EVENT_OUTPUT))
+            if (!p->destroyed && !p->detached &&
+                ((mask & EVENT_OUTPUT) || force_event == EVENT_OUTPUT))
             {
                 p->last_event = now;
                 (*p->fun)(p, EVENT_OUTPUT);
             }
-            if (!p->destroyed && ((output_mask & yaz_poll_except) ||
-                force_event == EVENT_EXCEPT))
+            if (!p->destroyed && !p->detached &&
+                ((mask & EVENT_EXCEPT) || force_event == EVENT_EXCEPT))
             {
                 p->last_event = now;
                 (*p->fun)(p, EVENT_EXCEPT);
             }
-            if (!p->destroyed && ((p->max_idle && now - p->last_event >=
-                p->max_idle) || force_event == EVENT_TIMEOUT))
+            if (!p->destroyed && !p->detached &&
+                force_event == EVENT_TIMEOUT)
             {
                 p->last_event = now;
                 (*p->fun)(p, EVENT_TIMEOUT);
             }
         }
-        xfree(fds);
-        for (p = *iochans; p; p = nextp)
+        /* expire timers. Activity since a timer was scheduled only moves
+           it further down the heap */
+        while (loop->num_timers && (p = loop->timers[0])->timer_due <= now)
         {
-            nextp = p->next;
-
-            if (p->destroyed)
+            if (p->destroyed || p->detached || p->max_idle <= 0)
+            {
+                timer_remove(loop, p);
+                continue;
+            }
+            if (p->last_event + p->max_idle <= now)
+            {
+                p->last_event = now;
+                p->timer_due = now + p->max_idle;
+                timer_sift_down(loop, 0);
+                (*p->fun)(p, EVENT_TIMEOUT);
+            }
+            else
             {
-                IOCHAN tmp = p, pr;
-
-                /* We need to inform the threadlist that this channel has been destroyed */
-                statserv_remove(p);
-
-                /* Now reset the pointers */
-                if (p == *iochans)
-                    *iochans = p->next;
-                else
-                {
-                    for (pr = *iochans; pr; pr = pr->next)
-                        if (pr->next == p)
-                            break;
-                    assert(pr); /* grave error if it weren't there */
-                    pr->next = p->next;
-                }
-                if (nextp == p)
-                    nextp = p->next;
-                xfree(tmp);
+                p->timer_due = p->last_event + p->max_idle;
+                timer_sift_down(loop, 0);
             }
         }
     }
-    while (*iochans);
+    iochan_loop_destroy(loop, *iochans);
     return 0;
 }
 /*
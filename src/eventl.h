@@ -50,35 +50,81 @@ typedef struct iochan
 #define EVENT_OUTPUT    0x02
 #define EVENT_EXCEPT    0x04
 #define EVENT_TIMEOUT   0x08
+#define EVENT_DETACHED  0x10
 int force_event;
     IOC_CALLBACK fun;
     void *data;
     int destroyed;
-    time_t last_event;
-    time_t max_idle;
+    int detached;
+    double last_event;
+    double max_idle;   /* idle timeout in seconds (0: none) */
 
     struct iochan *next;
     int chan_id; /* listening port (0 if none ) */
+
+    /* private to the event loop */
+    struct iochan_loop *loop; /* loop that has registered this channel */
+    struct iochan *prev;
+    struct iochan *dirty_next;
+    struct iochan *ready_next;
+    int dirty;
+    int poll_fd;    /* fd as registered with readiness backend */
+    int poll_mask;  /* events registered with readiness backend (-1: none) */
+    int ready_mask; /* events reported by readiness backend */
+    double timer_due;  /* time at which timer was last scheduled */
+    int timer_index;   /* position in timer heap (-1: none) */
+    int timer_pending; /* timeout changed since last sync */
 } *IOCHAN;
 
-#define iochan_destroy(i) (void)((i)->destroyed = 1)
+#define iochan_destroy(i) (void)((i)->destroyed = 1, iochan_changed(i))
+#define iochan_detach(i) (void)((i)->detached = 1, iochan_changed(i))
 #define iochan_getfd(i) ((i)->fd)
-#define iochan_setfd(i, f) ((i)->fd = (f))
+#define iochan_setfd(i, f) ((i)->fd = (f), iochan_changed(i))
 #define iochan_getdata(i) ((i)->data)
 #define iochan_setdata(i, d) ((i)->data = d)
 #define iochan_getflags(i) ((i)->flags)
-#define iochan_setflags(i, d) ((i)->flags = d)
-#define iochan_setflag(i, d) ((i)->flags |= d)
-#define iochan_clearflag(i, d) ((i)->flags &= ~(d))
+#define iochan_setflags(i, d) ((i)->flags = d, iochan_changed(i))
+#define iochan_setflag(i, d) ((i)->flags |= d, iochan_changed(i))
+#define iochan_clearflag(i, d) ((i)->flags &= ~(d), iochan_changed(i))
 #define iochan_getflag(i, d) ((i)->flags & d ? 1 : 0)
 #define iochan_getfun(i) ((i)->fun)
 #define iochan_setfun(i, d) ((i)->fun = d)
-#define iochan_setevent(i, e) ((i)->force_event = (e))
+#define iochan_setevent(i, e) ((i)->force_event = (e), iochan_changed(i))
 #define iochan_getnext(i) ((i)->next)
-#define iochan_settimeout(i, t) ((i)->max_idle = (t), (i)->last_event = time(0))
 
 IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int port);
 int iochan_is_alive(IOCHAN chan);
+
+/** \brief sets idle timeout for channel
+    \param chan channel
+    \param sec seconds of inactivity before EVENT_TIMEOUT (0 disables)
+
+    The timeout has millisecond resolution and is restarted by every
+    event delivered to the channel.
+*/
+void iochan_settimeout(IOCHAN chan, double sec);
+
+/** \brief marks channel as modified for the event loop
+    \param chan channel whose flags, fd, forced event or state changed
+
+    Called by the iochan_set.. macros. The readiness backend of the loop
+    owning the channel is updated before the next wait.
+*/
+void iochan_changed(IOCHAN chan);
+
+/** \brief runs event loop until all channels are destroyed
+    \param iochans list of channels
+    \param watch_sig if non-NULL, stop when *watch_sig is set on EINTR
+    \retval 0 always
+
+    Channels may be added to the list while the loop is running, but
+    only at the head of the list (chan->next = *iochans; *iochans = chan).
+
+    A channel marked with iochan_detach is taken off the list before the
+    next wait and its callback is invoked with EVENT_DETACHED. From then
+    on the loop no longer refers to it; it may be handed to another
+    thread and later be added to the head of any list again.
+*/
 int iochan_event_loop(IOCHAN *iochans, int *watch_sig);
 void statserv_remove (IOCHAN pIOChannel);
 #endif
@@ -613,11 +613,10 @@ static void dump_http_package(ODR o, const char *buf, size_t len)
     }
 }
 
-int yaz_encode_http_response(ODR o, Z_HTTP_Response *hr)
+int yaz_encode_http_response_head(ODR o, Z_HTTP_Response *hr)
 {
     char sbuf[80];
     Z_HTTP_Header *h;
-    int top0 = o->op->top;
 
     yaz_snprintf(sbuf, sizeof(sbuf), "HTTP/%s %d %s\r\n", hr->version,
             hr->code,
@@ -638,6 +637,14 @@ int yaz_encode_http_response(ODR o, Z_HTTP_Response *hr)
         }
     }
     odr_write(o, "\r\n", 2);
+    return odr_geterror(o) ? 0 : 1;
+}
+
+int yaz_encode_http_response(ODR o, Z_HTTP_Response *hr)
+{
+    int top0 = o->op->top;
+
+    yaz_encode_http_response_head(o, hr);
     if (hr->content_buf)
         odr_write(o, hr->content_buf, hr->content_len);
     if (o->direction == ODR_PRINT)
@@ -49,6 +49,12 @@ struct yaz_iconv_encoder_s {
                            char **outbuf, size_t *outbytesleft);
     void (*init_handle)(yaz_iconv_encoder_t e);
     void (*destroy_handle)(yaz_iconv_encoder_t e);
+    /* optional: writes printable ASCII characters inp[0..len-1] as
+       write_handle would; returns number of characters consumed (0 if
+       write_handle must be used for the first one) */
+    size_t (*write_ascii_handle)(yaz_iconv_t cd, yaz_iconv_encoder_t e,
+                                 const unsigned char *inp, size_t len,
+                                 char **outbuf, size_t *outbytesleft);
 };
 
 yaz_iconv_encoder_t yaz_marc8_encoder(const char *name,
@@ -87,6 +93,10 @@ struct yaz_iconv_decoder_s {
                                  unsigned char *inbuf,
                                  size_t inbytesleft, size_t *no_read);
     void (*destroy_handle)(yaz_iconv_decoder_t d);
+    /* optional: returns number of leading bytes that read_handle would
+       decode one by one to the same printable ASCII characters */
+    size_t (*read_ascii_handle)(yaz_iconv_decoder_t d,
+                                const unsigned char *inp, size_t inbytesleft);
 };
 
 yaz_iconv_decoder_t yaz_marc8_decoder(const char *fromcode,
@@ -110,6 +120,14 @@ yaz_iconv_decoder_t yaz_danmarc_decoder(const char *fromcode,
 
 int yaz_danmarc_is_combining(unsigned long ch);
 
+/* SSE2 is part of x86-64 and may be used without a run time check */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define YAZ_ICONV_SSE2 1
+#endif
+
+size_t yaz_iconv_ascii_span(const unsigned char *inp, size_t len);
+
 unsigned long yaz_danmarc_swap_to_danmarc(unsigned long ch);
 
 #endif
@@ -200,6 +200,22 @@ static size_t init_danmarc(yaz_iconv_t cd, yaz_iconv_decoder_t d,
     return 0;
 }
 
+static size_t read_ascii_danmarc(yaz_iconv_decoder_t d,
+                                 const unsigned char *inp, size_t inbytesleft)
+{
+    struct decoder_data *data = (struct decoder_data *) d->data;
+    size_t i, n;
+
+    if (data->sz)
+        return 0;
+    n = yaz_iconv_ascii_span(inp, inbytesleft);
+    /* escape character and those mapped to combining characters */
+    for (i = 0; i < n; i++)
+        if (inp[i] == '@' || inp[i] == '^' || inp[i] == '_' || inp[i] == '`')
+            break;
+    return i;
+}
+
 void destroy_danmarc(yaz_iconv_decoder_t d)
 {
     struct decoder_data *data = (struct decoder_data *) d->data;
@@ -217,6 +233,7 @@ yaz_iconv_decoder_t yaz_danmarc_decoder(const char *fromcode,
             xmalloc(sizeof(*data));
         d->data = data;
         d->read_handle = read_danmarc_comb;
+        d->read_ascii_handle = read_ascii_danmarc;
         d->init_handle = init_danmarc;
         d->destroy_handle = destroy_danmarc;
         return d;
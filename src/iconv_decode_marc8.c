@@ -267,6 +267,18 @@ static size_t init_marc8c(yaz_iconv_t cd, yaz_iconv_decoder_t d,
     return 0;
 }
 
+static size_t read_ascii_marc8(yaz_iconv_decoder_t d,
+                              const unsigned char *inp, size_t inbytesleft)
+{
+    struct decoder_data *data = (struct decoder_data *) d->data;
+
+    /* no pending combining characters and G0 is ASCII */
+    if (data->comb_offset < data->comb_size
+        || (data->g0_mode != 'B' && data->g0_mode != 's'))
+        return 0;
+    return yaz_iconv_ascii_span(inp, inbytesleft);
+}
+
 void destroy_marc8(yaz_iconv_decoder_t d)
 {
     struct decoder_data *data = (struct decoder_data *) d->data;
@@ -297,6 +309,7 @@ yaz_iconv_decoder_t yaz_marc8_decoder(const char *fromcode,
         struct decoder_data *data = (struct decoder_data *)
             xmalloc(sizeof(*data));
         d->data = data;
+        d->read_ascii_handle = read_ascii_marc8;
         d->destroy_handle = destroy_marc8;
     }
     return d;
@@ -149,6 +149,30 @@ static size_t write_danmarc(yaz_iconv_t cd, yaz_iconv_encoder_t e,
     return 0;
 }
 
+static size_t write_ascii_danmarc(yaz_iconv_t cd, yaz_iconv_encoder_t e,
+                                  const unsigned char *inp, size_t len,
+                                  char **outbuf, size_t *outbytesleft)
+{
+    struct encoder_data *w = (struct encoder_data *) e->data;
+    size_t i, n;
+
+    for (i = 0; i < len; i++)
+        if (inp[i] == '@' || inp[i] == '*') /* escaped by write1 */
+            break;
+    if (i == 0 || flush_danmarc(cd, e, outbuf, outbytesleft))
+        return 0;
+    /* as write_danmarc: last character is kept as base_char because
+       combining characters may follow */
+    n = i - 1;
+    if (n > *outbytesleft)
+        n = *outbytesleft;
+    memcpy(*outbuf, inp, n);
+    *outbuf += n;
+    *outbytesleft -= n;
+    w->base_char = inp[n];
+    return n + 1;
+}
+
 static void init_danmarc(yaz_iconv_encoder_t e)
 {
     struct encoder_data *w = (struct encoder_data *) e->data;
@@ -172,6 +196,7 @@ yaz_iconv_encoder_t yaz_danmarc_encoder(const char *tocode,
         data->dia = 0;
         e->data = data;
         e->write_handle = write_danmarc;
+        e->write_ascii_handle = write_ascii_danmarc;
         e->flush_handle = flush_danmarc;
         e->init_handle = init_danmarc;
         e->destroy_handle = destroy_danmarc;
@@ -184,6 +209,7 @@ yaz_iconv_encoder_t yaz_danmarc_encoder(const char *tocode,
         data->dia = 1;
         e->data = data;
         e->write_handle = write_danmarc;
+        e->write_ascii_handle = write_ascii_danmarc;
         e->flush_handle = flush_danmarc;
         e->init_handle = init_danmarc;
         e->destroy_handle = destroy_danmarc;
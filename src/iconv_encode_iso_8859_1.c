@@ -189,6 +189,41 @@ static size_t write_iso_8859_1(yaz_iconv_t cd, yaz_iconv_encoder_t e,
     return 0;
 }
 
+static size_t write_ascii_iso_8859_1(yaz_iconv_t cd, yaz_iconv_encoder_t e,
+                                     const unsigned char *inp, size_t len,
+                                     char **outbuf, size_t *outbytesleft)
+{
+    struct encoder_data *w = (struct encoder_data *) e->data;
+    size_t n;
+
+    /* as write_iso_8859_1: the last letter is kept in compose_char
+       because a combining character may follow */
+    if (w->compose_char)
+    {
+        if (*outbytesleft < 1)
+            return 0;
+        *(*outbuf)++ = (char) w->compose_char;
+        (*outbytesleft)--;
+        w->compose_char = 0;
+    }
+    n = len - 1;
+    if (n > *outbytesleft)
+        n = *outbytesleft;
+    memcpy(*outbuf, inp, n);
+    *outbuf += n;
+    *outbytesleft -= n;
+    if (inp[n] != ' ')
+        w->compose_char = inp[n];
+    else if (*outbytesleft < 1)
+        return n;
+    else
+    {
+        *(*outbuf)++ = ' ';
+        (*outbytesleft)--;
+    }
+    return n + 1;
+}
+
 static size_t flush_iso_8859_1(yaz_iconv_t cd, yaz_iconv_encoder_t e,
                                char **outbuf, size_t *outbytesleft)
 {
@@ -231,6 +266,7 @@ yaz_iconv_encoder_t yaz_iso_8859_1_encoder(const char *tocode,
             xmalloc(sizeof(*data));
         e->data = data;
         e->write_handle = write_iso_8859_1;
+        e->write_ascii_handle = write_ascii_iso_8859_1;
         e->flush_handle = flush_iso_8859_1;
         e->init_handle = init_iso_8859_1;
         e->destroy_handle = destroy_iso_8859_1;
@@ -249,6 +285,13 @@ static unsigned long read_ISO8859_1(yaz_iconv_t cd,
     return x;
 }
 
+static size_t read_ascii_ISO8859_1(yaz_iconv_decoder_t d,
+                                   const unsigned char *inp,
+                                   size_t inbytesleft)
+{
+    return yaz_iconv_ascii_span(inp, inbytesleft);
+}
+
 yaz_iconv_decoder_t yaz_iso_8859_1_decoder(const char *fromcode,
                                            yaz_iconv_decoder_t d)
 
@@ -256,6 +299,7 @@ yaz_iconv_decoder_t yaz_iso_8859_1_decoder(const char *fromcode,
     if (!yaz_matchstr(fromcode, "iso88591"))
     {
         d->read_handle = read_ISO8859_1;
+        d->read_ascii_handle = read_ascii_ISO8859_1;
         return d;
     }
     return 0;
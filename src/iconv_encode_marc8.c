@@ -22,18 +22,8 @@
 #include <yaz/snprintf.h>
 #include "iconv-p.h"
 
-yaz_conv_func_t yaz_marc8r_42_conv;
-yaz_conv_func_t yaz_marc8r_45_conv;
-yaz_conv_func_t yaz_marc8r_67_conv;
-yaz_conv_func_t yaz_marc8r_62_conv;
-yaz_conv_func_t yaz_marc8r_70_conv;
-yaz_conv_func_t yaz_marc8r_32_conv;
-yaz_conv_func_t yaz_marc8r_4E_conv;
-yaz_conv_func_t yaz_marc8r_51_conv;
-yaz_conv_func_t yaz_marc8r_33_conv;
-yaz_conv_func_t yaz_marc8r_34_conv;
-yaz_conv_func_t yaz_marc8r_53_conv;
-yaz_conv_func_t yaz_marc8r_31_conv;
+/* generated by charconv.tcl -r: MARC-8 code for UCS code point */
+unsigned long yaz_marc8r_lookup(unsigned long ucs, int *combining, int *set);
 
 #define ESC "\033"
 
@@ -67,96 +57,48 @@ static unsigned long lookup_marc8(yaz_iconv_t cd,
                                   unsigned long x, int *comb,
                                   const char **page_chr)
 {
-    char utf8_buf[7];
-    char *utf8_outbuf = utf8_buf;
-    size_t utf8_outbytesleft = sizeof(utf8_buf)-1, r;
-    int error_code;
+    int set = 0;
+    unsigned long y = yaz_marc8r_lookup(x, comb, &set);
 
-    r = yaz_write_UTF8_char(x, &utf8_outbuf, &utf8_outbytesleft, &error_code);
-    if (r == (size_t)(-1))
+    switch (set)
     {
-        yaz_iconv_set_errno(cd, YAZ_ICONV_EILSEQ);
-        return 0;
+    case 0x42: /* Basic Latin */
+    case 0x45: /* Extended Latin */
+        *page_chr = ESC "(B";
+        break;
+    case 0x62:
+        *page_chr = ESC "b";
+        break;
+    case 0x70:
+        *page_chr = ESC "p";
+        break;
+    case 0x32:
+        *page_chr = ESC "(2";
+        break;
+    case 0x4E:
+        *page_chr = ESC "(N";
+        break;
+    case 0x51:
+        *page_chr = ESC "(Q";
+        break;
+    case 0x33:
+        *page_chr = ESC "(3";
+        break;
+    case 0x34:
+        *page_chr = ESC "(4";
+        break;
+    case 0x53:
+        *page_chr = ESC "(S";
+        break;
+    case 0x31:
+        *page_chr = ESC "$1";
+        break;
+    default:
+        y = 0;
     }
-    else
-    {
-        unsigned char *inp;
-        size_t inbytesleft, no_read_sub = 0;
-        unsigned long x;
-
-        *utf8_outbuf = '\0';
-        inp = (unsigned char *) utf8_buf;
-        inbytesleft = strlen(utf8_buf);
-
-        x = yaz_marc8r_42_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(B";
-            return x;
-        }
-        x = yaz_marc8r_45_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(B";
-            return x;
-        }
-        x = yaz_marc8r_62_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "b";
-            return x;
-        }
-        x = yaz_marc8r_70_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "p";
-            return x;
-        }
-        x = yaz_marc8r_32_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(2";
-            return x;
-        }
-        x = yaz_marc8r_4E_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(N";
-            return x;
-        }
-        x = yaz_marc8r_51_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(Q";
-            return x;
-        }
-        x = yaz_marc8r_33_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(3";
-            return x;
-        }
-        x = yaz_marc8r_34_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(4";
-            return x;
-        }
-        x = yaz_marc8r_53_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "(S";
-            return x;
-        }
-        x = yaz_marc8r_31_conv(inp, inbytesleft, &no_read_sub, comb, 255, 0);
-        if (x)
-        {
-            *page_chr = ESC "$1";
-            return x;
-        }
+    if (!y)
         yaz_iconv_set_errno(cd, YAZ_ICONV_EILSEQ);
-        return x;
-    }
+    return y;
 }
 
 static size_t flush_combos(yaz_iconv_t cd,
@@ -385,6 +327,37 @@ static size_t yaz_write_marc8_generic(yaz_iconv_t cd, struct encoder_data *w,
     return yaz_write_marc8_2(cd, w, x, outbuf, outbytesleft, loss_mode);
 }
 
+static size_t write_ascii_marc8(yaz_iconv_t cd, yaz_iconv_encoder_t e,
+                                const unsigned char *inp, size_t len,
+                                char **outbuf, size_t *outbytesleft)
+{
+    struct encoder_data *w = (struct encoder_data *) e->data;
+    size_t n;
+
+    if (flush_combos(cd, w, outbuf, outbytesleft))
+        return 0;
+    /* as yaz_write_marc8_2: last character is kept in write_marc8_last
+       because combining characters may follow. A pending second half of
+       a double diacritic goes after the first character */
+    n = len - 1;
+    if (n > *outbytesleft || w->write_marc8_second_half_char)
+        n = w->write_marc8_second_half_char ? 0 : *outbytesleft;
+    if (n)
+    {
+        if (yaz_write_marc8_page_chr(cd, w, outbuf, outbytesleft, ESC "(B"))
+            return 0;
+        if (n > *outbytesleft)
+            n = *outbytesleft;
+        memcpy(*outbuf, inp, n);
+        *outbuf += n;
+        *outbytesleft -= n;
+    }
+    w->write_marc8_last = inp[n];
+    w->write_marc8_lpage = ESC "(B";
+    w->write_marc8_ncr = 0;
+    return n + 1;
+}
+
 static size_t write_marc8_normal(yaz_iconv_t cd, yaz_iconv_encoder_t e,
                                  unsigned long x,
                                  char **outbuf, size_t *outbytesleft)
@@ -445,6 +418,7 @@ yaz_iconv_encoder_t yaz_marc8_encoder(const char *tocode,
         e->data = data;
         e->destroy_handle = destroy_marc8;
         e->flush_handle = flush_marc8;
+        e->write_ascii_handle = write_ascii_marc8;
         e->init_handle = init_marc8;
     }
     return e;
@@ -23,7 +23,6 @@
 #include <yaz/marcdisp.h>
 #include <yaz/wrbuf.h>
 #include <yaz/yaz-util.h>
-#include <yaz/nmem_xml.h>
 #include <yaz/snprintf.h>
 
 #if YAZ_HAVE_XML2
@@ -37,7 +36,7 @@ enum yaz_collection_state {
     collection_second
 };
 
-/** \brief node types for yaz_marc_node */
+/** \brief field types for yaz_marc_field */
 enum YAZ_MARC_NODE_TYPE
 {
     YAZ_MARC_DATAFIELD,
@@ -46,40 +45,31 @@ enum YAZ_MARC_NODE_TYPE
     YAZ_MARC_LEADER
 };
 
-/** \brief represents a data field */
-struct yaz_marc_datafield {
-    char *tag;
-    char *indicator;
-    struct yaz_marc_subfield *subfields;
-};
-
-/** \brief represents a control field */
-struct yaz_marc_controlfield {
-    char *tag;
-    char *data;
-};
-
-/** \brief a comment node */
-struct yaz_marc_comment {
-    char *comment;
-};
+/** \brief directory entry of a record
 
-/** \brief MARC node */
-struct yaz_marc_node {
+    All strings are 0-terminated and stored in the data buffer of the
+    handle; entries hold offsets into it, so that the buffer may grow.
+    Subfields of a data field are consecutive in the subfield array,
+    which holds the offsets of code + data of each subfield.
+*/
+struct yaz_marc_field {
     enum YAZ_MARC_NODE_TYPE which;
-    union {
-        struct yaz_marc_datafield datafield;
-        struct yaz_marc_controlfield controlfield;
-        char *comment;
-        char *leader;
-    } u;
-    struct yaz_marc_node *next;
+    size_t tag;            /* data and control field */
+    size_t data;           /* indicator, control field data, comment, leader */
+    size_t subfield;       /* index of first subfield (data field) */
+    size_t num_subfields;
 };
 
-/** \brief represents a subfield */
-struct yaz_marc_subfield {
-    char *code_data;
-    struct yaz_marc_subfield *next;
+/** \brief directory entry of ISO2709 record being transcoded
+
+    Offsets are into the ISO2709 buffer. For a data field, data is the
+    offset of the indicators and subfields follow them.
+*/
+struct iso2709_entry {
+    int tag;
+    int data;
+    int ind_len;           /* bytes of indicators; 0 for control field */
+    int end;               /* offset of field separator */
 };
 
 /** \brief the internals of a yaz_marc_t handle */
@@ -94,11 +84,20 @@ struct yaz_marc_t_ {
     char subfield_str[8];
     char endline_str[8];
     char *leader_spec;
-    struct yaz_marc_node *nodes;
-    struct yaz_marc_node **nodes_pp;
-    struct yaz_marc_subfield **subfield_pp;
+    WRBUF data;            /* all strings of record */
+    struct yaz_marc_field *fields;
+    size_t num_fields;
+    size_t max_fields;
+    size_t *subfields;     /* offsets into data */
+    size_t num_subfields;
+    size_t max_subfields;
+    struct yaz_marc_field *cur_datafield; /* receives subfields */
+    struct iso2709_entry *entries; /* used by marc_transcode_iso2709 */
+    size_t max_entries;
 };
 
+#define MARC_STR(mt, off) (wrbuf_buf((mt)->data) + (off))
+
 yaz_marc_t yaz_marc_create(void)
 {
     yaz_marc_t mt = (yaz_marc_t) xmalloc(sizeof(*mt));
@@ -112,6 +111,14 @@ yaz_marc_t yaz_marc_create(void)
     strcpy(mt->subfield_str, " $");
     strcpy(mt->endline_str, "\n");
 
+    mt->data = wrbuf_alloc();
+    mt->fields = 0;
+    mt->max_fields = 0;
+    mt->subfields = 0;
+    mt->max_subfields = 0;
+    mt->entries = 0;
+    mt->max_entries = 0;
+
     mt->nmem = nmem_create();
     yaz_marc_reset(mt);
     return mt;
@@ -123,6 +130,10 @@ void yaz_marc_destroy(yaz_marc_t mt)
         return ;
     nmem_destroy(mt->nmem);
     wrbuf_destroy(mt->m_wr);
+    wrbuf_destroy(mt->data);
+    xfree(mt->fields);
+    xfree(mt->subfields);
+    xfree(mt->entries);
     xfree(mt->leader_spec);
     xfree(mt);
 }
@@ -146,33 +157,67 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
                                         const char *type);
 #endif
 
-static struct yaz_marc_node *yaz_marc_add_node(yaz_marc_t mt)
+/* copies string to data buffer and returns its offset */
+static size_t marc_add_str(yaz_marc_t mt, const char *str, size_t len)
 {
-    struct yaz_marc_node *n = (struct yaz_marc_node *)
-        nmem_malloc(mt->nmem, sizeof(*n));
-    n->next = 0;
-    *mt->nodes_pp = n;
-    mt->nodes_pp = &n->next;
-    return n;
+    size_t off = wrbuf_len(mt->data);
+
+    wrbuf_write(mt->data, str, len);
+    wrbuf_putc(mt->data, '\0');
+    return off;
+}
+
+static struct yaz_marc_field *yaz_marc_add_field(
+    yaz_marc_t mt, enum YAZ_MARC_NODE_TYPE which)
+{
+    struct yaz_marc_field *f;
+
+    if (mt->num_fields == mt->max_fields)
+    {
+        size_t cur = mt->cur_datafield ? mt->cur_datafield - mt->fields : 0;
+
+        mt->max_fields = mt->max_fields ? 2 * mt->max_fields : 64;
+        mt->fields = (struct yaz_marc_field *)
+            xrealloc(mt->fields, mt->max_fields * sizeof(*mt->fields));
+        if (mt->cur_datafield)
+            mt->cur_datafield = mt->fields + cur;
+    }
+    f = mt->fields + mt->num_fields++;
+    f->which = which;
+    f->tag = f->data = 0;
+    f->subfield = mt->num_subfields;
+    f->num_subfields = 0;
+    return f;
 }
 
 #if YAZ_HAVE_XML2
+/* adds text of sibling text nodes as one string; returns its offset */
+static size_t marc_add_text_nodes(yaz_marc_t mt, const xmlNode *ptr_cdata)
+{
+    size_t off = wrbuf_len(mt->data);
+    const xmlNode *ptr;
+
+    for (ptr = ptr_cdata; ptr; ptr = ptr->next)
+        if (ptr->type == XML_TEXT_NODE)
+            wrbuf_puts(mt->data, (const char *) ptr->content);
+    wrbuf_putc(mt->data, '\0');
+    return off;
+}
+
 void yaz_marc_add_controlfield_xml(yaz_marc_t mt, const xmlNode *ptr_tag,
                                    const xmlNode *ptr_data)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
-    n->u.controlfield.data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_CONTROLFIELD);
+    f->tag = marc_add_text_nodes(mt, ptr_tag);
+    f->data = marc_add_text_nodes(mt, ptr_data);
 }
 
 void yaz_marc_add_controlfield_xml2(yaz_marc_t mt, char *tag,
                                     const xmlNode *ptr_data)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = tag;
-    n->u.controlfield.data = nmem_text_node_cdata(ptr_data, mt->nmem);
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_CONTROLFIELD);
+    f->tag = marc_add_str(mt, tag, strlen(tag));
+    f->data = marc_add_text_nodes(mt, ptr_data);
 }
 
 #endif
@@ -180,9 +225,8 @@ void yaz_marc_add_controlfield_xml2(yaz_marc_t mt, char *tag,
 
 void yaz_marc_add_comment(yaz_marc_t mt, char *comment)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_COMMENT;
-    n->u.comment = nmem_strdup(mt->nmem, comment);
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_COMMENT);
+    f->data = marc_add_str(mt, comment, strlen(comment));
 }
 
 void yaz_marc_cprintf(yaz_marc_t mt, const char *fmt, ...)
@@ -203,19 +247,17 @@ int yaz_marc_get_debug(yaz_marc_t mt)
 
 void yaz_marc_add_leader(yaz_marc_t mt, const char *leader, size_t leader_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_LEADER;
-    n->u.leader = nmem_strdupn(mt->nmem, leader, leader_len);
-    marc_exec_leader(mt->leader_spec, n->u.leader, leader_len);
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_LEADER);
+    f->data = marc_add_str(mt, leader, leader_len);
+    marc_exec_leader(mt->leader_spec, MARC_STR(mt, f->data), leader_len);
 }
 
 void yaz_marc_add_controlfield(yaz_marc_t mt, const char *tag,
                                const char *data, size_t data_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_CONTROLFIELD;
-    n->u.controlfield.tag = nmem_strdup(mt->nmem, tag);
-    n->u.controlfield.data = nmem_strdupn(mt->nmem, data, data_len);
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_CONTROLFIELD);
+    f->tag = marc_add_str(mt, tag, strlen(tag));
+    f->data = marc_add_str(mt, data, data_len);
     if (mt->debug)
     {
         size_t i;
@@ -233,15 +275,12 @@ void yaz_marc_add_controlfield(yaz_marc_t mt, const char *tag,
 void yaz_marc_add_datafield(yaz_marc_t mt, const char *tag,
                             const char *indicator, size_t indicator_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = nmem_strdup(mt->nmem, tag);
-    n->u.datafield.indicator =
-        nmem_strdupn(mt->nmem, indicator, indicator_len);
-    n->u.datafield.subfields = 0;
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_DATAFIELD);
+    f->tag = marc_add_str(mt, tag, strlen(tag));
+    f->data = marc_add_str(mt, indicator, indicator_len);
 
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
+    /* subfields are added to this one from now on */
+    mt->cur_datafield = f;
 }
 
 /** \brief adds a attribute value to the element name if it is plain chars
@@ -252,7 +291,7 @@ void yaz_marc_add_datafield(yaz_marc_t mt, const char *tag,
 */
 static int element_name_append_attribute_value(
     yaz_marc_t mt, WRBUF buffer,
-    const char *attribute_name, char *code_data, size_t code_len)
+    const char *attribute_name, const char *code_data, size_t code_len)
 {
     /* TODO Map special codes to something possible for XML ELEMENT names */
 
@@ -271,7 +310,10 @@ static int element_name_append_attribute_value(
         wrbuf_printf(buffer, " %s=\"", attribute_name);
 
     if (!encode || attribute_name)
+    {
         wrbuf_iconv_write_cdata(buffer, mt->iconv_cd, code_data, code_len);
+        marc_iconv_reset(mt, buffer);
+    }
     else
         success = -1;
 
@@ -284,31 +326,22 @@ static int element_name_append_attribute_value(
 void yaz_marc_add_datafield_xml(yaz_marc_t mt, const xmlNode *ptr_tag,
                                 const char *indicator, size_t indicator_len)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = nmem_text_node_cdata(ptr_tag, mt->nmem);
-    n->u.datafield.indicator = nmem_strdup(mt->nmem, indicator);
-    n->u.datafield.subfields = 0;
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_DATAFIELD);
+    f->tag = marc_add_text_nodes(mt, ptr_tag);
+    f->data = marc_add_str(mt, indicator, strlen(indicator));
 
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
+    /* subfields are added to this one from now on */
+    mt->cur_datafield = f;
 }
 
 void yaz_marc_add_datafield_xml2(yaz_marc_t mt, char *tag_value, char *indicators)
 {
-    struct yaz_marc_node *n = yaz_marc_add_node(mt);
-    n->which = YAZ_MARC_DATAFIELD;
-    n->u.datafield.tag = tag_value;
-    n->u.datafield.indicator = indicators;
-    n->u.datafield.subfields = 0;
+    struct yaz_marc_field *f = yaz_marc_add_field(mt, YAZ_MARC_DATAFIELD);
+    f->tag = marc_add_str(mt, tag_value, strlen(tag_value));
+    f->data = marc_add_str(mt, indicators, indicators ? strlen(indicators) : 0);
 
-    /* make subfield_pp the current (last one) */
-    mt->subfield_pp = &n->u.datafield.subfields;
-}
-
-void yaz_marc_datafield_set_indicators(struct yaz_marc_node *n, char *indicator)
-{
-    n->u.datafield.indicator = indicator;
+    /* subfields are added to this one from now on */
+    mt->cur_datafield = f;
 }
 
 #endif
@@ -329,15 +362,18 @@ void yaz_marc_add_subfield(yaz_marc_t mt,
         yaz_marc_add_comment(mt, msg);
     }
 
-    if (mt->subfield_pp)
+    if (mt->cur_datafield)
     {
-        struct yaz_marc_subfield *n = (struct yaz_marc_subfield *)
-            nmem_malloc(mt->nmem, sizeof(*n));
-        n->code_data = nmem_strdupn(mt->nmem, code_data, code_data_len);
-        n->next = 0;
-        /* mark subfield_pp to point to this one, so we append here next */
-        *mt->subfield_pp = n;
-        mt->subfield_pp = &n->next;
+        if (mt->num_subfields == mt->max_subfields)
+        {
+            mt->max_subfields = mt->max_subfields ? 2 * mt->max_subfields : 256;
+            mt->subfields = (size_t *)
+                xrealloc(mt->subfields,
+                         mt->max_subfields * sizeof(*mt->subfields));
+        }
+        mt->subfields[mt->num_subfields++] =
+            marc_add_str(mt, code_data, code_data_len);
+        mt->cur_datafield->num_subfields++;
     }
 }
 
@@ -483,21 +519,22 @@ size_t yaz_marc_sizeof_char(yaz_marc_t mt, const char *buf)
 void yaz_marc_reset(yaz_marc_t mt)
 {
     nmem_reset(mt->nmem);
-    mt->nodes = 0;
-    mt->nodes_pp = &mt->nodes;
-    mt->subfield_pp = 0;
+    wrbuf_rewind(mt->data);
+    mt->num_fields = 0;
+    mt->num_subfields = 0;
+    mt->cur_datafield = 0;
 }
 
 int yaz_marc_write_check(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n;
+    size_t i;
     int identifier_length;
     const char *leader = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            leader = MARC_STR(mt, mt->fields[i].data);
             break;
         }
 
@@ -506,13 +543,15 @@ int yaz_marc_write_check(yaz_marc_t mt, WRBUF wr)
     if (!atoi_n_check(leader+11, 1, &identifier_length))
         return -1;
 
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
-        switch(n->which)
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *comment;
+        switch(f->which)
         {
         case YAZ_MARC_COMMENT:
-            wrbuf_iconv_write(wr, mt->iconv_cd,
-                              n->u.comment, strlen(n->u.comment));
+            comment = MARC_STR(mt, f->data);
+            wrbuf_iconv_write(wr, mt->iconv_cd, comment, strlen(comment));
             wrbuf_puts(wr, "\n");
             break;
         default:
@@ -525,25 +564,34 @@ int yaz_marc_write_check(yaz_marc_t mt, WRBUF wr)
 static size_t get_subfield_len(yaz_marc_t mt, const char *data,
                                int identifier_length)
 {
+    size_t len, i;
+
     /* if identifier length is 2 (most MARCs) or less (probably an error),
        the code is a single character .. However we've
        seen multibyte codes, so see how big it really is */
     if (identifier_length > 2)
-        return identifier_length - 1;
+        len = identifier_length - 1;
     else
-        return cdata_one_character(mt, data);
+        len = cdata_one_character(mt, data);
+    /* a code at end of subfield may be counted with the terminating
+       NUL (MARC-8 combining character); stay within data. Writers reset
+       the converter after the code, so such a character is dropped
+       rather than combined with the text that follows */
+    for (i = 0; i < len && data[i]; i++)
+        ;
+    return i;
 }
 
 int yaz_marc_write_line(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n;
+    size_t i, j;
     int identifier_length;
     const char *leader = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            leader = MARC_STR(mt, mt->fields[i].data);
             break;
         }
 
@@ -552,45 +600,49 @@ int yaz_marc_write_line(yaz_marc_t mt, WRBUF wr)
     if (!atoi_n_check(leader+11, 1, &identifier_length))
         return -1;
 
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
-        struct yaz_marc_subfield *s;
-        switch(n->which)
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *data = MARC_STR(mt, f->data);
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
-            wrbuf_printf(wr, "%s %s", n->u.datafield.tag,
-                         n->u.datafield.indicator);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            wrbuf_puts(wr, MARC_STR(mt, f->tag));
+            wrbuf_putc(wr, ' ');
+            wrbuf_puts(wr, data);
+            for (j = 0; j < f->num_subfields; j++)
             {
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
+                size_t using_code_len = get_subfield_len(mt, code_data,
                                                          identifier_length);
 
                 wrbuf_puts (wr, mt->subfield_str);
-                wrbuf_iconv_write(wr, mt->iconv_cd, s->code_data,
+                wrbuf_iconv_write(wr, mt->iconv_cd, code_data,
                                   using_code_len);
+                marc_iconv_reset(mt, wr);
                 wrbuf_iconv_puts(wr, mt->iconv_cd, " ");
                 wrbuf_iconv_puts(wr, mt->iconv_cd,
-                                 s->code_data + using_code_len);
+                                 code_data + using_code_len);
                 marc_iconv_reset(mt, wr);
             }
             wrbuf_puts (wr, mt->endline_str);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_printf(wr, "%s", n->u.controlfield.tag);
+            wrbuf_puts(wr, MARC_STR(mt, f->tag));
             wrbuf_iconv_puts(wr, mt->iconv_cd, " ");
-            wrbuf_iconv_puts(wr, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_puts(wr, mt->iconv_cd, data);
             marc_iconv_reset(mt, wr);
             wrbuf_puts (wr, mt->endline_str);
             break;
         case YAZ_MARC_COMMENT:
             wrbuf_puts(wr, "(");
-            wrbuf_iconv_write(wr, mt->iconv_cd,
-                              n->u.comment, strlen(n->u.comment));
+            wrbuf_iconv_write(wr, mt->iconv_cd, data, strlen(data));
             marc_iconv_reset(mt, wr);
             wrbuf_puts(wr, ")\n");
             break;
         case YAZ_MARC_LEADER:
-            wrbuf_printf(wr, "%s\n", n->u.leader);
+            wrbuf_printf(wr, "%s\n", data);
         }
     }
     wrbuf_puts(wr, "\n");
@@ -665,14 +717,14 @@ static int yaz_marc_write_marcxml_wrbuf(yaz_marc_t mt, WRBUF wr,
                                         const char *type,
                                         int turbo)
 {
-    struct yaz_marc_node *n;
+    size_t i, j;
     int identifier_length;
     const char *leader = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            leader = MARC_STR(mt, mt->fields[i].data);
             break;
         }
 
@@ -698,109 +750,114 @@ static int yaz_marc_write_marcxml_wrbuf(yaz_marc_t mt, WRBUF wr,
         wrbuf_printf(wr, " format=\"%.80s\"", format);
     if (type)
         wrbuf_printf(wr, " type=\"%.80s\"", type);
-    wrbuf_printf(wr, ">\n");
-    for (n = mt->nodes; n; n = n->next)
+    wrbuf_puts(wr, ">\n");
+    for (i = 0; i < mt->num_fields; i++)
     {
-        struct yaz_marc_subfield *s;
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *tag = MARC_STR(mt, f->tag);
+        const char *data = MARC_STR(mt, f->data);
+        size_t off = 0;
+        int k;
 
-        switch(n->which)
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
 
-            wrbuf_printf(wr, "  <%s", datafield_name[turbo]);
+            wrbuf_puts(wr, "  <");
+            wrbuf_puts(wr, datafield_name[turbo]);
             if (!turbo)
-                wrbuf_printf(wr, " tag=\"");
-            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.datafield.tag,
-                                    strlen(n->u.datafield.tag));
+                wrbuf_puts(wr, " tag=\"");
+            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag,
+                                    strlen(tag));
             if (!turbo)
-                wrbuf_printf(wr, "\"");
-            if (n->u.datafield.indicator)
+                wrbuf_puts(wr, "\"");
+            for (k = 0; data[off]; k++)
             {
-                int i;
-                size_t off = 0;
-                for (i = 0; n->u.datafield.indicator[off]; i++)
-                {
-                    size_t ilen =
-                        cdata_one_character(mt, n->u.datafield.indicator + off);
-                    wrbuf_printf(wr, " %s%d=\"", indicator_name[turbo], i+1);
-                    wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                            n->u.datafield.indicator + off,
-                                            ilen);
-                    off += ilen;
-                    wrbuf_iconv_puts(wr, mt->iconv_cd, "\"");
-                }
+                size_t ilen = cdata_one_character(mt, data + off);
+                wrbuf_printf(wr, " %s%d=\"", indicator_name[turbo], k+1);
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, data + off, ilen);
+                off += ilen;
+                wrbuf_iconv_puts(wr, mt->iconv_cd, "\"");
             }
-            wrbuf_printf(wr, ">\n");
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            wrbuf_puts(wr, ">\n");
+            for (j = 0; j < f->num_subfields; j++)
             {
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
+                size_t using_code_len = get_subfield_len(mt, code_data,
                                                          identifier_length);
-                wrbuf_printf(wr, "    <%s", subfield_name[turbo]);
+                wrbuf_puts(wr, "    <");
+                wrbuf_puts(wr, subfield_name[turbo]);
                 if (!turbo)
                 {
-                    wrbuf_printf(wr, " code=\"");
+                    wrbuf_puts(wr, " code=\"");
                     wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                            s->code_data, using_code_len);
+                                            code_data, using_code_len);
+                    marc_iconv_reset(mt, wr);
                     wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
                 }
                 else
                 {
-                    element_name_append_attribute_value(mt, wr, "code", s->code_data, using_code_len);
+                    element_name_append_attribute_value(mt, wr, "code", code_data, using_code_len);
                     wrbuf_puts(wr, ">");
                 }
                 wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                        s->code_data + using_code_len,
-                                        strlen(s->code_data + using_code_len));
+                                        code_data + using_code_len,
+                                        strlen(code_data + using_code_len));
                 marc_iconv_reset(mt, wr);
-                wrbuf_printf(wr, "</%s", subfield_name[turbo]);
+                wrbuf_puts(wr, "</");
+                wrbuf_puts(wr, subfield_name[turbo]);
                 if (turbo)
-                    element_name_append_attribute_value(mt, wr, 0, s->code_data, using_code_len);
+                    element_name_append_attribute_value(mt, wr, 0, code_data, using_code_len);
                 wrbuf_puts(wr, ">\n");
             }
-            wrbuf_printf(wr, "  </%s", datafield_name[turbo]);
+            wrbuf_puts(wr, "  </");
+            wrbuf_puts(wr, datafield_name[turbo]);
             /* TODO Not CDATA */
             if (turbo)
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.datafield.tag,
-                                        strlen(n->u.datafield.tag));
-            wrbuf_printf(wr, ">\n");
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag,
+                                        strlen(tag));
+            wrbuf_puts(wr, ">\n");
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_printf(wr, "  <%s", controlfield_name[turbo]);
+            wrbuf_puts(wr, "  <");
+            wrbuf_puts(wr, controlfield_name[turbo]);
             if (!turbo)
             {
-                wrbuf_printf(wr, " tag=\"");
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-                                        strlen(n->u.controlfield.tag));
+                wrbuf_puts(wr, " tag=\"");
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag,
+                                        strlen(tag));
                 wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
             }
             else
             {
                 /* TODO convert special */
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-                                        strlen(n->u.controlfield.tag));
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag,
+                                        strlen(tag));
                 wrbuf_iconv_puts(wr, mt->iconv_cd, ">");
             }
             wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
-                                    n->u.controlfield.data,
-                                    strlen(n->u.controlfield.data));
+                                    data,
+                                    strlen(data));
             marc_iconv_reset(mt, wr);
-            wrbuf_printf(wr, "</%s", controlfield_name[turbo]);
+            wrbuf_puts(wr, "</");
+            wrbuf_puts(wr, controlfield_name[turbo]);
             /* TODO convert special */
             if (turbo)
-                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, n->u.controlfield.tag,
-                                        strlen(n->u.controlfield.tag));
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag,
+                                        strlen(tag));
             wrbuf_puts(wr, ">\n");
             break;
         case YAZ_MARC_COMMENT:
-            wrbuf_printf(wr, "<!-- ");
-            wrbuf_puts(wr, n->u.comment);
-            wrbuf_printf(wr, " -->\n");
+            wrbuf_puts(wr, "<!-- ");
+            wrbuf_puts(wr, data);
+            wrbuf_puts(wr, " -->\n");
             break;
         case YAZ_MARC_LEADER:
             wrbuf_printf(wr, "  <%s>", leader_name[turbo]);
             wrbuf_iconv_write_cdata(wr,
                                     0 , /* no charset conversion for leader */
-                                    n->u.leader, strlen(n->u.leader));
+                                    data, strlen(data));
             wrbuf_printf(wr, "</%s>\n", leader_name[turbo]);
         }
     }
@@ -878,62 +935,63 @@ int yaz_marc_write_marcxchange(yaz_marc_t mt, WRBUF wr,
 }
 
 #if YAZ_HAVE_XML2
-static void write_xml_indicator(yaz_marc_t mt, struct yaz_marc_node *n,
+static void write_xml_indicator(yaz_marc_t mt,
+                                const struct yaz_marc_field *f,
                                 xmlNode *ptr, int turbo)
 {
-    if (n->u.datafield.indicator)
+    const char *indicator = MARC_STR(mt, f->data);
+    int i;
+    size_t off = 0;
+
+    for (i = 0; indicator[off]; i++)
     {
-        int i;
-        size_t off = 0;
-        for (i = 0; n->u.datafield.indicator[off]; i++)
+        size_t ilen = cdata_one_character(mt, indicator + off);
+        char ind_val[10];
+        if (ilen < sizeof(ind_val) - 1)
         {
-            size_t ilen =
-                cdata_one_character(mt, n->u.datafield.indicator + off);
-            char ind_val[10];
-            if (ilen < sizeof(ind_val) - 1)
-            {
-                char ind_str[12];
-                yaz_snprintf(ind_str, sizeof ind_str, "%s%d", indicator_name[turbo], i+1);
-                memcpy(ind_val, n->u.datafield.indicator + off, ilen);
-                ind_val[ilen] = '\0';
-                xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
-            }
-            off += ilen;
+            char ind_str[12];
+            yaz_snprintf(ind_str, sizeof ind_str, "%s%d", indicator_name[turbo], i+1);
+            memcpy(ind_val, indicator + off, ilen);
+            ind_val[ilen] = '\0';
+            xmlNewProp(ptr, BAD_CAST ind_str, BAD_CAST ind_val);
         }
+        off += ilen;
     }
 }
 
 static void add_marc_datafield_turbo_xml(yaz_marc_t mt,
-                                  struct yaz_marc_node *n,
+                                  const struct yaz_marc_field *f,
                                   xmlNode *record_ptr,
                                   xmlNsPtr ns_record, WRBUF wr_cdata,
                                   int identifier_length)
 {
     xmlNode *ptr;
-    struct yaz_marc_subfield *s;
+    size_t j;
     WRBUF subfield_name = wrbuf_alloc();
 
     /* TODO consider if safe */
     char field[10];
     field[0] = 'd';
-    strncpy(field + 1, n->u.datafield.tag, 3);
+    strncpy(field + 1, MARC_STR(mt, f->tag), 3);
     field[4] = '\0';
     ptr = xmlNewChild(record_ptr, ns_record, BAD_CAST field, 0);
 
-    write_xml_indicator(mt, n, ptr, 1);
-    for (s = n->u.datafield.subfields; s; s = s->next)
+    write_xml_indicator(mt, f, ptr, 1);
+    for (j = 0; j < f->num_subfields; j++)
     {
+        const char *code_data =
+            MARC_STR(mt, mt->subfields[f->subfield + j]);
         int not_written;
         xmlNode *ptr_subfield;
-        size_t using_code_len = get_subfield_len(mt, s->code_data,
+        size_t using_code_len = get_subfield_len(mt, code_data,
                                                  identifier_length);
         wrbuf_rewind(wr_cdata);
-        wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, s->code_data + using_code_len, wrbuf_xml_strip);
+        wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, code_data + using_code_len, wrbuf_xml_strip);
         marc_iconv_reset(mt, wr_cdata);
 
         wrbuf_rewind(subfield_name);
         wrbuf_puts(subfield_name, "s");
-        not_written = element_name_append_attribute_value(mt, subfield_name, 0, s->code_data, using_code_len) != 0;
+        not_written = element_name_append_attribute_value(mt, subfield_name, 0, code_data, using_code_len) != 0;
         ptr_subfield = xmlNewTextChild(ptr, ns_record,
                                        BAD_CAST wrbuf_cstr(subfield_name),
                                        BAD_CAST wrbuf_cstr(wr_cdata));
@@ -941,7 +999,8 @@ static void add_marc_datafield_turbo_xml(yaz_marc_t mt,
         {
             /* Generate code attribute value and add */
             wrbuf_rewind(wr_cdata);
-            wrbuf_iconv_write2(wr_cdata, mt->iconv_cd, s->code_data, using_code_len, wrbuf_xml_strip);
+            wrbuf_iconv_write2(wr_cdata, mt->iconv_cd, code_data, using_code_len, wrbuf_xml_strip);
+            marc_iconv_reset(mt, wr_cdata);
             xmlNewProp(ptr_subfield, BAD_CAST "code",  BAD_CAST wrbuf_cstr(wr_cdata));
         }
     }
@@ -953,17 +1012,17 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
                                         const char *format,
                                         const char *type)
 {
-    struct yaz_marc_node *n;
+    size_t i;
     int identifier_length;
     const char *leader = 0;
     xmlNode *record_ptr;
     xmlNsPtr ns_record;
     WRBUF wr_cdata = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            leader = MARC_STR(mt, mt->fields[i].data);
             break;
         }
 
@@ -984,36 +1043,39 @@ static int yaz_marc_write_xml_turbo_xml(yaz_marc_t mt, xmlNode **root_ptr,
         xmlNewProp(record_ptr, BAD_CAST "format", BAD_CAST format);
     if (type)
         xmlNewProp(record_ptr, BAD_CAST "type", BAD_CAST type);
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *tag = MARC_STR(mt, f->tag);
+        const char *data = MARC_STR(mt, f->data);
         xmlNode *ptr;
 
         char field[10];
         field[0] = 'c';
         field[4] = '\0';
 
-        switch(n->which)
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
-            add_marc_datafield_turbo_xml(mt, n, record_ptr, ns_record, wr_cdata, identifier_length);
+            add_marc_datafield_turbo_xml(mt, f, record_ptr, ns_record, wr_cdata, identifier_length);
             break;
         case YAZ_MARC_CONTROLFIELD:
             wrbuf_rewind(wr_cdata);
-            wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, n->u.controlfield.data, wrbuf_xml_strip);
+            wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, data, wrbuf_xml_strip);
             marc_iconv_reset(mt, wr_cdata);
 
-            strncpy(field + 1, n->u.controlfield.tag, 3);
+            strncpy(field + 1, tag, 3);
             ptr = xmlNewTextChild(record_ptr, ns_record,
                                   BAD_CAST field,
                                   BAD_CAST wrbuf_cstr(wr_cdata));
             break;
         case YAZ_MARC_COMMENT:
-            ptr = xmlNewComment(BAD_CAST n->u.comment);
+            ptr = xmlNewComment(BAD_CAST data);
             xmlAddChild(record_ptr, ptr);
             break;
         case YAZ_MARC_LEADER:
             xmlNewTextChild(record_ptr, ns_record, BAD_CAST "l",
-                            BAD_CAST n->u.leader);
+                            BAD_CAST data);
             break;
         }
     }
@@ -1027,17 +1089,17 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
                        const char *format,
                        const char *type)
 {
-    struct yaz_marc_node *n;
+    size_t i, j;
     int identifier_length;
     const char *leader = 0;
     xmlNode *record_ptr;
     xmlNsPtr ns_record;
     WRBUF wr_cdata = 0;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            leader = MARC_STR(mt, mt->fields[i].data);
             break;
         }
 
@@ -1058,25 +1120,29 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
         xmlNewProp(record_ptr, BAD_CAST "format", BAD_CAST format);
     if (type)
         xmlNewProp(record_ptr, BAD_CAST "type", BAD_CAST type);
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
-        struct yaz_marc_subfield *s;
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *tag = MARC_STR(mt, f->tag);
+        const char *data = MARC_STR(mt, f->data);
         xmlNode *ptr;
 
-        switch(n->which)
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
             ptr = xmlNewChild(record_ptr, ns_record, BAD_CAST "datafield", 0);
-            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST n->u.datafield.tag);
-            write_xml_indicator(mt, n, ptr, 0);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST tag);
+            write_xml_indicator(mt, f, ptr, 0);
+            for (j = 0; j < f->num_subfields; j++)
             {
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
                 xmlNode *ptr_subfield;
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                size_t using_code_len = get_subfield_len(mt, code_data,
                                                          identifier_length);
                 wrbuf_rewind(wr_cdata);
                 wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd,
-                                  s->code_data + using_code_len, wrbuf_xml_strip);
+                                  code_data + using_code_len, wrbuf_xml_strip);
                 marc_iconv_reset(mt, wr_cdata);
                 ptr_subfield = xmlNewTextChild(
                     ptr, ns_record,
@@ -1084,29 +1150,30 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
 
                 wrbuf_rewind(wr_cdata);
                 wrbuf_iconv_write2(wr_cdata, mt->iconv_cd,
-                                  s->code_data, using_code_len, wrbuf_xml_strip);
+                                  code_data, using_code_len, wrbuf_xml_strip);
+                marc_iconv_reset(mt, wr_cdata);
                 xmlNewProp(ptr_subfield, BAD_CAST "code",
                            BAD_CAST wrbuf_cstr(wr_cdata));
             }
             break;
         case YAZ_MARC_CONTROLFIELD:
             wrbuf_rewind(wr_cdata);
-            wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, n->u.controlfield.data, wrbuf_xml_strip);
+            wrbuf_iconv_puts2(wr_cdata, mt->iconv_cd, data, wrbuf_xml_strip);
             marc_iconv_reset(mt, wr_cdata);
 
             ptr = xmlNewTextChild(record_ptr, ns_record,
                                   BAD_CAST "controlfield",
                                   BAD_CAST wrbuf_cstr(wr_cdata));
 
-            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST n->u.controlfield.tag);
+            xmlNewProp(ptr, BAD_CAST "tag", BAD_CAST tag);
             break;
         case YAZ_MARC_COMMENT:
-            ptr = xmlNewComment(BAD_CAST n->u.comment);
+            ptr = xmlNewComment(BAD_CAST data);
             xmlAddChild(record_ptr, ptr);
             break;
         case YAZ_MARC_LEADER:
             xmlNewTextChild(record_ptr, ns_record, BAD_CAST "leader",
-                            BAD_CAST n->u.leader);
+                            BAD_CAST data);
             break;
         }
     }
@@ -1118,7 +1185,7 @@ int yaz_marc_write_xml(yaz_marc_t mt, xmlNode **root_ptr,
 
 int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
 {
-    struct yaz_marc_node *n, *cap_node = 0;
+    size_t i, j, cap = mt->num_fields;
     int indicator_length;
     int identifier_length;
     int length_data_entry;
@@ -1129,9 +1196,9 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
     WRBUF wr_dir, wr_head, wr_data_tmp;
     int base_address;
 
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-            leader = n->u.leader;
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
+            leader = MARC_STR(mt, mt->fields[i].data);
 
     if (!leader)
         return -1;
@@ -1148,23 +1215,25 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
 
     wr_data_tmp = wrbuf_alloc();
     wr_dir = wrbuf_alloc();
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
+        const struct yaz_marc_field *f = mt->fields + i;
         int data_length = 0;
         const char *tag = 0;
-        struct yaz_marc_subfield *s;
 
-        switch(n->which)
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
-            tag = n->u.datafield.tag;
-            data_length += strlen(n->u.datafield.indicator);
+            tag = MARC_STR(mt, f->tag);
+            data_length += strlen(MARC_STR(mt, f->data));
             wrbuf_rewind(wr_data_tmp);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            for (j = 0; j < f->num_subfields; j++)
             {
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
                 /* write dummy IDFS + content */
                 wrbuf_iconv_putchar(wr_data_tmp, mt->iconv_cd, ' ');
-                wrbuf_iconv_puts(wr_data_tmp, mt->iconv_cd, s->code_data);
+                wrbuf_iconv_puts(wr_data_tmp, mt->iconv_cd, code_data);
                 marc_iconv_reset(mt, wr_data_tmp);
             }
             /* write dummy FS (makes MARC-8 to become ASCII) */
@@ -1173,10 +1242,10 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
             data_length += wrbuf_len(wr_data_tmp);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            tag = n->u.controlfield.tag;
+            tag = MARC_STR(mt, f->tag);
             wrbuf_rewind(wr_data_tmp);
             wrbuf_iconv_puts(wr_data_tmp, mt->iconv_cd,
-                             n->u.controlfield.data);
+                             MARC_STR(mt, f->data));
             marc_iconv_reset(mt, wr_data_tmp);
             wrbuf_iconv_putchar(wr_data_tmp, mt->iconv_cd, ' ');/* field sep */
             marc_iconv_reset(mt, wr_data_tmp);
@@ -1191,12 +1260,12 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
         {
             if (wrbuf_len(wr_dir) + 40 + data_offset + data_length > 99999)
             {
-                cap_node = n;
+                cap = i;
                 break;
             }
-            wrbuf_printf(wr_dir, "%3.3s", tag);
-            wrbuf_printf(wr_dir, "%0*d", length_data_entry, data_length);
-            wrbuf_printf(wr_dir, "%0*d", length_starting, data_offset);
+            wrbuf_printf(wr_dir, "%3.3s%0*d%0*d", tag,
+                         length_data_entry, data_length,
+                         length_starting, data_offset);
             data_offset += data_length;
         }
     }
@@ -1223,24 +1292,27 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
     wrbuf_destroy(wr_dir);
     wrbuf_destroy(wr_data_tmp);
 
-    for (n = mt->nodes; n != cap_node; n = n->next)
+    for (i = 0; i < cap; i++)
     {
-        struct yaz_marc_subfield *s;
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *data = MARC_STR(mt, f->data);
 
-        switch(n->which)
+        switch(f->which)
         {
         case YAZ_MARC_DATAFIELD:
-            wrbuf_puts(wr, n->u.datafield.indicator);
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            wrbuf_puts(wr, data);
+            for (j = 0; j < f->num_subfields; j++)
             {
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
                 wrbuf_putc(wr, ISO2709_IDFS);
-                wrbuf_iconv_puts(wr, mt->iconv_cd, s->code_data);
+                wrbuf_iconv_puts(wr, mt->iconv_cd, code_data);
                 marc_iconv_reset(mt, wr);
             }
             wrbuf_putc(wr, ISO2709_FS);
             break;
         case YAZ_MARC_CONTROLFIELD:
-            wrbuf_iconv_puts(wr, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_puts(wr, mt->iconv_cd, data);
             marc_iconv_reset(mt, wr);
             wrbuf_putc(wr, ISO2709_FS);
             break;
@@ -1257,14 +1329,14 @@ int yaz_marc_write_iso2709(yaz_marc_t mt, WRBUF wr)
 int yaz_marc_write_json(yaz_marc_t mt, WRBUF w)
 {
     int identifier_length;
-    struct yaz_marc_node *n;
+    size_t i, j;
     const char *leader = 0;
     int first = 1;
 
     wrbuf_puts(w, "{\n");
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
-            leader = n->u.leader;
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
+            leader = MARC_STR(mt, mt->fields[i].data);
 
     if (!leader)
         return -1;
@@ -1277,11 +1349,15 @@ int yaz_marc_write_json(yaz_marc_t mt, WRBUF w)
     wrbuf_puts(w, "\",\n");
     wrbuf_puts(w, "  \"fields\": [");
 
-    for (n = mt->nodes; n; n = n->next)
+    for (i = 0; i < mt->num_fields; i++)
     {
-        struct yaz_marc_subfield *s;
+        const struct yaz_marc_field *f = mt->fields + i;
+        const char *tag = MARC_STR(mt, f->tag);
+        const char *data = MARC_STR(mt, f->data);
+        size_t off = 0;
+        int k;
         const char *sep = "";
-        switch (n->which)
+        switch (f->which)
         {
         case YAZ_MARC_LEADER:
         case YAZ_MARC_COMMENT:
@@ -1292,9 +1368,9 @@ int yaz_marc_write_json(yaz_marc_t mt, WRBUF w)
             else
                 wrbuf_puts(w, ",");
             wrbuf_puts(w, "\n    {\n      \"");
-            wrbuf_iconv_json_puts(w, mt->iconv_cd, n->u.controlfield.tag);
+            wrbuf_iconv_json_puts(w, mt->iconv_cd, tag);
             wrbuf_puts(w, "\": \"");
-            wrbuf_iconv_json_puts(w, mt->iconv_cd, n->u.controlfield.data);
+            wrbuf_iconv_json_puts(w, mt->iconv_cd, data);
             wrbuf_puts(w, "\"\n    }");
             break;
         case YAZ_MARC_DATAFIELD:
@@ -1304,36 +1380,33 @@ int yaz_marc_write_json(yaz_marc_t mt, WRBUF w)
                 wrbuf_puts(w, ",");
 
             wrbuf_puts(w, "\n    {\n      \"");
-            wrbuf_json_puts(w, n->u.datafield.tag);
+            wrbuf_json_puts(w, tag);
             wrbuf_puts(w, "\": {\n        \"subfields\": [\n");
-            for (s = n->u.datafield.subfields; s; s = s->next)
+            for (j = 0; j < f->num_subfields; j++)
             {
-                size_t using_code_len = get_subfield_len(mt, s->code_data,
+                const char *code_data =
+                    MARC_STR(mt, mt->subfields[f->subfield + j]);
+                size_t using_code_len = get_subfield_len(mt, code_data,
                                                          identifier_length);
                 wrbuf_puts(w, sep);
                 sep = ",\n";
                 wrbuf_puts(w, "          {\n            \"");
                 wrbuf_iconv_json_write(w, mt->iconv_cd,
-                                       s->code_data, using_code_len);
+                                       code_data, using_code_len);
+                marc_iconv_reset(mt, w);
                 wrbuf_puts(w, "\": \"");
                 wrbuf_iconv_json_puts(w, mt->iconv_cd,
-                                      s->code_data + using_code_len);
+                                      code_data + using_code_len);
                 wrbuf_puts(w, "\"\n          }");
             }
             wrbuf_puts(w, "\n        ]");
-            if (n->u.datafield.indicator)
+            for (k = 0; data[off]; k++)
             {
-                int i;
-                size_t off = 0;
-                for (i = 0; n->u.datafield.indicator[off]; i++)
-                {
-                    size_t ilen =
-                        cdata_one_character(mt, n->u.datafield.indicator + off);
-                    wrbuf_printf(w, ",\n        \"ind%d\": \"", i + 1);
-                    wrbuf_json_write(w, &n->u.datafield.indicator[off], ilen);
-                    wrbuf_printf(w, "\"");
-                    off += ilen;
-                }
+                size_t ilen = cdata_one_character(mt, data + off);
+                wrbuf_printf(w, ",\n        \"ind%d\": \"", k + 1);
+                wrbuf_json_write(w, data + off, ilen);
+                wrbuf_printf(w, "\"");
+                off += ilen;
             }
             wrbuf_puts(w, "\n      }");
             wrbuf_puts(w, "\n    }");
@@ -1348,6 +1421,496 @@ int yaz_marc_write_json(yaz_marc_t mt, WRBUF w)
     return 0;
 }
 
+/** \brief reads leader and directory of ISO2709 record for transcoding
+    \param mt handle
+    \param buf ISO2709 buffer
+    \param bsize size of buffer (-1 if "any size")
+    \param num_entries number of fields in mt->entries (output)
+    \returns record length; 0 if record is not well-formed
+
+    Fields are split as yaz_marc_read_iso2709 does. Anything for which
+    yaz_marc_read_iso2709 would add a comment makes this function return 0.
+    The leader is stored in the handle.
+*/
+static int iso2709_read_directory(yaz_marc_t mt, const char *buf, int bsize,
+                                  size_t *num_entries)
+{
+    int entry_p, l;
+    int record_length;
+    int indicator_length;
+    int identifier_length;
+    int end_of_directory;
+    int base_address;
+    int length_data_entry;
+    int length_starting;
+    int length_implementation;
+    size_t n = 0;
+
+    if (!atoi_n_check(buf, 5, &record_length) || record_length < 25)
+        return 0;
+    if (bsize != -1 && record_length > bsize)
+        return 0;
+    yaz_marc_reset(mt);
+    yaz_marc_set_leader(mt, buf,
+                        &indicator_length,
+                        &identifier_length,
+                        &base_address,
+                        &length_data_entry,
+                        &length_starting,
+                        &length_implementation);
+    if (mt->num_fields != 1)
+        return 0; /* comments for bad leader */
+
+    l = 3 + length_data_entry + length_starting;
+    for (entry_p = 24; buf[entry_p] != ISO2709_FS; entry_p += l)
+    {
+        int k;
+
+        if (entry_p + l >= record_length)
+            return 0;
+        for (k = 3; k < l; k++)
+            if (!yaz_isdigit(buf[entry_p + k]))
+                return 0;
+    }
+    end_of_directory = entry_p;
+    if (base_address != entry_p + 1)
+        return 0;
+
+    for (entry_p = 24; entry_p != end_of_directory; entry_p += l)
+    {
+        const char *tag = buf + entry_p;
+        int data_length = atoi_n(tag + 3, length_data_entry);
+        int data_offset = atoi_n(tag + 3 + length_data_entry,
+                                 length_starting);
+        int i = data_offset + base_address;
+        int end_offset = i + data_length - 1;
+        int identifier_flag = 0;
+        struct iso2709_entry *e;
+
+        if (data_length <= 0 || data_offset < 0)
+            break;
+        if (end_offset >= record_length || memchr(tag, '\0', 3))
+            return 0;
+        if (memcmp(tag, "00", 2))
+            identifier_flag = 1;  /* if not 00X assume subfields */
+        else if (indicator_length < 4 && indicator_length > 0)
+        {
+            /* Danmarc 00X have subfields */
+            if (buf[i + indicator_length] == ISO2709_IDFS)
+                identifier_flag = 1;
+            else if (buf[i + indicator_length + 1] == ISO2709_IDFS)
+                identifier_flag = 2;
+        }
+        if (n == mt->max_entries)
+        {
+            mt->max_entries = mt->max_entries ? 2 * mt->max_entries : 64;
+            mt->entries = (struct iso2709_entry *)
+                xrealloc(mt->entries, mt->max_entries * sizeof(*mt->entries));
+        }
+        e = mt->entries + n++;
+        e->tag = entry_p;
+        e->end = end_offset;
+        e->ind_len = 0;
+        if (identifier_flag)
+        {
+            int j;
+
+            i += identifier_flag - 1;
+            e->data = i;
+            for (j = 0; j < indicator_length; j++)
+                i += yaz_marc_sizeof_char(mt, buf + i);
+            e->ind_len = i - e->data;
+            if (i > end_offset || e->ind_len > 40 ||
+                memchr(buf + e->data, '\0', e->ind_len))
+                return 0;
+        }
+        else
+            e->data = i;
+    }
+    *num_entries = n;
+    return record_length;
+}
+
+/** \brief returns next subfield of data field being transcoded
+    \param buf ISO2709 buffer
+    \param e field
+    \param i offset of scan (input/output)
+    \param code_offset offset of current subfield (input/output)
+    \param start offset of subfield (output)
+    \param len length of subfield (output)
+    \retval 1 subfield at *start of *len bytes
+    \retval 0 no more subfields
+    \retval -1 field is not well-formed
+*/
+static int iso2709_next_subfield(const char *buf,
+                                 const struct iso2709_entry *e,
+                                 int *i, int *code_offset,
+                                 int *start, int *len)
+{
+    int end_offset = e->end;
+
+    while (*i < end_offset &&
+           buf[*i] != ISO2709_RS && buf[*i] != ISO2709_FS)
+    {
+        int p = (*i)++;
+
+        if (buf[p] == '\0')
+            return -1;
+        if (buf[p] == ISO2709_IDFS && p < end_offset -1 &&
+            !(buf[p+1] >= 0 && buf[p+1] <= ' '))
+        {
+            *start = *code_offset;
+            *len = p - *code_offset;
+            *code_offset = p + 1;
+            if (*len > 0)
+                return 1;
+        }
+    }
+    if (*i > end_offset)
+        return 0;  /* last subfield returned already */
+    if (*i < end_offset ||
+        (buf[*i] != ISO2709_RS && buf[*i] != ISO2709_FS))
+        return -1;
+    (*i)++;
+    *start = *code_offset;
+    *len = end_offset - *code_offset;
+    return *len > 0 ? 1 : 0;
+}
+
+/** \brief returns length of control field being transcoded; -1 if
+    it is not well-formed */
+static int iso2709_controlfield_len(const char *buf,
+                                    const struct iso2709_entry *e)
+{
+    int i;
+
+    for (i = e->data; i < e->end; i++)
+        if (buf[i] == ISO2709_RS || buf[i] == ISO2709_FS || buf[i] == '\0')
+            return -1;
+    if (buf[i] != ISO2709_RS && buf[i] != ISO2709_FS)
+        return -1;
+    return i - e->data;
+}
+
+/* same as wrbuf_printf(wr, "%d", no) which is slow for every indicator */
+static void transcode_indicator_no(WRBUF wr, int no)
+{
+    if (no < 10)
+        wrbuf_putc(wr, '0' + no);
+    else
+        wrbuf_printf(wr, "%d", no);
+}
+
+/** \brief writes MARCXML/MARCXchange/TurboMARC from ISO2709 directory
+    \retval 0 OK
+    \retval -1 record must be read with yaz_marc_read_iso2709 instead
+
+    Output is the same as that of yaz_marc_write_marcxml_wrbuf for the
+    record as read by yaz_marc_read_iso2709.
+*/
+static int transcode_marcxml(yaz_marc_t mt, const char *buf,
+                             size_t num_entries, WRBUF wr,
+                             const char *ns, int turbo)
+{
+    size_t n;
+    int identifier_length;
+    const char *leader = MARC_STR(mt, mt->fields[0].data);
+
+    if (!atoi_n_check(leader+11, 1, &identifier_length))
+        return -1;
+
+    if (mt->enable_collection != no_collection)
+    {
+        if (mt->enable_collection == collection_first)
+        {
+            wrbuf_printf(wr, "<collection xmlns=\"%s\">\n", ns);
+            mt->enable_collection = collection_second;
+        }
+        wrbuf_printf(wr, "<%s", record_name[turbo]);
+    }
+    else
+    {
+        wrbuf_printf(wr, "<%s xmlns=\"%s\"", record_name[turbo], ns);
+    }
+    wrbuf_puts(wr, ">\n");
+    wrbuf_printf(wr, "  <%s>", leader_name[turbo]);
+    wrbuf_iconv_write_cdata(wr, 0, leader, strlen(leader));
+    wrbuf_printf(wr, "</%s>\n", leader_name[turbo]);
+    for (n = 0; n < num_entries; n++)
+    {
+        const struct iso2709_entry *e = mt->entries + n;
+        const char *tag = buf + e->tag;
+
+        if (e->ind_len)
+        {
+            char ind[48];  /* 0-terminated as when read into handle */
+            int i = e->data + e->ind_len;
+            int code_offset = i + 1;
+            int off = 0, start, len, r, k;
+
+            memset(ind, 0, sizeof(ind));
+            memcpy(ind, buf + e->data, e->ind_len);
+            wrbuf_puts(wr, "  <");
+            wrbuf_puts(wr, datafield_name[turbo]);
+            if (!turbo)
+                wrbuf_puts(wr, " tag=\"");
+            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, 3);
+            if (!turbo)
+                wrbuf_puts(wr, "\"");
+            for (k = 0; off < e->ind_len; k++)
+            {
+                int ilen = (int) cdata_one_character(mt, ind + off);
+                if (off + ilen > e->ind_len)
+                    return -1;
+                wrbuf_putc(wr, ' ');
+                wrbuf_puts(wr, indicator_name[turbo]);
+                transcode_indicator_no(wr, k + 1);
+                wrbuf_puts(wr, "=\"");
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, ind + off, ilen);
+                off += ilen;
+                wrbuf_iconv_puts(wr, mt->iconv_cd, "\"");
+            }
+            wrbuf_puts(wr, ">\n");
+            while ((r = iso2709_next_subfield(buf, e, &i, &code_offset,
+                                              &start, &len)) > 0)
+            {
+                const char *code_data = buf + start;
+                size_t using_code_len = get_subfield_len(mt, code_data,
+                                                         identifier_length);
+                if (using_code_len > (size_t) len)
+                    return -1;
+                wrbuf_puts(wr, "    <");
+                wrbuf_puts(wr, subfield_name[turbo]);
+                if (!turbo)
+                {
+                    wrbuf_puts(wr, " code=\"");
+                    wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
+                                            code_data, using_code_len);
+                    marc_iconv_reset(mt, wr);
+                    wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
+                }
+                else
+                {
+                    element_name_append_attribute_value(mt, wr, "code", code_data, using_code_len);
+                    wrbuf_puts(wr, ">");
+                }
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd,
+                                        code_data + using_code_len,
+                                        len - using_code_len);
+                marc_iconv_reset(mt, wr);
+                wrbuf_puts(wr, "</");
+                wrbuf_puts(wr, subfield_name[turbo]);
+                if (turbo)
+                    element_name_append_attribute_value(mt, wr, 0, code_data, using_code_len);
+                wrbuf_puts(wr, ">\n");
+            }
+            if (r < 0)
+                return -1;
+            wrbuf_puts(wr, "  </");
+            wrbuf_puts(wr, datafield_name[turbo]);
+            if (turbo)
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, 3);
+            wrbuf_puts(wr, ">\n");
+        }
+        else
+        {
+            int len = iso2709_controlfield_len(buf, e);
+
+            if (len < 0)
+                return -1;
+            wrbuf_puts(wr, "  <");
+            wrbuf_puts(wr, controlfield_name[turbo]);
+            if (!turbo)
+            {
+                wrbuf_puts(wr, " tag=\"");
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, 3);
+                wrbuf_iconv_puts(wr, mt->iconv_cd, "\">");
+            }
+            else
+            {
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, 3);
+                wrbuf_iconv_puts(wr, mt->iconv_cd, ">");
+            }
+            wrbuf_iconv_write_cdata(wr, mt->iconv_cd, buf + e->data, len);
+            marc_iconv_reset(mt, wr);
+            wrbuf_puts(wr, "</");
+            wrbuf_puts(wr, controlfield_name[turbo]);
+            if (turbo)
+                wrbuf_iconv_write_cdata(wr, mt->iconv_cd, tag, 3);
+            wrbuf_puts(wr, ">\n");
+        }
+    }
+    wrbuf_printf(wr, "</%s>\n", record_name[turbo]);
+    return 0;
+}
+
+/** \brief writes MARC-in-JSON from ISO2709 directory
+    \retval 0 OK
+    \retval -1 record must be read with yaz_marc_read_iso2709 instead
+
+    Output is the same as that of yaz_marc_write_json for the
+    record as read by yaz_marc_read_iso2709.
+*/
+static int transcode_json(yaz_marc_t mt, const char *buf,
+                          size_t num_entries, WRBUF w)
+{
+    size_t n;
+    int identifier_length;
+    const char *leader = MARC_STR(mt, mt->fields[0].data);
+
+    if (!atoi_n_check(leader+11, 1, &identifier_length))
+        return -1;
+
+    wrbuf_puts(w, "{\n");
+    wrbuf_puts(w, "  \"leader\": \"");
+    wrbuf_json_puts(w, leader);
+    wrbuf_puts(w, "\",\n");
+    wrbuf_puts(w, "  \"fields\": [");
+    for (n = 0; n < num_entries; n++)
+    {
+        const struct iso2709_entry *e = mt->entries + n;
+        const char *tag = buf + e->tag;
+
+        if (n > 0)
+            wrbuf_puts(w, ",");
+        wrbuf_puts(w, "\n    {\n      \"");
+        if (e->ind_len)
+        {
+            char ind[48];  /* 0-terminated as when read into handle */
+            int i = e->data + e->ind_len;
+            int code_offset = i + 1;
+            int off = 0, start, len, r, k;
+            const char *sep = "";
+
+            wrbuf_json_write(w, tag, 3);
+            wrbuf_puts(w, "\": {\n        \"subfields\": [\n");
+            while ((r = iso2709_next_subfield(buf, e, &i, &code_offset,
+                                              &start, &len)) > 0)
+            {
+                const char *code_data = buf + start;
+                size_t using_code_len = get_subfield_len(mt, code_data,
+                                                         identifier_length);
+                if (using_code_len > (size_t) len)
+                    return -1;
+                wrbuf_puts(w, sep);
+                sep = ",\n";
+                wrbuf_puts(w, "          {\n            \"");
+                wrbuf_iconv_json_write(w, mt->iconv_cd,
+                                       code_data, using_code_len);
+                marc_iconv_reset(mt, w);
+                wrbuf_puts(w, "\": \"");
+                wrbuf_iconv_json_write(w, mt->iconv_cd,
+                                       code_data + using_code_len,
+                                       len - using_code_len);
+                wrbuf_puts(w, "\"\n          }");
+            }
+            if (r < 0)
+                return -1;
+            wrbuf_puts(w, "\n        ]");
+            memset(ind, 0, sizeof(ind));
+            memcpy(ind, buf + e->data, e->ind_len);
+            for (k = 0; off < e->ind_len; k++)
+            {
+                int ilen = (int) cdata_one_character(mt, ind + off);
+                if (off + ilen > e->ind_len)
+                    return -1;
+                wrbuf_puts(w, ",\n        \"ind");
+                transcode_indicator_no(w, k + 1);
+                wrbuf_puts(w, "\": \"");
+                wrbuf_json_write(w, ind + off, ilen);
+                wrbuf_putc(w, '"');
+                off += ilen;
+            }
+            wrbuf_puts(w, "\n      }");
+            wrbuf_puts(w, "\n    }");
+        }
+        else
+        {
+            int len = iso2709_controlfield_len(buf, e);
+
+            if (len < 0)
+                return -1;
+            wrbuf_iconv_json_write(w, mt->iconv_cd, tag, 3);
+            wrbuf_puts(w, "\": \"");
+            wrbuf_iconv_json_write(w, mt->iconv_cd, buf + e->data, len);
+            wrbuf_puts(w, "\"\n    }");
+        }
+    }
+    if (num_entries > 0)
+        wrbuf_puts(w, "\n  ");
+    wrbuf_puts(w, "]\n");
+    wrbuf_puts(w, "}\n");
+    return 0;
+}
+
+/** \brief converts ISO2709 record directly to MARCXML, TurboMARC,
+    MARCXchange or JSON
+    \param mt handle
+    \param buf ISO2709 buffer
+    \param bsize size of buffer (-1 if "any size")
+    \param wr output
+    \returns record length; 0 if record must be converted by
+    yaz_marc_read_iso2709 and yaz_marc_write_mode
+
+    Fields are written as the directory is walked without storing the
+    record in the handle. Records that yaz_marc_read_iso2709 would add
+    comments for are not handled here (output is left untouched).
+*/
+static int marc_transcode_iso2709(yaz_marc_t mt, const char *buf, int bsize,
+                                  WRBUF wr)
+{
+    size_t len = wrbuf_len(wr);
+    enum yaz_collection_state collection = mt->enable_collection;
+    size_t num_entries = 0;
+    int record_length, r = -1;
+
+    if (mt->debug || mt->write_using_libxml2)
+        return 0;
+    switch (mt->output_format)
+    {
+    case YAZ_MARC_MARCXML:
+    case YAZ_MARC_TURBOMARC:
+    case YAZ_MARC_XCHANGE:
+    case YAZ_MARC_JSON:
+        break;
+    default:
+        return 0;
+    }
+    record_length = iso2709_read_directory(mt, buf, bsize, &num_entries);
+    if (!record_length)
+        return 0;
+    switch (mt->output_format)
+    {
+    case YAZ_MARC_MARCXML:
+        if (!mt->leader_spec)
+            yaz_marc_modify_leader(mt, 9, "a");
+        r = transcode_marcxml(mt, buf, num_entries, wr,
+                              "http://www.loc.gov/MARC21/slim", 0);
+        break;
+    case YAZ_MARC_TURBOMARC:
+        if (!mt->leader_spec)
+            yaz_marc_modify_leader(mt, 9, "a");
+        r = transcode_marcxml(mt, buf, num_entries, wr,
+                              "http://www.indexdata.com/turbomarc", 1);
+        break;
+    case YAZ_MARC_XCHANGE:
+        r = transcode_marcxml(mt, buf, num_entries, wr,
+                              "info:lc/xmlns/marcxchange-v1", 0);
+        break;
+    case YAZ_MARC_JSON:
+        r = transcode_json(mt, buf, num_entries, wr);
+        break;
+    }
+    if (r)
+    {
+        marc_iconv_reset(mt, wr);
+        wrbuf_cut_right(wr, wrbuf_len(wr) - len);
+        mt->enable_collection = collection;
+        return 0;
+    }
+    return record_length;
+}
+
 int yaz_marc_decode_wrbuf(yaz_marc_t mt, const char *buf, int bsize, WRBUF wr)
 {
     int s, r = yaz_marc_read_iso2709(mt, buf, bsize);
@@ -1359,6 +1922,15 @@ int yaz_marc_decode_wrbuf(yaz_marc_t mt, const char *buf, int bsize, WRBUF wr)
     return r; /* OK, return length > 0 */
 }
 
+int yaz_marc_transcode_wrbuf(yaz_marc_t mt, const char *buf, int bsize,
+                             WRBUF wr)
+{
+    int r = marc_transcode_iso2709(mt, buf, bsize, wr);
+    if (r > 0)
+        return r;
+    return yaz_marc_decode_wrbuf(mt, buf, bsize, wr);
+}
+
 int yaz_marc_decode_buf(yaz_marc_t mt, const char *buf, int bsize,
                         const char **result, size_t *rsize)
 {
@@ -1396,12 +1968,11 @@ yaz_iconv_t yaz_marc_get_iconv(yaz_marc_t mt)
 
 void yaz_marc_modify_leader(yaz_marc_t mt, size_t off, const char *str)
 {
-    struct yaz_marc_node *n;
-    char *leader = 0;
-    for (n = mt->nodes; n; n = n->next)
-        if (n->which == YAZ_MARC_LEADER)
+    size_t i;
+    for (i = 0; i < mt->num_fields; i++)
+        if (mt->fields[i].which == YAZ_MARC_LEADER)
         {
-            leader = n->u.leader;
+            char *leader = MARC_STR(mt, mt->fields[i].data);
             memcpy(leader+off, str, strlen(str));
             break;
         }
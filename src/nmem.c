@@ -8,7 +8,9 @@
  * \brief Implements Nibble Memory
  *
  * This is a simple and fairly wasteful little module for nibble memory
- * allocation.
+ * allocation. Blocks of common sizes are recycled through a small cache
+ * for each thread, so that a reset/destroy followed by new allocations
+ * does not go to the system allocator.
  *
  */
 #if HAVE_CONFIG_H
@@ -37,6 +39,15 @@ static size_t no_nmem_blocks = 0;
 static size_t nmem_allocated = 0;
 
 #define NMEM_CHUNK (4*1024)
+/* block sizes grow from NMEM_CHUNK to NMEM_CHUNK_MAX for each handle */
+#define NMEM_CHUNK_MAX (1024*1024)
+/* allocations of this size or more get a block of their own */
+#define NMEM_LARGE (64*1024)
+
+/* recycled blocks: sizes NMEM_CHUNK << 0 .. NMEM_CACHE_CLASSES-1, at most
+   NMEM_CACHE_BYTES in each class for each thread */
+#define NMEM_CACHE_CLASSES 4
+#define NMEM_CACHE_BYTES (64*1024)
 
 struct nmem_block
 {
@@ -49,10 +60,17 @@ struct nmem_block
 struct nmem_control
 {
     size_t total;
+    size_t next_size;       /* size of next block */
     struct nmem_block *blocks;
     struct nmem_control *next;
 };
 
+struct nmem_cache
+{
+    struct nmem_block *blocks[NMEM_CACHE_CLASSES];
+    size_t no[NMEM_CACHE_CLASSES];
+};
+
 struct align {
     char x;
     union {
@@ -87,42 +105,133 @@ static void nmem_unlock(void)
 #endif
 }
 
+/* statistics are updated without taking nmem_lock when possible */
+#if defined(__GNUC__)
+#define NMEM_STAT_ADD(v, d) ((void) __sync_add_and_fetch(&(v), (d)))
+#define NMEM_STAT_SUB(v, d) ((void) __sync_sub_and_fetch(&(v), (d)))
+#define NMEM_STAT_GET(v) __sync_add_and_fetch(&(v), 0)
+#else
+#define NMEM_STAT_ADD(v, d) (nmem_lock(), (v) += (d), nmem_unlock())
+#define NMEM_STAT_SUB(v, d) (nmem_lock(), (v) -= (d), nmem_unlock())
+#define NMEM_STAT_GET(v) (v)
+#endif
+
+#if YAZ_POSIX_THREADS
+static pthread_key_t nmem_cache_key;
+static pthread_once_t nmem_cache_once = PTHREAD_ONCE_INIT;
+
+static void nmem_cache_destroy(void *p)
+{
+    struct nmem_cache *cache = (struct nmem_cache *) p;
+    int i;
+
+    for (i = 0; i < NMEM_CACHE_CLASSES; i++)
+    {
+        struct nmem_block *b;
+        while ((b = cache->blocks[i]))
+        {
+            cache->blocks[i] = b->next;
+            xfree(b->buf);
+            xfree(b);
+        }
+    }
+    xfree(cache);
+}
+
+static void nmem_cache_key_create(void)
+{
+    pthread_key_create(&nmem_cache_key, nmem_cache_destroy);
+}
+
+/* returns block cache for calling thread */
+static struct nmem_cache *nmem_cache_get(void)
+{
+    struct nmem_cache *cache;
+
+    pthread_once(&nmem_cache_once, nmem_cache_key_create);
+    cache = (struct nmem_cache *) pthread_getspecific(nmem_cache_key);
+    if (!cache)
+    {
+        int i;
+        cache = (struct nmem_cache *) xmalloc(sizeof(*cache));
+        for (i = 0; i < NMEM_CACHE_CLASSES; i++)
+        {
+            cache->blocks[i] = 0;
+            cache->no[i] = 0;
+        }
+        pthread_setspecific(nmem_cache_key, cache);
+    }
+    return cache;
+}
+#else
+static struct nmem_cache *nmem_cache_get(void)
+{
+    return 0;
+}
+#endif
+
+/* returns cache size class for block size, -1 if not cached */
+static int nmem_cache_class(size_t size)
+{
+    int i;
+
+    for (i = 0; i < NMEM_CACHE_CLASSES; i++)
+        if (size == ((size_t) NMEM_CHUNK << i))
+            return i;
+    return -1;
+}
+
 static void free_block(struct nmem_block *p)
 {
-    nmem_lock();
-    no_nmem_blocks--;
-    nmem_allocated -= p->size;
-    nmem_unlock();
-    xfree(p->buf);
-    xfree(p);
+    int c = nmem_cache_class(p->size);
+    struct nmem_cache *cache = c >= 0 ? nmem_cache_get() : 0;
+
+    NMEM_STAT_SUB(no_nmem_blocks, 1);
+    NMEM_STAT_SUB(nmem_allocated, p->size);
     if (log_level)
         yaz_log(log_level, "nmem free_block p=%p", p);
+    if (cache && (cache->no[c] + 1) * p->size <= NMEM_CACHE_BYTES)
+    {
+        p->next = cache->blocks[c];
+        cache->blocks[c] = p;
+        cache->no[c]++;
+        return;
+    }
+    xfree(p->buf);
+    xfree(p);
 }
 
 /*
- * acquire a block with a minimum of size free bytes.
+ * acquire a block of get bytes.
  */
-static struct nmem_block *get_block(size_t size)
+static struct nmem_block *get_block(size_t get)
 {
     struct nmem_block *r;
-    size_t get = NMEM_CHUNK;
-
-    if (log_level)
-        yaz_log(log_level, "nmem get_block size=%ld", (long) size);
+    int c;
+    struct nmem_cache *cache;
 
-    if (get < size)
-        get = size;
     if (log_level)
-        yaz_log(log_level, "nmem get_block alloc new block size=%ld",
-                (long) get);
+        yaz_log(log_level, "nmem get_block size=%ld", (long) get);
 
-    r = (struct nmem_block *) xmalloc(sizeof(*r));
-    r->buf = (char *)xmalloc(r->size = get);
+    c = nmem_cache_class(get);
+    cache = c >= 0 ? nmem_cache_get() : 0;
+    if (cache && (r = cache->blocks[c]))
+    {
+        cache->blocks[c] = r->next;
+        cache->no[c]--;
+    }
+    else
+    {
+        if (log_level)
+            yaz_log(log_level, "nmem get_block alloc new block size=%ld",
+                    (long) get);
+        r = (struct nmem_block *) xmalloc(sizeof(*r));
+        r->buf = (char *)xmalloc(r->size = get);
+    }
     r->top = 0;
-    nmem_lock();
-    no_nmem_blocks++;
-    nmem_allocated += r->size;
-    nmem_unlock();
+    r->next = 0;
+    NMEM_STAT_ADD(no_nmem_blocks, 1);
+    NMEM_STAT_ADD(nmem_allocated, r->size);
     return r;
 }
 
@@ -133,15 +242,33 @@ void nmem_reset(NMEM n)
     yaz_log(log_level, "nmem_reset p=%p", n);
     if (!n)
         return;
-    while (n->blocks)
+    /* keep the first block, unless it is a large one */
+    while ((t = n->blocks) && (t->next || nmem_cache_class(t->size) < 0))
     {
-        t = n->blocks;
-        n->blocks = n->blocks->next;
+        n->blocks = t->next;
         free_block(t);
     }
+    n->next_size = NMEM_CHUNK;
+    if (t)
+    {
+        t->top = 0;
+        if (t->size < NMEM_CHUNK_MAX)
+            n->next_size = t->size * 2;
+    }
     n->total = 0;
 }
 
+/* size of next block for a request of size bytes */
+static size_t next_block_size(NMEM n, size_t size)
+{
+    size_t get = n->next_size;
+
+    while (get < size)
+        get *= 2;
+    n->next_size = get < NMEM_CHUNK_MAX ? get * 2 : NMEM_CHUNK_MAX;
+    return get;
+}
+
 void *nmem_malloc(NMEM n, size_t size)
 {
     struct nmem_block *p;
@@ -153,9 +280,27 @@ void *nmem_malloc(NMEM n, size_t size)
         abort();
     }
     p = n->blocks;
-    if (!p || p->size < size + p->top)
+    if (size >= NMEM_LARGE && (!p || p->size < size + p->top))
     {
+        /* own block. Keep on filling the current block */
         p = get_block(size);
+        p->top = size;
+        if (n->blocks)
+        {
+            p->next = n->blocks->next;
+            n->blocks->next = p;
+        }
+        else
+        {
+            p->next = 0;
+            n->blocks = p;
+        }
+        n->total += size;
+        return p->buf;
+    }
+    if (!p || p->size < size + p->top)
+    {
+        p = get_block(next_block_size(n, size));
         p->next = n->blocks;
         n->blocks = p;
     }
@@ -182,9 +327,7 @@ NMEM nmem_create(void)
 {
     NMEM r;
 
-    nmem_lock();
-    no_nmem_handles++;
-    nmem_unlock();
+    NMEM_STAT_ADD(no_nmem_handles, 1);
     if (!log_level_initialized)
     {
         /* below will call nmem_init_globals once */
@@ -196,21 +339,64 @@ NMEM nmem_create(void)
 
     r->blocks = 0;
     r->total = 0;
+    r->next_size = NMEM_CHUNK;
     r->next = 0;
 
     return r;
 }
 
+NMEM nmem_create_with_hint(size_t size)
+{
+    NMEM r = nmem_create();
+
+    nmem_hint(r, size);
+    if (size > NMEM_CHUNK)
+        r->blocks = get_block(next_block_size(r, size));
+    return r;
+}
+
+void nmem_hint(NMEM n, size_t size)
+{
+    while (n->next_size < size && n->next_size < NMEM_CHUNK_MAX)
+        n->next_size *= 2;
+}
+
 void nmem_destroy(NMEM n)
 {
+    struct nmem_block *t;
+
     if (!n)
         return;
 
-    nmem_reset(n);
+    while ((t = n->blocks))
+    {
+        n->blocks = t->next;
+        free_block(t);
+    }
     xfree(n);
-    nmem_lock();
-    no_nmem_handles--;
-    nmem_unlock();
+    NMEM_STAT_SUB(no_nmem_handles, 1);
+}
+
+void nmem_adopt(NMEM n, void *buf, size_t size)
+{
+    struct nmem_block *p = (struct nmem_block *) xmalloc(sizeof(*p));
+
+    p->buf = (char *) buf;
+    p->size = size;
+    p->top = size;
+    NMEM_STAT_ADD(no_nmem_blocks, 1);
+    NMEM_STAT_ADD(nmem_allocated, size);
+    /* like a large block: keep on filling the current block */
+    if (n->blocks)
+    {
+        p->next = n->blocks->next;
+        n->blocks->next = p;
+    }
+    else
+    {
+        p->next = 0;
+        n->blocks = p;
+    }
 }
 
 void nmem_transfer(NMEM dst, NMEM src)
@@ -230,11 +416,9 @@ int nmem_get_status(char *dst, size_t l)
 {
     size_t handles, blocks, allocated;
 
-    nmem_lock();
-    handles = no_nmem_handles;
-    blocks = no_nmem_blocks;
-    allocated = nmem_allocated;
-    nmem_unlock();
+    handles = NMEM_STAT_GET(no_nmem_handles);
+    blocks = NMEM_STAT_GET(no_nmem_blocks);
+    allocated = NMEM_STAT_GET(nmem_allocated);
     yaz_snprintf(dst, l,
                  "<nmem>\n"
                  "  <handles>%zd</handles>\n"
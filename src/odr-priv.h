@@ -69,6 +69,7 @@ struct odr_constack
     const char *lenb;            /** where to encode length */
     int len_offset;
     int lenlen;                  /** length of length-field */
+    int size_idx;                /** index in sizes (sized encoding) */
     const char *name;            /** name of stack entry */
 
     struct odr_constack *prev;   /** pointer back in stack */
@@ -109,53 +110,75 @@ struct Odr_private {
     int t_tag;
 
     int enable_bias;     /* force choice enable flag */
+    int lazy;            /* keep record EXTERNALs undecoded (odr_set_lazy) */
+    int borrow;          /* decoded octets refer to buf (odr_set_borrow) */
     int choice_bias;     /* force choice */
     int lenlen;          /* force length-of-lenght (odr_setlen()) */
     FILE *print;         /* output file handler for direction print */
     int indent;          /* current indent level for printing */
+
+    int size_mode;       /* ODR_SIZE_.. (odr_encode_sized) */
+    int *sizes;          /* content length of constructed types */
+    int sizes_num;       /* number of sizes used */
+    int sizes_max;       /* number of sizes allocated */
+    int sizes_pos;       /* next size to use (ODR_SIZE_WRITE) */
 };
 
+#define ODR_SIZE_NONE 0   /* normal encoding */
+#define ODR_SIZE_COUNT 1  /* first pass: count bytes, no writing */
+#define ODR_SIZE_WRITE 2  /* second pass: write with known lengths */
+
 #define ODR_STACK_POP(x) ((x)->op->stack_top = (x)->op->stack_top->prev, (x)->op->stack_depth--)
 #define ODR_STACK_EMPTY(x) (!(x)->op->stack_top)
 #define ODR_STACK_NOT_EMPTY(x) ((x)->op->stack_top)
 
 #define odr_tell(o) ((o)->op->pos)
 
+/* ber_octetstring that may refer to decode buffer (borrow != 0) */
+int ber_octetstring_x(ODR o, Odr_oct *p, int cons, int borrow);
+
 /* Private macro.
  * write a single character at the current position - grow buffer if
- * necessary.
+ * necessary. Only counts when sizing (ODR_SIZE_COUNT).
  * (no, we're not usually this anal about our macros, but this baby is
  *  next to unreadable without some indentation  :)
  */
 #define odr_putc(o, c) \
 ( \
+    (o)->op->size_mode == ODR_SIZE_COUNT ? \
+    ( \
+        (o)->op->pos++, \
+        (o)->op->pos > (o)->op->top ? ((o)->op->top = (o)->op->pos, 0) : 0 \
+    ) : \
     ( \
-        (o)->op->pos < (o)->op->size ? \
-        ( \
-            (o)->op->buf[(o)->op->pos++] = (c), \
-            0 \
-        ) : \
         ( \
-            odr_grow_block((o), 1) == 0 ? \
+            (o)->op->pos < (o)->op->size ? \
             ( \
                 (o)->op->buf[(o)->op->pos++] = (c), \
                 0 \
             ) : \
             ( \
-                (o)->error = OSPACE, \
-                -1 \
+                odr_grow_block((o), 1) == 0 ? \
+                ( \
+                    (o)->op->buf[(o)->op->pos++] = (c), \
+                    0 \
+                ) : \
+                ( \
+                    (o)->error = OSPACE, \
+                    -1 \
+                ) \
             ) \
-        ) \
-    ) == 0 ? \
-    ( \
-        (o)->op->pos > (o)->op->top ? \
+        ) == 0 ? \
         ( \
-            (o)->op->top = (o)->op->pos, \
+            (o)->op->pos > (o)->op->top ? \
+            ( \
+                (o)->op->top = (o)->op->pos, \
+                0 \
+            ) : \
             0 \
         ) : \
-        0 \
-    ) : \
-        -1 \
+            -1 \
+    ) \
 )
 
 #endif
@@ -215,6 +215,11 @@ ODR odr_createmem(int direction)
     o->op->enable_bias = 1;
     o->op->odr_ber_tag.lclass = -1;
     o->op->iconv_handle = 0;
+    o->op->lazy = 0;
+    o->op->borrow = 0;
+    o->op->size_mode = ODR_SIZE_NONE;
+    o->op->sizes = 0;
+    o->op->sizes_num = o->op->sizes_max = o->op->sizes_pos = 0;
     odr_setprint_noclose(o, stderr);
     odr_reset(o);
     yaz_log(log_level, "odr_createmem dir=%d o=%p", direction, o);
@@ -258,6 +263,7 @@ void odr_destroy(ODR o)
         o->op->stream_close(o->op->print);
     if (o->op->iconv_handle != 0)
         yaz_iconv_close(o->op->iconv_handle);
+    xfree(o->op->sizes);
     xfree(o->op);
     xfree(o);
     yaz_log(log_level, "odr_destroy o=%p", o);
@@ -271,6 +277,15 @@ void odr_setbuf(ODR o, char *buf, int len, int can_grow)
     o->op->can_grow = can_grow;
     o->op->top = o->op->pos = 0;
     o->op->size = len;
+    if (o->direction == ODR_DECODE)
+        nmem_hint(o->mem, len); /* decoded data is about the size of buf */
+}
+
+void odr_setbuf_adopt(ODR o, char *buf, int len)
+{
+    odr_setbuf(o, buf, len, 0);
+    if (buf)
+        nmem_adopt(o->mem, buf, len); /* lives until decoded data is freed */
 }
 
 char *odr_getbuf(ODR o, int *len, int *size)
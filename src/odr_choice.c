@@ -97,6 +97,26 @@ void odr_choice_enable_bias (ODR o, int mode)
 {
     o->op->enable_bias = mode;
 }
+
+void odr_set_lazy(ODR o, int mode)
+{
+    o->op->lazy = mode;
+}
+
+int odr_get_lazy(ODR o)
+{
+    return o->op->lazy;
+}
+
+void odr_set_borrow(ODR o, int mode)
+{
+    o->op->borrow = mode;
+}
+
+int odr_get_borrow(ODR o)
+{
+    return o->op->borrow;
+}
 /*
  * Local variables:
  * c-basic-offset: 4
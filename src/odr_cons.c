@@ -81,7 +81,31 @@ int odr_constructed_begin(ODR o, void *xxp, int zclass, int tag,
     o->op->stack_top->lenb = o->op->bp;
     o->op->stack_top->len_offset = odr_tell(o);
     o->op->stack_top->name = name ? name : "?";
-    if (o->direction == ODR_ENCODE)
+    if (o->direction == ODR_ENCODE && o->op->size_mode == ODR_SIZE_COUNT)
+    {
+        /* length is counted in odr_constructed_end */
+        if (o->op->sizes_num == o->op->sizes_max)
+        {
+            o->op->sizes_max = o->op->sizes_max ? 2 * o->op->sizes_max : 64;
+            o->op->sizes = (int *)
+                xrealloc(o->op->sizes, o->op->sizes_max * sizeof(int));
+        }
+        o->op->stack_top->size_idx = o->op->sizes_num++;
+    }
+    else if (o->direction == ODR_ENCODE && o->op->size_mode == ODR_SIZE_WRITE)
+    {
+        int idx = o->op->sizes_pos++;
+
+        o->op->stack_top->size_idx = idx;
+        if (idx >= o->op->sizes_num ||
+            ber_enclen(o, o->op->sizes[idx], sizeof(int) + 1, 0) <= 0)
+        {
+            odr_seterror(o, OLENOV, 60);
+            ODR_STACK_POP(o);
+            return 0;
+        }
+    }
+    else if (o->direction == ODR_ENCODE)
     {
         static char dummy[sizeof(int)+1];
 
@@ -178,6 +202,30 @@ int odr_constructed_end(ODR o)
         return 1;
     case ODR_ENCODE:
         pos = odr_tell(o);
+        if (o->op->size_mode == ODR_SIZE_COUNT)
+        {
+            /* add size of (definite) length octets */
+            int len = pos - o->op->stack_top->base_offset;
+
+            o->op->sizes[o->op->stack_top->size_idx] = len;
+            o->op->pos += ber_lenlen(len);
+            if (o->op->pos > o->op->top)
+                o->op->top = o->op->pos;
+            ODR_STACK_POP(o);
+            return 1;
+        }
+        if (o->op->size_mode == ODR_SIZE_WRITE)
+        {
+            /* the first pass must have produced the same length */
+            if (pos - o->op->stack_top->base_offset !=
+                o->op->sizes[o->op->stack_top->size_idx])
+            {
+                odr_seterror(o, OLENOV, 61);
+                return 0;
+            }
+            ODR_STACK_POP(o);
+            return 1;
+        }
         odr_seek(o, ODR_S_SET, o->op->stack_top->len_offset);
         if ((res = ber_enclen(o, pos - o->op->stack_top->base_offset,
                               o->op->stack_top->lenlen, 1)) < 0)
@@ -204,6 +252,67 @@ int odr_constructed_end(ODR o)
         return 0;
     }
 }
+/* restart encoding from position 0 (odr_reset without freeing memory) */
+static void odr_encode_restart(ODR o)
+{
+    odr_seek(o, ODR_S_SET, 0);
+    o->op->top = 0;
+    o->op->bp = o->op->buf;
+    o->op->t_class = -1;
+    o->op->t_tag = -1;
+    o->op->stack_top = 0;
+    o->op->stack_depth = 0;
+    o->op->choice_bias = -1;
+    o->op->lenlen = 1;
+    o->op->odr_ber_tag.lclass = -1;
+    if (o->op->iconv_handle != 0)
+        yaz_iconv(o->op->iconv_handle, 0, 0, 0, 0);
+}
+
+int odr_encode_sized(ODR o, Odr_fun fun, void *p, const char *name)
+{
+    int r, len;
+
+    if (o->direction != ODR_ENCODE)
+        return (*fun)(o, (char **) p, 0, name);
+    /* first pass: count bytes and collect lengths */
+    o->op->size_mode = ODR_SIZE_COUNT;
+    o->op->sizes_num = 0;
+    odr_encode_restart(o);
+    r = (*fun)(o, (char **) p, 0, name);
+    len = o->op->top;
+    if (r)
+    {   /* odr_write needs one byte more than what is written */
+        if (o->op->size <= len)
+        {
+            if (!o->op->can_grow)
+            {
+                odr_seterror(o, OSPACE, 62);
+                r = 0;
+            }
+            else
+            {
+                xfree(o->op->buf);
+                o->op->buf = (char *) xmalloc(o->op->size = len + 1);
+            }
+        }
+    }
+    if (r)
+    {   /* second pass: write with lengths known */
+        o->op->size_mode = ODR_SIZE_WRITE;
+        o->op->sizes_pos = 0;
+        odr_encode_restart(o);
+        r = (*fun)(o, (char **) p, 0, name);
+        if (r && o->op->top != len)
+        {
+            odr_seterror(o, OLENOV, 63);
+            r = 0;
+        }
+    }
+    o->op->size_mode = ODR_SIZE_NONE;
+    return r;
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
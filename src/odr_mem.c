@@ -71,6 +71,11 @@ Odr_oct *odr_create_Odr_oct(ODR o, const char *buf, int sz)
     return p;
 }
 
+void odr_oct_detach(NMEM nmem, Odr_oct *p)
+{
+    p->buf = nmem_strdupn(nmem, p->buf, p->len);
+}
+
 /* ---------- memory management for data encoding ----------*/
 
 
@@ -102,6 +107,13 @@ int odr_write(ODR o, const char *buf, int bytes)
         odr_seterror(o, OSPACE, 40);
         return -1;
     }
+    if (o->op->size_mode == ODR_SIZE_COUNT)
+    {
+        o->op->pos += bytes;
+        if (o->op->pos > o->op->top)
+            o->op->top = o->op->pos;
+        return 0;
+    }
     if (o->op->pos + bytes >= o->op->size && odr_grow_block(o, bytes))
     {
         odr_seterror(o, OSPACE, 40);
@@ -120,7 +132,8 @@ int odr_seek(ODR o, int whence, int offset)
         offset += o->op->pos;
     else if (whence == ODR_S_END)
         offset += o->op->top;
-    if (offset > o->op->size && odr_grow_block(o, offset - o->op->size))
+    if (offset > o->op->size && o->op->size_mode != ODR_SIZE_COUNT
+        && odr_grow_block(o, offset - o->op->size))
     {
         odr_seterror(o, OSPACE, 41);
         return -1;
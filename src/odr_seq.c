@@ -142,6 +142,42 @@ int odr_sequence_of(ODR o, Odr_fun type, void *p, int *num,
     return odr_sequence_x (o, type, p, num);
 }
 
+int odr_sequence_fields(ODR o, void *p, int size, const Odr_field *f,
+                        int opt, const char *name)
+{
+    char *base;
+
+    if (!odr_sequence_begin(o, p, size, name))
+        return odr_missing(o, opt, name) && odr_ok(o);
+    base = *(char **) p;
+    for (; f->fun; f++)
+    {
+        char **mp = (char **) (base + f->offset);
+        int r;
+
+        if (f->num_offset >= 0)
+        {
+            if (f->tagmode == ODR_IMPLICIT)
+                odr_implicit_settag(o, f->zclass, f->tag);
+            r = odr_sequence_of(o, f->fun, mp, (int *) (base + f->num_offset),
+                                f->name);
+            if (!r && f->opt)
+                r = odr_ok(o);
+        }
+        else if (f->tagmode == ODR_NONE)
+            r = (*f->fun)(o, mp, f->opt, f->name);
+        else if (f->tagmode == ODR_IMPLICIT)
+            r = odr_implicit_tag(o, (*f->fun), mp, f->zclass, f->tag, f->opt,
+                                 f->name);
+        else
+            r = odr_explicit_tag(o, (*f->fun), mp, f->zclass, f->tag, f->opt,
+                                 f->name);
+        if (!r)
+            return 0;
+    }
+    return odr_sequence_end(o);
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
@@ -73,6 +73,20 @@ Z_ext_typeent *z_ext_getentbyref(const Odr_oid *oid)
     return 0;
 }
 
+/* structured record syntaxes that are left undecoded in lazy mode */
+static int ext_lazy_type(int what)
+{
+    switch (what)
+    {
+    case Z_External_grs1:
+    case Z_External_OPAC:
+    case Z_External_summary:
+    case Z_External_explainRecord:
+        return 1;
+    }
+    return 0;
+}
+
 /**
   This routine is the BER codec for the EXTERNAL type.
   It handles information in single-ASN1-type and octet-aligned
@@ -91,6 +105,9 @@ Z_ext_typeent *z_ext_getentbyref(const Odr_oid *oid)
     }
   </pre>
   arbitrary BIT STRING not handled yet.
+
+  In lazy mode (odr_set_lazy) record syntaxes in single-ASN1-type are
+  kept as Z_External_single; see z_External_resolve.
 */
 int z_External(ODR o, Z_External **p, int opt, const char *name)
 {
@@ -248,7 +265,8 @@ int z_External(ODR o, Z_External **p, int opt, const char *name)
 
             return r && odr_sequence_end(o);
         }
-        if (zclass == ODR_CONTEXT && tag == 0 && cons == 1)
+        if (zclass == ODR_CONTEXT && tag == 0 && cons == 1 &&
+            !(o->op->lazy && ext_lazy_type(type->what)))
         {
             /* It's single ASN.1 type, bias the CHOICE. */
             odr_choice_bias(o, type->what);
@@ -259,6 +277,37 @@ int z_External(ODR o, Z_External **p, int opt, const char *name)
         odr_sequence_end(o);
 }
 
+int z_External_resolve(NMEM nmem, Z_External *ext)
+{
+    Z_ext_typeent *type;
+    Odr_oct *raw;
+    char *voidp = 0;
+    ODR o;
+    int r;
+
+    if (!ext || !ext->direct_reference)
+        return 1;
+    if (ext->which == Z_External_single)
+        raw = ext->u.single_ASN1_type;
+    else if (ext->which == Z_External_octet)
+        raw = ext->u.octet_aligned;
+    else
+        return 1;
+    if (!(type = z_ext_getentbyref(ext->direct_reference)))
+        return 1; /* unknown structure: raw is all we have */
+    o = odr_createmem(ODR_DECODE);
+    odr_setbuf(o, raw->buf, raw->len, 0);
+    r = (*type->fun)(o, &voidp, 0, 0);
+    if (r)
+    {
+        nmem_transfer(nmem, odr_getmem(o));
+        ext->which = type->what;
+        ext->u.single_ASN1_type = (Odr_any *) voidp;
+    }
+    odr_destroy(o);
+    return r;
+}
+
 Z_External *z_ext_record_oid_nmem(NMEM nmem, const Odr_oid *oid,
                                   const char *buf, int len)
 {
@@ -93,7 +93,7 @@ static const char *return_marc_record(WRBUF wrbuf,
     if (cd)
         yaz_marc_iconv(mt, cd);
     yaz_marc_xml(mt, marc_type);
-    if (yaz_marc_decode_wrbuf(mt, buf, sz, wrbuf) > 0)
+    if (yaz_marc_transcode_wrbuf(mt, buf, sz, wrbuf) > 0)
     {
         *len = wrbuf_len(wrbuf);
         ret_string = wrbuf_cstr(wrbuf);
@@ -161,6 +161,15 @@ static const char *return_string_record(WRBUF wrbuf,
         sz = wrbuf_len(wrbuf);
         yaz_iconv_close(cd);
     }
+    else if (buf == wrbuf_buf(wrbuf))
+        buf = wrbuf_cstr(wrbuf);
+    else
+    {
+        /* decoded octets may not be null-terminated (odr_set_borrow).
+           Callers of ZOOM_record_get expect a C string, so copy */
+        wrbuf_write(wrbuf, buf, sz);
+        buf = wrbuf_cstr(wrbuf);
+    }
     *len = sz;
     return buf;
 }
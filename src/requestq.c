@@ -82,6 +82,9 @@ request *request_get(request_q *q)
     r->apdu_request = 0;
     r->request_mem = 0;
     r->len_response = 0;
+    r->response_body = 0;
+    r->len_response_body = 0;
+    r->response_mem = 0;
     r->clientData = 0;
     r->state = REQUEST_IDLE;
     r->next = 0;
@@ -93,6 +96,8 @@ void request_release(request *r)
     request_q *q = r->q;
     if (r->request_mem)
         nmem_destroy(r->request_mem);
+    if (r->response_mem)
+        nmem_destroy(r->response_mem);
     r->next = q->list;
     q->list = r;
 }
@@ -98,6 +98,11 @@ static Z_APDU *process_deleteRequest(association *assoc, request *reqb);
 static Z_APDU *process_segmentRequest(association *assoc, request *reqb);
 static Z_APDU *process_ESRequest(association *assoc, request *reqb);
 
+/* maximum number of pipelined responses written with one cs_put_iov */
+#define OUTPUT_BATCH_MAX 32
+/* HTTP bodies of this size or larger are not copied to the encode buffer */
+#define RESPONSE_BODY_SEGMENT_MIN 8192
+
 /* dynamic logging levels */
 static int logbits_set = 0;
 static int log_session = 0; /* one-line logs for session */
@@ -163,6 +168,7 @@ association *create_association(IOCHAN channel, COMSTACK link,
     anew->cs_get_mask = 0;
     anew->cs_put_mask = 0;
     anew->cs_accept_mask = 0;
+    anew->offload = 0;
     if (!(anew->decode = odr_createmem(ODR_DECODE)) ||
         !(anew->encode = odr_createmem(ODR_ENCODE)))
         return 0;
@@ -208,7 +214,8 @@ association *create_association(IOCHAN channel, COMSTACK link,
  */
 void destroy_association(association *h)
 {
-    statserv_options_block *cb = statserv_getcontrol();
+    statserv_options_block *cb =
+        h->last_control ? h->last_control : statserv_getcontrol();
     request *req;
 
     xfree(h->init);
@@ -216,8 +223,7 @@ void destroy_association(association *h)
     odr_destroy(h->encode);
     if (h->print)
         odr_destroy(h->print);
-    if (h->input_buffer)
-    xfree(h->input_buffer);
+    cs_buf_release(&h->input_buffer, &h->input_buffer_len);
     if (h->backend)
         (*cb->bend_close)(h->backend);
     while ((req = request_deq(&h->incoming)))
@@ -351,6 +357,9 @@ int ir_read(IOCHAN h, int event)
             request_enq(&assoc->incoming, req);
         }
         while (cs_more(conn));
+        /* decoded requests do not refer to the input buffer. Give it
+           back to the pool while the session is between PDUs */
+        cs_buf_release(&assoc->input_buffer, &assoc->input_buffer_len);
     }
     return 1;
 }
@@ -372,6 +381,11 @@ void ir_session(IOCHAN h, int event)
     request *req;
 
     assert(h && conn && assoc);
+    if (event == EVENT_DETACHED)
+    {
+        (*assoc->offload)(h);
+        return;
+    }
     if (event == EVENT_TIMEOUT)
     {
         if (assoc->state != ASSOC_UP)
@@ -422,18 +436,41 @@ void ir_session(IOCHAN h, int event)
         req = request_head(&assoc->incoming);
         if (req->state == REQUEST_IDLE)
         {
+            if (assoc->offload)
+            {   /* leave the request to ir_process in another thread */
+                iochan_detach(h);
+                return;
+            }
             request_deq(&assoc->incoming);
             process_gdu_request(assoc, req);
         }
     }
     if (event & assoc->cs_put_mask)
     {
+        struct cs_iovec iov[2 * OUTPUT_BATCH_MAX];
+        int i, iovcnt = 0, nreq = 0, pending;
         request *req = request_head(&assoc->outgoing);
 
         assoc->cs_put_mask = 0;
         yaz_log(YLOG_DEBUG, "ir_session (output)");
-        req->state = REQUEST_PENDING;
-        switch (res = cs_put(conn, req->response, req->len_response))
+        /* queued (pipelined) responses are written together. A partially
+           written batch must be repeated with the same segments */
+        pending = req->state == REQUEST_PENDING;
+        for (; req && nreq < OUTPUT_BATCH_MAX; req = req->next)
+        {
+            if (pending && req->state != REQUEST_PENDING)
+                break;
+            req->state = REQUEST_PENDING;
+            iov[iovcnt].buf = req->response;
+            iov[iovcnt++].len = req->len_response;
+            if (req->response_body)
+            {
+                iov[iovcnt].buf = req->response_body;
+                iov[iovcnt++].len = req->len_response_body;
+            }
+            nreq++;
+        }
+        switch (res = cs_put_iov(conn, iov, iovcnt))
         {
         case -1:
             yaz_log(log_sessiondetail, "Connection closed by client");
@@ -441,14 +478,14 @@ void ir_session(IOCHAN h, int event)
             destroy_association(assoc);
             iochan_destroy(h);
             break;
-        case 0: /* all sent - release the request structure */
-            yaz_log(YLOG_DEBUG, "Wrote PDU, %d bytes", req->len_response);
-#if 0
-            yaz_log(YLOG_DEBUG, "HTTP out:\n%.*s", req->len_response,
-                    req->response);
-#endif
-            request_deq(&assoc->outgoing);
-            request_release(req);
+        case 0: /* all sent - release the request structures */
+            for (i = 0; i < nreq; i++)
+            {
+                req = request_deq(&assoc->outgoing);
+                yaz_log(YLOG_DEBUG, "Wrote PDU, %d bytes",
+                        req->len_response + req->len_response_body);
+                request_release(req);
+            }
             if (!request_head(&assoc->outgoing))
             {   /* restore mask for cs_get operation ... */
                 iochan_clearflag(h, EVENT_OUTPUT|EVENT_INPUT);
@@ -479,6 +516,24 @@ void ir_session(IOCHAN h, int event)
     }
 }
 
+/*
+ * Process incoming requests of a detached session. Called in a backend
+ * thread; the session is handed back to its event loop afterwards.
+ */
+void ir_process(IOCHAN h)
+{
+    association *assoc = (association *)iochan_getdata(h);
+    request *req = request_head(&assoc->incoming);
+
+    if (assoc->last_control)
+        statserv_setcontrol(assoc->last_control);
+    if (req && req->state == REQUEST_IDLE)
+    {
+        request_deq(&assoc->incoming);
+        process_gdu_request(assoc, req);
+    }
+}
+
 static void assoc_init_reset(association *assoc, const char *peer_name1)
 {
     const char *peer_name2 = cs_addrstr(assoc->client_link);
@@ -2143,6 +2198,9 @@ static int process_z_request(association *assoc, request *req, const char **msg)
  */
 static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
 {
+    Z_HTTP_Response *hres = 0;
+    int r;
+
     odr_setbuf(assoc->encode, req->response, req->size_response, 1);
 
     if (assoc->print)
@@ -2152,16 +2210,35 @@ static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
                 odr_errmsg(odr_geterror(assoc->print)));
         odr_reset(assoc->print);
     }
-    if (!z_GDU(assoc->encode, &res, 0, 0))
+    if (res->which == Z_GDU_HTTP_Response &&
+        res->u.HTTP_Response->content_buf &&
+        res->u.HTTP_Response->content_len >= RESPONSE_BODY_SEGMENT_MIN)
+    {   /* encode header only. Body is sent from where it is */
+        hres = res->u.HTTP_Response;
+        req->response_body = hres->content_buf;
+        req->len_response_body = hres->content_len;
+    }
+    if (hres)  /* response itself is left as is */
+        r = yaz_encode_http_response_head(assoc->encode, hres);
+    else if (res->which == Z_GDU_Z3950)
+        /* sized: buffer allocated once, no length patching */
+        r = odr_encode_sized(assoc->encode, (Odr_fun) z_GDU, &res, 0);
+    else
+        r = z_GDU(assoc->encode, &res, 0, 0);
+    if (!r)
     {
         yaz_log(YLOG_WARN, "ODR error when encoding PDU: %s [element %s]",
-                odr_errmsg(odr_geterror(assoc->decode)),
-                odr_getelement(assoc->decode));
+                odr_errmsg(odr_geterror(assoc->encode)),
+                odr_getelement(assoc->encode));
+        req->response_body = 0;
+        req->len_response_body = 0;
         return -1;
     }
     req->response = odr_getbuf(assoc->encode, &req->len_response,
         &req->size_response);
     odr_setbuf(assoc->encode, 0, 0, 0); /* don'txfree if we abort later */
+    if (hres)  /* body is allocated by encode stream */
+        req->response_mem = odr_extract_mem(assoc->encode);
     odr_reset(assoc->encode);
     req->state = REQUEST_IDLE;
     request_enq(&assoc->outgoing, req);
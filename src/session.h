@@ -79,6 +79,9 @@ typedef struct request
     int size_response;     /* size of buffer */
     int len_response;      /* length of encoded data */
     char *response;        /* encoded data waiting for transmission */
+    char *response_body;   /* HTTP body sent after response (or NULL) */
+    int len_response_body; /* length of HTTP body */
+    NMEM response_mem;     /* memory handle for response_body */
 
     void *clientData;
     struct request *next;
@@ -130,6 +133,9 @@ typedef struct association
     int cs_put_mask;
     int cs_accept_mask;
 
+    void (*offload)(IOCHAN chan); /* hands detached session to backend
+                                     threads (0: process in event loop) */
+
     struct bend_initrequest *init;
     statserv_options_block *last_control;
 
@@ -140,6 +146,7 @@ association *create_association(IOCHAN channel, COMSTACK link,
                                 const char *apdufile);
 void destroy_association(association *h);
 void ir_session(IOCHAN h, int event);
+void ir_process(IOCHAN h);
 
 void request_enq(request_q *q, request *r);
 request *request_head(request_q *q);
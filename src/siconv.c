@@ -29,6 +29,10 @@
 #include <yaz/errno.h>
 #include "iconv-p.h"
 
+#if YAZ_ICONV_SSE2
+#include <emmintrin.h>
+#endif
+
 struct yaz_iconv_struct {
     int my_errno;
     int init_flag;
@@ -42,6 +46,47 @@ struct yaz_iconv_struct {
 };
 
 
+/** \brief returns length of leading run of printable ASCII (0x20-0x7E)
+    \param inp input bytes
+    \param len number of bytes
+    \returns number of leading bytes in range
+
+    Tests 16 bytes at a time with SSE2 if available, otherwise a word
+    at a time (no byte below 0x20, no byte 0x7F or above).
+*/
+size_t yaz_iconv_ascii_span(const unsigned char *inp, size_t len)
+{
+    const unsigned long ones = ~0UL / 255;
+    const unsigned long highs = ones * 0x80;
+    size_t i = 0;
+#if YAZ_ICONV_SSE2
+    const __m128i lo = _mm_set1_epi8(0x1f);
+    const __m128i hi = _mm_set1_epi8(0x7f);
+
+    /* signed compare: bytes 0x80 and above are negative */
+    while (i + 16 <= len)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (inp + i));
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                   _mm_cmplt_epi8(v, hi));
+        if (_mm_movemask_epi8(ok) != 0xffff)
+            break;
+        i += 16;
+    }
+#endif
+    while (i + sizeof(unsigned long) <= len)
+    {
+        unsigned long w;
+        memcpy(&w, inp + i, sizeof(w));
+        if ((w | (w - ones * 0x20) | ((w ^ (ones * 0x7f)) - ones)) & highs)
+            break;
+        i += sizeof(w);
+    }
+    while (i < len && inp[i] >= 0x20 && inp[i] < 0x7f)
+        i++;
+    return i;
+}
+
 int yaz_iconv_isbuiltin(yaz_iconv_t cd)
 {
     return cd->decoder.read_handle && cd->encoder.write_handle;
@@ -101,11 +146,13 @@ yaz_iconv_t yaz_iconv_open(const char *tocode, const char *fromcode)
     cd->encoder.flush_handle = 0;
     cd->encoder.init_handle = 0;
     cd->encoder.destroy_handle = 0;
+    cd->encoder.write_ascii_handle = 0;
 
     cd->decoder.data = 0;
     cd->decoder.read_handle = 0;
     cd->decoder.init_handle = 0;
     cd->decoder.destroy_handle = 0;
+    cd->decoder.read_ascii_handle = 0;
 
     cd->my_errno = YAZ_ICONV_UNKNOWN;
 
@@ -244,6 +291,22 @@ size_t yaz_iconv(yaz_iconv_t cd, char **inbuf, size_t *inbytesleft,
                 r = *inbuf - inbuf0;
                 break;
             }
+            if (cd->decoder.read_ascii_handle && cd->encoder.write_ascii_handle)
+            {
+                /* run of ASCII: no per-character dispatch */
+                size_t n = (*cd->decoder.read_ascii_handle)(
+                    &cd->decoder, (unsigned char *) *inbuf, *inbytesleft);
+                if (n)
+                    n = (*cd->encoder.write_ascii_handle)(
+                        cd, &cd->encoder, (unsigned char *) *inbuf, n,
+                        outbuf, outbytesleft);
+                if (n)
+                {
+                    *inbytesleft -= n;
+                    (*inbuf) += n;
+                    continue;
+                }
+            }
             x = (*cd->decoder.read_handle)(
                 cd, &cd->decoder,
                 (unsigned char *) *inbuf, *inbytesleft, &no_read);
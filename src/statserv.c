@@ -67,6 +67,8 @@
 #include <yaz/daemon.h>
 #include <yaz/yaz-iconv.h>
 #include <yaz/snprintf.h>
+#include <yaz/mutex.h>
+#include <yaz/spipe.h>
 
 static IOCHAN pListener = NULL;
 
@@ -127,6 +129,19 @@ statserv_options_block control_block = {
 };
 
 static int max_sessions = 0;
+static int worker_threads = 0;  /* event loop threads (-W) */
+static int backend_threads = 0; /* threads processing requests (-B) */
+static int reuseport = 0;       /* listeners bound by each worker (-R) */
+
+/* listener to be bound by every worker thread */
+struct reuseport_listener {
+    char *where;
+    char *cert_fname;
+    int listen_id;
+    IOCHAN chan;                /* bound by main thread; given to worker 0 */
+    struct reuseport_listener *next;
+};
+static struct reuseport_listener *reuseport_listeners = 0;
 
 static int logbits_set = 0;
 static int log_session = 0; /* one-line logs for session */
@@ -166,6 +181,8 @@ static void get_logbits(int force)
 
 
 static int add_listener(char *where, int listen_id);
+static IOCHAN create_listener(const char *where, const char *cert_fname,
+                              int listen_id, int flags);
 
 #if YAZ_HAVE_XML2
 static xmlDocPtr xml_config_doc = 0;
@@ -942,11 +959,335 @@ static void listener(IOCHAN h, int event)
 
 #else /* ! WIN32 */
 
-/* To save having an #ifdef in event_loop we need to
-   define this empty function
-*/
+#if YAZ_POSIX_THREADS
+/* event loop thread owning a share of the sessions (-W) */
+struct statserv_worker {
+    pthread_t thread;
+    IOCHAN chans;             /* channels served by this worker */
+    yaz_spipe_t spipe;        /* wakes up the worker */
+    YAZ_MUTEX mutex;          /* protects members below */
+    IOCHAN attach;            /* channels to be added to chans */
+    int wakeup_pending;
+    int no_sessions;
+    int stop;
+};
+
+/* session with a request for the backend threads (-B) */
+struct statserv_job {
+    IOCHAN chan;
+    struct statserv_worker *worker;
+    struct statserv_job *next;
+};
+
+static struct statserv_worker *workers = 0;
+static pthread_key_t current_worker_tls;
+static pthread_t *pool_threads = 0;
+static YAZ_MUTEX pool_mutex = 0;
+static YAZ_COND pool_cond = 0;
+static struct statserv_job *pool_head = 0;
+static struct statserv_job **pool_tail = &pool_head;
+static int pool_stop = 0;
+
+static int cpu_count(void)
+{
+    int n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+    n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? n : 1;
+}
+
+/* signals are handled by the main thread only */
+static int statserv_thread_create(pthread_t *t, void *(*start)(void *),
+                                  void *arg)
+{
+    sigset_t block, old;
+    int r;
+
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGHUP);
+    sigaddset(&block, SIGCHLD);
+    sigaddset(&block, SIGUSR1);
+    sigaddset(&block, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    r = pthread_create(t, 0, start, arg);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+    return r;
+}
+
+/* must be called with w->mutex held */
+static void worker_wakeup(struct statserv_worker *w)
+{
+    if (!w->wakeup_pending)
+    {
+        w->wakeup_pending = 1;
+        if (write(yaz_spipe_get_write_fd(w->spipe), "", 1) != 1)
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "worker wakeup");
+    }
+}
+
+static void worker_attach(struct statserv_worker *w, IOCHAN chan)
+{
+    yaz_mutex_enter(w->mutex);
+    chan->next = w->attach;
+    w->attach = chan;
+    worker_wakeup(w);
+    yaz_mutex_leave(w->mutex);
+}
+
+static void worker_wakeup_handler(IOCHAN h, int event)
+{
+    struct statserv_worker *w = (struct statserv_worker *) iochan_getdata(h);
+    IOCHAN p, p_next;
+    char buf[1];
+
+    if (event != EVENT_INPUT)
+        return;
+    yaz_mutex_enter(w->mutex);
+    if (read(iochan_getfd(h), buf, 1) != 1)
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "worker wakeup");
+    w->wakeup_pending = 0;
+    p = w->attach;
+    w->attach = 0;
+    if (w->stop && w->no_sessions == 0)
+        iochan_destroy(h);
+    yaz_mutex_leave(w->mutex);
+    for (; p; p = p_next)
+    {
+        p_next = p->next;
+        p->next = w->chans;
+        w->chans = p;
+    }
+}
+
+static void *worker_thread(void *vp)
+{
+    struct statserv_worker *w = (struct statserv_worker *) vp;
+
+    pthread_setspecific(current_worker_tls, w);
+    iochan_event_loop(&w->chans, 0);
+    return 0;
+}
+
+/* hands new session to the worker with fewest sessions. The counts
+   are read unlocked; the balance need not be exact */
+static void worker_add_session(IOCHAN chan)
+{
+    struct statserv_worker *w = (struct statserv_worker *)
+        pthread_getspecific(current_worker_tls);
+    int i;
+
+    if (w)
+    {   /* accepted by the worker itself (-R): session stays there */
+        yaz_mutex_enter(w->mutex);
+        w->no_sessions++;
+        yaz_mutex_leave(w->mutex);
+        chan->next = w->chans;
+        w->chans = chan;
+        return;
+    }
+    w = workers;
+    for (i = 1; i < worker_threads; i++)
+        if (workers[i].no_sessions < w->no_sessions)
+            w = workers + i;
+    yaz_mutex_enter(w->mutex);
+    w->no_sessions++;
+    yaz_mutex_leave(w->mutex);
+    worker_attach(w, chan);
+}
+
+/* called in worker thread when session is detached from its loop */
+static void pool_submit(IOCHAN chan)
+{
+    struct statserv_job *job = (struct statserv_job *)
+        xmalloc(sizeof(*job));
+
+    job->chan = chan;
+    job->worker = (struct statserv_worker *)
+        pthread_getspecific(current_worker_tls);
+    job->next = 0;
+    yaz_mutex_enter(pool_mutex);
+    *pool_tail = job;
+    pool_tail = &job->next;
+    yaz_cond_signal(pool_cond);
+    yaz_mutex_leave(pool_mutex);
+}
+
+static void *pool_thread(void *vp)
+{
+    while (1)
+    {
+        struct statserv_job *job;
+
+        yaz_mutex_enter(pool_mutex);
+        while (!pool_head && !pool_stop)
+            yaz_cond_wait(pool_cond, pool_mutex, 0);
+        if ((job = pool_head))
+        {
+            if (!(pool_head = job->next))
+                pool_tail = &pool_head;
+        }
+        yaz_mutex_leave(pool_mutex);
+        if (!job)
+            break;
+        ir_process(job->chan);
+        /* time spent in the backend is not idle time */
+        iochan_settimeout(job->chan, job->chan->max_idle);
+        worker_attach(job->worker, job->chan);
+        xfree(job);
+    }
+    return 0;
+}
+
+/* sets up workers. Called before the server is daemonized, so that
+   privileged ports can still be bound for -R */
+static int statserv_workers_init(void)
+{
+    struct reuseport_listener *rl;
+    int i;
+
+    /* listeners of workers are not served by the main thread */
+    for (rl = reuseport_listeners; rl; rl = rl->next)
+    {
+        IOCHAN *pp = &pListener;
+
+        while (*pp && *pp != rl->chan)
+            pp = &(*pp)->next;
+        if (*pp)
+            *pp = rl->chan->next;
+    }
+    pthread_key_create(&current_worker_tls, 0);
+    workers = (struct statserv_worker *)
+        xmalloc(worker_threads * sizeof(*workers));
+    for (i = 0; i < worker_threads; i++)
+    {
+        struct statserv_worker *w = workers + i;
+        IOCHAN chan;
+
+        w->attach = 0;
+        w->wakeup_pending = 0;
+        w->no_sessions = 0;
+        w->stop = 0;
+        w->spipe = yaz_spipe_create(0, 0);
+        if (!w->spipe)
+        {
+            yaz_log(YLOG_FATAL, "Failed to create pipe for worker");
+            return -1;
+        }
+        chan = iochan_create(yaz_spipe_get_read_fd(w->spipe),
+                             worker_wakeup_handler, EVENT_INPUT, 0);
+        iochan_setdata(chan, w);
+        w->chans = chan;
+        w->mutex = 0;
+        yaz_mutex_create(&w->mutex);
+        for (rl = reuseport_listeners; rl; rl = rl->next)
+        {
+            IOCHAN lst = rl->chan;
+
+            if (i > 0 && !(lst = create_listener(rl->where, rl->cert_fname,
+                                                 rl->listen_id,
+                                                 CS_FLAGS_REUSEPORT)))
+                return -1;
+            lst->next = w->chans;
+            w->chans = lst;
+        }
+    }
+    return 0;
+}
+
+static int statserv_workers_start(void)
+{
+    int i;
+
+    for (i = 0; i < worker_threads; i++)
+    {
+        struct statserv_worker *w = workers + i;
+
+        if (statserv_thread_create(&w->thread, worker_thread, w))
+        {
+            yaz_log(YLOG_FATAL|YLOG_ERRNO, "pthread_create");
+            return -1;
+        }
+    }
+    if (backend_threads)
+    {
+        yaz_mutex_create(&pool_mutex);
+        yaz_cond_create(&pool_cond);
+        pool_threads = (pthread_t *)
+            xmalloc(backend_threads * sizeof(*pool_threads));
+        for (i = 0; i < backend_threads; i++)
+            if (statserv_thread_create(pool_threads + i, pool_thread, 0))
+            {
+                yaz_log(YLOG_FATAL|YLOG_ERRNO, "pthread_create");
+                return -1;
+            }
+    }
+    yaz_log(log_server, "Started %d event loop threads and %d backend "
+            "threads", worker_threads, backend_threads);
+    return 0;
+}
+
+/* lets sessions finish and waits for all threads */
+static void statserv_workers_stop(void)
+{
+    int i;
+
+    for (i = 0; i < worker_threads; i++)
+    {
+        struct statserv_worker *w = workers + i;
+
+        yaz_mutex_enter(w->mutex);
+        w->stop = 1;
+        worker_wakeup(w);
+        yaz_mutex_leave(w->mutex);
+    }
+    for (i = 0; i < worker_threads; i++)
+    {
+        struct statserv_worker *w = workers + i;
+
+        pthread_join(w->thread, 0);
+        yaz_spipe_destroy(w->spipe);
+        yaz_mutex_destroy(&w->mutex);
+    }
+    xfree(workers);
+    workers = 0;
+    if (backend_threads)
+    {
+        yaz_mutex_enter(pool_mutex);
+        pool_stop = 1;
+        yaz_cond_broadcast(pool_cond);
+        yaz_mutex_leave(pool_mutex);
+        for (i = 0; i < backend_threads; i++)
+            pthread_join(pool_threads[i], 0);
+        xfree(pool_threads);
+        pool_threads = 0;
+        yaz_cond_destroy(&pool_cond);
+        yaz_mutex_destroy(&pool_mutex);
+    }
+}
+#endif
+
+/* Called by the event loop when a channel has been destroyed. Keeps
+   the session count of worker threads */
 void statserv_remove(IOCHAN pIOChannel)
 {
+#if YAZ_POSIX_THREADS
+    struct statserv_worker *w;
+
+    if (!workers || pIOChannel->fun != ir_session)
+        return;
+    w = (struct statserv_worker *) pthread_getspecific(current_worker_tls);
+    if (w)
+    {
+        yaz_mutex_enter(w->mutex);
+        w->no_sessions--;
+        if (w->stop && w->no_sessions == 0)
+            worker_wakeup(w);
+        yaz_mutex_leave(w->mutex);
+    }
+#endif
 }
 
 static void statserv_closedown(void)
@@ -1110,6 +1451,14 @@ static void *new_session(void *vp)
     {
         iochan_event_loop(&new_chan, 0);
     }
+#if YAZ_POSIX_THREADS
+    else if (workers)
+    {
+        if (backend_threads)
+            newas->offload = pool_submit;
+        worker_add_session(new_chan);
+    }
+#endif
     else
     {
         new_chan->next = pListener;
@@ -1167,7 +1516,6 @@ static void inetd_connection(int what)
 static int add_listener(char *where, int listen_id)
 {
     COMSTACK l;
-    void *ap;
     IOCHAN lst = NULL;
     const char *mode;
 
@@ -1175,20 +1523,53 @@ static int add_listener(char *where, int listen_id)
         mode = "dynamic";
     else if (control_block.threads)
         mode = "threaded";
+    else if (worker_threads)
+        mode = "worker";
     else
         mode = "static";
 
     yaz_log(log_server, "Adding %s listener on %s id=%d PID=%ld", mode, where,
             listen_id, (long) getpid());
 
-    l = cs_create_host(where, 2, &ap);
+    lst = create_listener(where, control_block.cert_fname, listen_id,
+                          reuseport ? CS_FLAGS_REUSEPORT : 0);
+    if (!lst)
+        return -1;
+    l = (COMSTACK) iochan_getdata(lst);
+    if (reuseport && (l->type == tcpip_type || l->type == ssl_type))
+    {
+        struct reuseport_listener *rl = (struct reuseport_listener *)
+            xmalloc(sizeof(*rl));
+
+        rl->where = xstrdup(where);
+        rl->cert_fname = xstrdup(control_block.cert_fname);
+        rl->listen_id = listen_id;
+        rl->chan = lst;
+        rl->next = reuseport_listeners;
+        reuseport_listeners = rl;
+    }
+
+    /* Add listener to chain */
+    lst->next = pListener;
+    pListener = lst;
+    return 0; /* OK */
+}
+
+static IOCHAN create_listener(const char *where, const char *cert_fname,
+                              int listen_id, int flags)
+{
+    COMSTACK l;
+    void *ap;
+    IOCHAN lst = NULL;
+
+    l = cs_create_host(where, 2 | flags, &ap);
     if (!l)
     {
         yaz_log(YLOG_FATAL, "Failed to listen on %s", where);
-        return -1;
+        return 0;
     }
-    if (*control_block.cert_fname)
-        cs_set_ssl_certificate_file(l, control_block.cert_fname);
+    if (*cert_fname)
+        cs_set_ssl_certificate_file(l, cert_fname);
 
     if (cs_bind(l, ap, CS_SERVER) < 0)
     {
@@ -1198,22 +1579,18 @@ static int add_listener(char *where, int listen_id)
             level |= YLOG_ERRNO;
         log_comstack_error(level, l, "Failed to bind to %s", where);
         cs_close(l);
-        return -1;
+        return 0;
     }
     if (!(lst = iochan_create(cs_fileno(l), listener, EVENT_INPUT |
                               EVENT_EXCEPT, listen_id)))
     {
         yaz_log(YLOG_FATAL|YLOG_ERRNO, "Failed to create IOCHAN-type");
         cs_close(l);
-        return -1;
+        return 0;
     }
     iochan_setdata(lst, l); /* user-defined data for listener is COMSTACK */
     l->user = lst;  /* user-defined data for COMSTACK is listener chan */
-
-    /* Add listener to chain */
-    lst->next = pListener;
-    pListener = lst;
-    return 0; /* OK */
+    return lst;
 }
 
 static void remove_listeners(void)
@@ -1284,10 +1661,42 @@ static void normal_stop_handler(int num)
 }
 #endif
 
+static void log_buf_stat(void)
+{
+    struct cs_buf_stat st;
+
+    cs_buf_get_stat(&st);
+    yaz_log(log_server, "Receive buffers: %ld hits %ld misses %ld released "
+            "%ld freed %ld bytes pooled", st.hits, st.misses, st.released,
+            st.freed, st.bytes_free);
+}
+
 static void daemon_handler(void *data)
 {
     IOCHAN *pListener = data;
+#if YAZ_POSIX_THREADS
+    if (worker_threads && statserv_workers_start())
+        return;
+    if (!*pListener)
+    {   /* all listeners are served by workers (-R) */
+        sigset_t block, old;
+
+        sigemptyset(&block);
+        sigaddset(&block, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &block, &old);
+        while (!sig_received)
+            sigsuspend(&old);
+        pthread_sigmask(SIG_SETMASK, &old, 0);
+        log_buf_stat();
+        return;
+    }
+#endif
     iochan_event_loop(pListener, &sig_received);
+#if YAZ_POSIX_THREADS
+    if (worker_threads && !sig_received)
+        statserv_workers_stop();
+#endif
+    log_buf_stat();
 }
 
 static void show_version(void)
@@ -1353,6 +1762,10 @@ static int statserv_sc_main(yaz_sc_t s, int argc, char **argv)
     }
     if (pListener == NULL)
         return 1;
+#if YAZ_POSIX_THREADS
+    if (worker_threads && statserv_workers_init())
+        return 1;
+#endif
     if (s)
         yaz_sc_running(s);
 
@@ -1386,7 +1799,7 @@ int check_options(int argc, char **argv)
 
     get_logbits(1);
 
-    while ((ret = options("1a:iszSTl:v:u:c:w:t:k:Kd:A:p:DC:f:m:r:V",
+    while ((ret = options("1a:iszSTRW:B:l:v:u:c:w:t:k:Kd:A:p:DC:f:m:r:V",
                           argv, argc, &arg)) != -2)
     {
         switch (ret)
@@ -1408,16 +1821,55 @@ int check_options(int argc, char **argv)
             break;
         case 'S':
             control_block.dynamic = 0;
+            worker_threads = 0;
             break;
         case 'T':
 #if YAZ_POSIX_THREADS
             control_block.dynamic = 0;
             control_block.threads = 1;
+            worker_threads = 0;
+#else
+            fprintf(stderr, "%s: Threaded mode not available.\n", me);
+            return 1;
+#endif
+            break;
+        case 'W':
+#if YAZ_POSIX_THREADS
+            if (!arg || (r = atoi(arg)) < 0)
+            {
+                fprintf(stderr, "%s: Specify number of threads for -W.\n",
+                        me);
+                return 1;
+            }
+            control_block.dynamic = 0;
+            control_block.threads = 0;
+            worker_threads = r ? r : cpu_count();
+#else
+            fprintf(stderr, "%s: Threaded mode not available.\n", me);
+            return 1;
+#endif
+            break;
+        case 'R':
+#if YAZ_POSIX_THREADS
+            control_block.dynamic = 0;
+            control_block.threads = 0;
+            if (!worker_threads)
+                worker_threads = cpu_count();
+            reuseport = 1;
 #else
             fprintf(stderr, "%s: Threaded mode not available.\n", me);
             return 1;
 #endif
             break;
+        case 'B':
+            if (!arg || (r = atoi(arg)) < 0)
+            {
+                fprintf(stderr, "%s: Specify number of threads for -B.\n",
+                        me);
+                return 1;
+            }
+            backend_threads = r;
+            break;
         case 'l':
             option_copy(control_block.logfile, arg);
             yaz_log_init_file(control_block.logfile);
@@ -1509,10 +1961,23 @@ int check_options(int argc, char **argv)
             fprintf(stderr, "Usage: %s [ -a <pdufile> -v <loglevel>"
                     " -l <logfile> -u <user> -c <config> -t <minutes>"
                     " -k <kilobytes> -d <daemon> -p <pidfile> -C certfile"
-                    " -zKiDSTV1 -m <time-format> -w <directory> <listener-addr>... ]\n", me);
+                    " -zKiDRSTV1 -m <time-format> -w <directory>"
+                    " -W <threads> -B <threads> <listener-addr>... ]\n", me);
             return 1;
         }
     }
+    if (backend_threads && !worker_threads)
+    {
+        fprintf(stderr, "%s: Option -B requires -W.\n", me);
+        return 1;
+    }
+    if (reuseport && (!worker_threads || control_block.one_shot ||
+                      max_sessions))
+    {
+        fprintf(stderr, "%s: Option -R can not be combined with -S, -T, "
+                "-1 or -A.\n", me);
+        return 1;
+    }
     return 0;
 }
 
@@ -12,6 +12,8 @@
 
 #include <yaz/yconfig.h>
 
+/* _DEFAULT_SOURCE: for glibc's sys/socket.h to expose SO_REUSEPORT */
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -83,6 +85,7 @@
 
 static void tcpip_close(COMSTACK h);
 static int tcpip_put(COMSTACK h, char *buf, int size);
+static int tcpip_put_iov(COMSTACK h, const struct cs_iovec *iov, int iovcnt);
 static int tcpip_get(COMSTACK h, char **buf, int *bufsize);
 static int tcpip_connect(COMSTACK h, void *address);
 static int tcpip_more(COMSTACK h);
@@ -121,7 +124,9 @@ typedef struct tcpip_state
 
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
-    int (*complete)(const char *buf, int len); /* length/complete. */
+    int (*complete)(const char *buf, int len,
+                    struct cs_complete_state *st); /* length/complete. */
+    struct cs_complete_state complete_state;
     char *bind_host;
     char *host_port;
     struct addrinfo *ai;
@@ -185,7 +190,8 @@ static struct tcpip_state *tcpip_state_create(void)
     sp->altbuf = 0;
     sp->altsize = sp->altlen = 0;
     sp->towrite = sp->written = -1;
-    sp->complete = cs_complete_auto;
+    sp->complete = cs_complete_auto_r;
+    cs_complete_reset(&sp->complete_state);
     sp->bind_host = 0;
     sp->host_port = 0;
     sp->ai = 0;
@@ -221,7 +227,7 @@ static void tcpip_state_destroy(tcpip_state *sp)
 #endif
     if (sp->ai)
         freeaddrinfo(sp->ai);
-    xfree(sp->altbuf);
+    cs_buf_release(&sp->altbuf, &sp->altsize);
     xfree(sp->bind_host);
     xfree(sp->host_port);
     xfree(sp->connect_host);
@@ -256,6 +262,8 @@ COMSTACK tcpip_type(int s, int flags, int protocol, void *vp)
     p->f_rcvconnect = tcpip_rcvconnect;
     p->f_get = tcpip_get;
     p->f_put = tcpip_put;
+    p->f_put_iov = tcpip_put_iov;
+    p->put_iov_next = 0;
     p->f_close = tcpip_close;
     p->f_more = tcpip_more;
     p->f_bind = tcpip_bind;
@@ -674,7 +682,8 @@ int tcpip_more(COMSTACK h)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
 
-    return sp->altlen && (*sp->complete)(sp->altbuf, sp->altlen) != 0;
+    return sp->altlen &&
+        (*sp->complete)(sp->altbuf, sp->altlen, &sp->complete_state) != 0;
 }
 
 static int cont_connect(COMSTACK h)
@@ -845,7 +854,8 @@ int tcpip_rcvconnect(COMSTACK h)
 
         if (sp->connect_phase == 0)
         {
-            sp->complete = cs_complete_auto_head;
+            sp->complete = cs_complete_auto_head_r;
+            cs_complete_reset(&sp->complete_state);
             r = tcpip_put(h, wrbuf_buf(sp->connect_request), wrbuf_len(sp->connect_request));
             yaz_log(log_level, "tcpip_rcvconnect connect put r=%d", r);
             h->event = CS_CONNECT; /* because tcpip_put sets it */
@@ -875,7 +885,8 @@ int tcpip_rcvconnect(COMSTACK h)
                 cs_set_error(h, CSDENY, 0);
                 return -1;
             }
-            sp->complete = cs_complete_auto;
+            sp->complete = cs_complete_auto_r;
+            cs_complete_reset(&sp->complete_state);
             sp->connect_phase = 2;
         }
     }
@@ -1009,6 +1020,16 @@ static int tcpip_bind(COMSTACK h, void *address, int mode)
         cs_set_error(h, CSYSERR, 0);
         return -1;
     }
+#endif
+#ifdef SO_REUSEPORT
+    /* several sockets may listen on the same address */
+    if ((h->flags & CS_FLAGS_REUSEPORT) &&
+        setsockopt(h->iofile, SOL_SOCKET, SO_REUSEPORT, (char*)
+                   &one, sizeof(one)) < 0)
+    {
+        cs_set_error(h, CSYSERR, 0);
+        return -1;
+    }
 #endif
     r = bind(h->iofile, ai->ai_addr, ai->ai_addrlen);
     freeaddrinfo(sp->ai);
@@ -1214,7 +1235,7 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
     char *tmpc;
-    int tmpi, berlen, rest, req, tomove;
+    int tmpi, berlen, req, tomove;
     int hasread = 0, res;
 
     yaz_log(log_level, "tcpip_get h=%p bufsize=%d", h, *bufsize);
@@ -1231,11 +1252,12 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
         sp->altsize = tmpi;
     }
     h->io_pending = 0;
-    while ((berlen = (*sp->complete)(*buf, hasread)) == 0)
+    while ((berlen = (*sp->complete)(*buf, hasread,
+                                     &sp->complete_state)) == 0)
     {
         if (!*bufsize)
         {
-            if (!(*buf = (char *)xmalloc(*bufsize = CS_TCPIP_BUFCHUNK)))
+            if (!(*buf = cs_buf_get(*bufsize = CS_TCPIP_BUFCHUNK)))
             {
                 cs_set_error(h, CSYSERR, 0);
                 return -1;
@@ -1243,20 +1265,25 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
         }
         else if (*bufsize - hasread < CS_TCPIP_BUFCHUNK)
         {
+            int nsize;
             if (*bufsize > h->max_recv_bytes / 2)
-                *bufsize = h->max_recv_bytes;
+                nsize = h->max_recv_bytes;
             else
-                *bufsize = *bufsize * 2;
-            if (*bufsize - hasread < CS_TCPIP_BUFCHUNK)
+                nsize = *bufsize * 2;
+            if (nsize - hasread < CS_TCPIP_BUFCHUNK)
             {
                 cs_set_error(h, CSBUFSIZE, 0);
                 return -1;
             }
-            if (!(*buf = (char *)xrealloc(*buf, *bufsize)))
+            if (!(tmpc = cs_buf_get(nsize)))
             {
                 cs_set_error(h, CSYSERR, 0);
                 return -1;
             }
+            memcpy(tmpc, *buf, hasread);
+            cs_buf_release(buf, bufsize);
+            *buf = tmpc;
+            *bufsize = nsize;
         }
 #if HAVE_GNUTLS_H
         if (sp->session)
@@ -1346,33 +1373,43 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
     }
     yaz_log(log_level, "  Out of read loop with hasread=%d, berlen=%d",
                 hasread, berlen);
-    /* move surplus buffer (or everything if we didn't get a BER rec.) */
+    cs_buf_release(&sp->altbuf, &sp->altsize);
+    if (!berlen)
+    {
+        /* incomplete: keep the data read so far in altbuf (no copy),
+           so an idle session does not hold a receive buffer. The
+           complete state still refers to it */
+        if (hasread)
+        {
+            sp->altbuf = *buf;
+            sp->altsize = *bufsize;
+            sp->altlen = hasread;
+            *buf = 0;
+            *bufsize = 0;
+        }
+        else
+            cs_buf_release(buf, bufsize);
+        return 1;
+    }
+    cs_complete_reset(&sp->complete_state);
+    /* move surplus buffer */
     if (hasread > berlen)
     {
-        tomove = req = hasread - berlen;
-        rest = tomove % CS_TCPIP_BUFCHUNK;
-        if (rest)
-            req += CS_TCPIP_BUFCHUNK - rest;
-        if (!sp->altbuf)
+        tomove = hasread - berlen;
+        for (req = CS_TCPIP_BUFCHUNK; req < tomove; req *= 2)
+            ;
+        if (!(sp->altbuf = cs_buf_get(sp->altsize = req)))
         {
-            if (!(sp->altbuf = (char *)xmalloc(sp->altsize = req)))
-            {
-                cs_set_error(h, CSYSERR, 0);
-                return -1;
-            }
-        } else if (sp->altsize < req)
-            if (!(sp->altbuf =(char *)xrealloc(sp->altbuf, sp->altsize = req)))
-            {
-                cs_set_error(h, CSYSERR, 0);
-                return -1;
-            }
+            cs_set_error(h, CSYSERR, 0);
+            return -1;
+        }
         yaz_log(log_level, "  Moving %d bytes to altbuf(%p)", tomove,
                 sp->altbuf);
         memcpy(sp->altbuf, *buf + berlen, sp->altlen = tomove);
     }
     if (berlen < CS_TCPIP_BUFCHUNK - 1)
         *(*buf + berlen) = '\0';
-    return berlen ? berlen : 1;
+    return berlen;
 }
 
 
@@ -1383,10 +1420,60 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
  */
 int tcpip_put(COMSTACK h, char *buf, int size)
 {
-    int res;
+    struct cs_iovec iov;
+
+    iov.buf = buf;
+    iov.len = size;
+    return tcpip_put_iov(h, &iov, 1);
+}
+
+#ifndef WIN32
+/* maximum number of segments passed to sendmsg at a time */
+#define TCPIP_IOV_MAX 64
+#endif
+
+/* sends segments; first segment starts at offset off */
+static int tcpip_send_iov(COMSTACK h, const struct cs_iovec *iov, int iovcnt,
+                          int off)
+{
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+#ifndef WIN32
+    if (iovcnt > 1)
+    {
+        struct iovec vec[TCPIP_IOV_MAX];
+        struct msghdr msg;
+        int i;
+
+        if (iovcnt > TCPIP_IOV_MAX)
+            iovcnt = TCPIP_IOV_MAX;
+        for (i = 0; i < iovcnt; i++)
+        {
+            vec[i].iov_base = iov[i].buf;
+            vec[i].iov_len = iov[i].len;
+        }
+        vec[0].iov_base = iov[0].buf + off;
+        vec[0].iov_len = iov[0].len - off;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iovcnt;
+        return sendmsg(h->iofile, &msg, flags);
+    }
+#endif
+    return send(h->iofile, iov[0].buf + off, iov[0].len - off, flags);
+}
+
+static int tcpip_put_iov(COMSTACK h, const struct cs_iovec *iov, int iovcnt)
+{
+    int res, i, off, size = 0;
     struct tcpip_state *state = (struct tcpip_state *)h->cprivate;
 
-    yaz_log(log_level, "tcpip_put h=%p size=%d", h, size);
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].len;
+    yaz_log(log_level, "tcpip_put h=%p size=%d iovcnt=%d", h, size, iovcnt);
     h->io_pending = 0;
     h->event = CS_DATA;
     if (state->towrite < 0)
@@ -1401,11 +1488,15 @@ int tcpip_put(COMSTACK h, char *buf, int size)
     }
     while (state->towrite > state->written)
     {
+        /* locate first segment with data not yet written */
+        off = state->written;
+        for (i = 0; off >= iov[i].len; i++)
+            off -= iov[i].len;
 #if HAVE_GNUTLS_H
         if (state->session)
         {
-            res = gnutls_record_send(state->session, buf + state->written,
-                                     size - state->written);
+            res = gnutls_record_send(state->session, iov[i].buf + off,
+                                     iov[i].len - off);
             if (res < 0)
             {
                 if (ssl_check_again(h, state, res))
@@ -1420,15 +1511,7 @@ int tcpip_put(COMSTACK h, char *buf, int size)
         else
 #endif
         {
-            if ((res =
-                 send(h->iofile, buf + state->written, size -
-                      state->written,
-#ifdef MSG_NOSIGNAL
-                      MSG_NOSIGNAL
-#else
-                      0
-#endif
-                     )) < 0)
+            if ((res = tcpip_send_iov(h, iov + i, iovcnt - i, off)) < 0)
             {
                 if (
 #ifdef WIN32
@@ -1775,9 +1858,10 @@ int cs_set_head_only(COMSTACK cs, int head_only)
     {
         tcpip_state *sp = (tcpip_state *)cs->cprivate;
         if (head_only)
-            sp->complete = cs_complete_auto_head;
+            sp->complete = cs_complete_auto_head_r;
         else
-            sp->complete = cs_complete_auto;
+            sp->complete = cs_complete_auto_r;
+        cs_complete_reset(&sp->complete_state);
         return 0;
     }
     cs_set_error(cs, CS_ST_INCON, 0);
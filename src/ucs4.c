@@ -17,6 +17,10 @@
 
 #include "iconv-p.h"
 
+#if YAZ_ICONV_SSE2
+#include <emmintrin.h>
+#endif
+
 static unsigned long read_UCS4(yaz_iconv_t cd, yaz_iconv_decoder_t d,
                                unsigned char *inp,
                                size_t inbytesleft, size_t *no_read)
@@ -98,16 +102,91 @@ static size_t write_UCS4LE(yaz_iconv_t cd, yaz_iconv_encoder_t en,
     *outbuf = (char *) outp;
     return 0;
 }
+/* widens ASCII bytes to 4 bytes each, big endian if be is set */
+static size_t write_ascii_ucs4_x(const unsigned char *inp, size_t len,
+                                 char **outbuf, size_t *outbytesleft, int be)
+{
+    unsigned char *outp = (unsigned char *) *outbuf;
+    size_t i = 0;
 
+    if (len > *outbytesleft / 4)
+        len = *outbytesleft / 4;
+#if YAZ_ICONV_SSE2
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (inp + i));
+            __m128i w0, w1;
+            if (be)
+            {
+                w0 = _mm_unpacklo_epi8(zero, v);
+                w1 = _mm_unpackhi_epi8(zero, v);
+                _mm_storeu_si128((__m128i *) outp,
+                                 _mm_unpacklo_epi16(zero, w0));
+                _mm_storeu_si128((__m128i *) (outp + 16),
+                                 _mm_unpackhi_epi16(zero, w0));
+                _mm_storeu_si128((__m128i *) (outp + 32),
+                                 _mm_unpacklo_epi16(zero, w1));
+                _mm_storeu_si128((__m128i *) (outp + 48),
+                                 _mm_unpackhi_epi16(zero, w1));
+            }
+            else
+            {
+                w0 = _mm_unpacklo_epi8(v, zero);
+                w1 = _mm_unpackhi_epi8(v, zero);
+                _mm_storeu_si128((__m128i *) outp,
+                                 _mm_unpacklo_epi16(w0, zero));
+                _mm_storeu_si128((__m128i *) (outp + 16),
+                                 _mm_unpackhi_epi16(w0, zero));
+                _mm_storeu_si128((__m128i *) (outp + 32),
+                                 _mm_unpacklo_epi16(w1, zero));
+                _mm_storeu_si128((__m128i *) (outp + 48),
+                                 _mm_unpackhi_epi16(w1, zero));
+            }
+            outp += 64;
+        }
+    }
+#endif
+    for (; i < len; i++)
+    {
+        outp[0] = outp[1] = outp[2] = outp[3] = 0;
+        outp[be ? 3 : 0] = inp[i];
+        outp += 4;
+    }
+    *outbuf = (char *) outp;
+    *outbytesleft -= len * 4;
+    return len;
+}
+
+static size_t write_ascii_UCS4(yaz_iconv_t cd, yaz_iconv_encoder_t en,
+                               const unsigned char *inp, size_t len,
+                               char **outbuf, size_t *outbytesleft)
+{
+    return write_ascii_ucs4_x(inp, len, outbuf, outbytesleft, 1);
+}
+
+static size_t write_ascii_UCS4LE(yaz_iconv_t cd, yaz_iconv_encoder_t en,
+                                 const unsigned char *inp, size_t len,
+                                 char **outbuf, size_t *outbytesleft)
+{
+    return write_ascii_ucs4_x(inp, len, outbuf, outbytesleft, 0);
+}
 
 yaz_iconv_encoder_t yaz_ucs4_encoder(const char *tocode,
                                      yaz_iconv_encoder_t e)
 
 {
     if (!yaz_matchstr(tocode, "UCS4"))
+    {
         e->write_handle = write_UCS4;
+        e->write_ascii_handle = write_ascii_UCS4;
+    }
     else if (!yaz_matchstr(tocode, "UCS4LE"))
+    {
         e->write_handle = write_UCS4LE;
+        e->write_ascii_handle = write_ascii_UCS4LE;
+    }
     else
         return 0;
     return e;
@@ -43,6 +43,7 @@
 #include <sys/un.h>
 #endif
 
+#include "comstack-p.h"
 #include <yaz/unix.h>
 #include <yaz/errno.h>
 #include <yaz/log.h>
@@ -54,6 +55,7 @@
 
 static void unix_close(COMSTACK h);
 static int unix_put(COMSTACK h, char *buf, int size);
+static int unix_put_iov(COMSTACK h, const struct cs_iovec *iov, int iovcnt);
 static int unix_get(COMSTACK h, char **buf, int *bufsize);
 static int unix_connect(COMSTACK h, void *address);
 static int unix_more(COMSTACK h);
@@ -82,7 +84,9 @@ typedef struct unix_state
 
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
-    int (*complete)(const char *buf, int len); /* length/complete. */
+    int (*complete)(const char *buf, int len,
+                    struct cs_complete_state *st); /* length/complete. */
+    struct cs_complete_state complete_state;
     struct sockaddr_un addr;  /* returned by cs_straddr */
     int uid;
     int gid;
@@ -151,6 +155,8 @@ COMSTACK unix_type(int s, int flags, int protocol, void *vp)
     p->f_rcvconnect = unix_rcvconnect;
     p->f_get = unix_get;
     p->f_put = unix_put;
+    p->f_put_iov = unix_put_iov;
+    p->put_iov_next = 0;
     p->f_close = unix_close;
     p->f_more = unix_more;
     p->f_bind = unix_bind;
@@ -170,7 +176,8 @@ COMSTACK unix_type(int s, int flags, int protocol, void *vp)
     state->altbuf = 0;
     state->altsize = state->altlen = 0;
     state->towrite = state->written = -1;
-    state->complete = cs_complete_auto;
+    state->complete = cs_complete_auto_r;
+    cs_complete_reset(&state->complete_state);
 
     yaz_log(log_level, "Created UNIX comstack h=%p", p);
 
@@ -313,7 +320,8 @@ static int unix_more(COMSTACK h)
 {
     unix_state *sp = (unix_state *)h->cprivate;
 
-    return sp->altlen && (*sp->complete)(sp->altbuf, sp->altlen) != 0;
+    return sp->altlen &&
+        (*sp->complete)(sp->altbuf, sp->altlen, &sp->complete_state) != 0;
 }
 
 /*
@@ -548,6 +556,7 @@ static COMSTACK unix_accept(COMSTACK h)
         state->altsize = state->altlen = 0;
         state->towrite = state->written = -1;
         state->complete = st->complete;
+        cs_complete_reset(&state->complete_state);
         memcpy(&state->addr, &st->addr, sizeof(state->addr));
         cnew->state = CS_ST_ACCEPT;
         cnew->event = CS_NONE;
@@ -579,7 +588,7 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
 {
     unix_state *sp = (unix_state *)h->cprivate;
     char *tmpc;
-    int tmpi, berlen, rest, req, tomove;
+    int tmpi, berlen, req, tomove;
     int hasread = 0, res;
 
     yaz_log(log_level, "unix_get h=%p bufsize=%d", h, *bufsize);
@@ -597,30 +606,36 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
         sp->altsize = tmpi;
     }
     h->io_pending = 0;
-    while ((berlen = (*sp->complete)(*buf, hasread)) == 0)
+    while ((berlen = (*sp->complete)(*buf, hasread,
+                                     &sp->complete_state)) == 0)
     {
         if (!*bufsize)
         {
-            if (!(*buf = (char *)xmalloc(*bufsize = CS_UNIX_BUFCHUNK)))
+            if (!(*buf = cs_buf_get(*bufsize = CS_UNIX_BUFCHUNK)))
                 return -1;
         }
         else if (*bufsize - hasread < CS_UNIX_BUFCHUNK)
         {
+            int nsize;
             if (*bufsize > h->max_recv_bytes / 2)
-                *bufsize = h->max_recv_bytes;
+                nsize = h->max_recv_bytes;
             else
-                *bufsize = *bufsize * 2;
+                nsize = *bufsize * 2;
 
-            if (*bufsize - hasread < CS_UNIX_BUFCHUNK)
+            if (nsize - hasread < CS_UNIX_BUFCHUNK)
             {
                 cs_set_error(h, CSBUFSIZE);
                 return -1;
             }
-            if (!(*buf = (char *)xrealloc(*buf, *bufsize)))
+            if (!(tmpc = cs_buf_get(nsize)))
             {
                 cs_set_error(h, CSYSERR);
                 return -1;
             }
+            memcpy(tmpc, *buf, hasread);
+            cs_buf_release(buf, bufsize);
+            *buf = tmpc;
+            *bufsize = nsize;
         }
         res = recv(h->iofile, *buf + hasread, CS_UNIX_BUFCHUNK, 0);
         yaz_log(log_level, "  recv res=%d, hasread=%d", res, hasread);
@@ -659,27 +674,43 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
     }
     yaz_log(log_level, "  Out of read loop with hasread=%d, berlen=%d",
                   hasread, berlen);
-    /* move surplus buffer (or everything if we didn't get a BER rec.) */
+    cs_buf_release(&sp->altbuf, &sp->altsize);
+    if (!berlen)
+    {
+        /* incomplete: keep the data read so far in altbuf (no copy),
+           so an idle session does not hold a receive buffer. The
+           complete state still refers to it */
+        if (hasread)
+        {
+            sp->altbuf = *buf;
+            sp->altsize = *bufsize;
+            sp->altlen = hasread;
+            *buf = 0;
+            *bufsize = 0;
+        }
+        else
+            cs_buf_release(buf, bufsize);
+        return 1;
+    }
+    cs_complete_reset(&sp->complete_state);
+    /* move surplus buffer */
     if (hasread > berlen)
     {
-        tomove = req = hasread - berlen;
-        rest = tomove % CS_UNIX_BUFCHUNK;
-        if (rest)
-            req += CS_UNIX_BUFCHUNK - rest;
-        if (!sp->altbuf)
+        tomove = hasread - berlen;
+        for (req = CS_UNIX_BUFCHUNK; req < tomove; req *= 2)
+            ;
+        if (!(sp->altbuf = cs_buf_get(sp->altsize = req)))
         {
-            if (!(sp->altbuf = (char *)xmalloc(sp->altsize = req)))
-                return -1;
-        } else if (sp->altsize < req)
-            if (!(sp->altbuf =(char *)xrealloc(sp->altbuf, sp->altsize = req)))
-                return -1;
+            cs_set_error(h, CSYSERR);
+            return -1;
+        }
         yaz_log(log_level, "  Moving %d bytes to altbuf(%p)", tomove,
                 sp->altbuf);
         memcpy(sp->altbuf, *buf + berlen, sp->altlen = tomove);
     }
     if (berlen < CS_UNIX_BUFCHUNK - 1)
         *(*buf + berlen) = '\0';
-    return berlen ? berlen : 1;
+    return berlen;
 }
 
 
@@ -691,10 +722,26 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
  */
 static int unix_put(COMSTACK h, char *buf, int size)
 {
-    int res;
+    struct cs_iovec iov;
+
+    iov.buf = buf;
+    iov.len = size;
+    return unix_put_iov(h, &iov, 1);
+}
+
+/* maximum number of segments passed to sendmsg at a time */
+#define UNIX_IOV_MAX 64
+
+static int unix_put_iov(COMSTACK h, const struct cs_iovec *iov, int iovcnt)
+{
+    int res, i, off, n, size = 0;
     struct unix_state *state = (struct unix_state *)h->cprivate;
+    struct iovec vec[UNIX_IOV_MAX];
+    struct msghdr msg;
 
-    yaz_log(log_level, "unix_put h=%p size=%d", h, size);
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].len;
+    yaz_log(log_level, "unix_put h=%p size=%d iovcnt=%d", h, size, iovcnt);
     h->io_pending = 0;
     h->event = CS_DATA;
     if (state->towrite < 0)
@@ -709,15 +756,27 @@ static int unix_put(COMSTACK h, char *buf, int size)
     }
     while (state->towrite > state->written)
     {
-        if ((res =
-             send(h->iofile, buf + state->written, size -
-                  state->written,
+        /* locate first segment with data not yet written */
+        off = state->written;
+        for (i = 0; off >= iov[i].len; i++)
+            off -= iov[i].len;
+        for (n = 0; n < UNIX_IOV_MAX && i + n < iovcnt; n++)
+        {
+            vec[n].iov_base = iov[i + n].buf;
+            vec[n].iov_len = iov[i + n].len;
+        }
+        vec[0].iov_base = iov[i].buf + off;
+        vec[0].iov_len = iov[i].len - off;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = vec;
+        msg.msg_iovlen = n;
+        if ((res = sendmsg(h->iofile, &msg,
 #ifdef MSG_NOSIGNAL
-                  MSG_NOSIGNAL
+                           MSG_NOSIGNAL
 #else
-                  0
+                           0
 #endif
-                 )) < 0)
+                     )) < 0)
         {
             if (
                 yaz_errno() == EWOULDBLOCK
@@ -753,8 +812,7 @@ static void unix_close(COMSTACK h)
     {
         close(h->iofile);
     }
-    if (sp->altbuf)
-        xfree(sp->altbuf);
+    cs_buf_release(&sp->altbuf, &sp->altsize);
     xfree(sp);
     xfree(h);
 }
@@ -17,6 +17,10 @@
 
 #include "iconv-p.h"
 
+#if YAZ_ICONV_SSE2
+#include <emmintrin.h>
+#endif
+
 static size_t init_utf8(yaz_iconv_t cd, yaz_iconv_decoder_t d,
                         unsigned char *inp,
                         size_t inbytesleft, size_t *no_read)
@@ -156,6 +160,24 @@ static size_t write_UTF8(yaz_iconv_t cd, yaz_iconv_encoder_t en,
     return r;
 }
 
+static size_t read_ascii_utf8(yaz_iconv_decoder_t d,
+                              const unsigned char *inp, size_t inbytesleft)
+{
+    return yaz_iconv_ascii_span(inp, inbytesleft);
+}
+
+static size_t write_ascii_UTF8(yaz_iconv_t cd, yaz_iconv_encoder_t en,
+                               const unsigned char *inp, size_t len,
+                               char **outbuf, size_t *outbytesleft)
+{
+    if (len > *outbytesleft)
+        len = *outbytesleft;
+    memcpy(*outbuf, inp, len);
+    *outbuf += len;
+    *outbytesleft -= len;
+    return len;
+}
+
 size_t yaz_write_UTF8_char(unsigned long x,
                            char **outbuf, size_t *outbytesleft,
                            int *error)
@@ -223,6 +245,7 @@ yaz_iconv_encoder_t yaz_utf8_encoder(const char *tocode,
     if (!yaz_matchstr(tocode, "UTF8"))
     {
         e->write_handle = write_UTF8;
+        e->write_ascii_handle = write_ascii_UTF8;
         return e;
     }
     return 0;
@@ -235,26 +258,87 @@ yaz_iconv_decoder_t yaz_utf8_decoder(const char *fromcode,
     {
         d->init_handle = init_utf8;
         d->read_handle = read_utf8;
+        d->read_ascii_handle = read_ascii_utf8;
         return d;
     }
     return 0;
 }
 
+/* returns length of leading run of 7-bit bytes */
+static size_t ascii7_span(const unsigned char *inp, size_t len)
+{
+    const unsigned long highs = ~0UL / 255 * 0x80;
+    size_t i = 0;
+#if YAZ_ICONV_SSE2
+    while (i + 16 <= len)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (inp + i));
+        if (_mm_movemask_epi8(v))
+            break;
+        i += 16;
+    }
+#endif
+    while (i + sizeof(unsigned long) <= len)
+    {
+        unsigned long w;
+        memcpy(&w, inp + i, sizeof(w));
+        if (w & highs)
+            break;
+        i += sizeof(w);
+    }
+    while (i < len && inp[i] < 0x80)
+        i++;
+    return i;
+}
+
 int yaz_utf8_check(const char *str)
 {
-    /* cast OK: yaz_read_UTF8_char is read-only */
-    unsigned char *inp = (unsigned char *) str;
+    const unsigned char *inp = (const unsigned char *) str;
     size_t inbytesleft = strlen(str);
 
     while (inbytesleft)
     {
-        int error = 0;
-        size_t no_read;
-        yaz_read_UTF8_char(inp, inbytesleft, &no_read, &error);
-        if (error)
-            return 0;
+        size_t no_read = ascii7_span(inp, inbytesleft);
+
         inp += no_read;
         inbytesleft -= no_read;
+        /* sequence of non-ASCII characters. Same rules as
+           yaz_read_UTF8_char: no overlong forms, up to 6 bytes */
+        while (inbytesleft && inp[0] >= 0x80)
+        {
+            unsigned c = inp[0];
+            if (c >= 0xc2 && c <= 0xdf)
+            {
+                if (inbytesleft < 2 || (inp[1] & 0xc0) != 0x80)
+                    return 0;
+                no_read = 2;
+            }
+            else if (c >= 0xe0 && c <= 0xef)
+            {
+                if (inbytesleft < 3 || (inp[1] & 0xc0) != 0x80
+                    || (inp[2] & 0xc0) != 0x80
+                    || (c == 0xe0 && inp[1] < 0xa0))
+                    return 0;
+                no_read = 3;
+            }
+            else if (c >= 0xf0 && c <= 0xf7)
+            {
+                if (inbytesleft < 4 || (inp[1] & 0xc0) != 0x80
+                    || (inp[2] & 0xc0) != 0x80 || (inp[3] & 0xc0) != 0x80
+                    || (c == 0xf0 && inp[1] < 0x90))
+                    return 0;
+                no_read = 4;
+            }
+            else
+            {
+                int error = 0;
+                yaz_read_UTF8_char(inp, inbytesleft, &no_read, &error);
+                if (error)
+                    return 0;
+            }
+            inp += no_read;
+            inbytesleft -= no_read;
+        }
     }
     return 1;
 }
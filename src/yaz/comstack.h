@@ -43,6 +43,12 @@ struct comstack;
 typedef struct comstack *COMSTACK;
 typedef COMSTACK (*CS_TYPE)(int s, int flags, int protocol, void *vp);
 
+/** \brief buffer segment for cs_put_iov */
+struct cs_iovec {
+    char *buf;
+    int len;
+};
+
 struct comstack
 {
     CS_TYPE type;
@@ -85,9 +91,16 @@ struct comstack
     void *(*f_straddr)(COMSTACK handle, const char *str);
     int (*f_set_blocking)(COMSTACK handle, int blocking);
     void *user;       /* user defined data associated with COMSTACK */
+    int (*f_put_iov)(COMSTACK handle, const struct cs_iovec *iov, int iovcnt);
+    int put_iov_next; /* next segment for cs_put_iov_f_put */
 };
 
 #define cs_put(handle, buf, size) ((*(handle)->f_put)(handle, buf, size))
+/* like cs_put, but data is given as segments. Call again with the same
+   segments until 0 is returned */
+#define cs_put_iov(handle, iov, cnt) ((handle)->f_put_iov ? \
+        (*(handle)->f_put_iov)(handle, iov, cnt) : \
+        cs_put_iov_f_put(handle, iov, cnt))
 #define cs_get(handle, buf, size) ((*(handle)->f_get)(handle, buf, size))
 #define cs_more(handle) ((*(handle)->f_more)(handle))
 #define cs_connect(handle, address) ((*(handle)->f_connect)(handle, address))
@@ -115,6 +128,16 @@ struct comstack
 #define CS_WANT_WRITE 2
 
 YAZ_EXPORT int cs_look (COMSTACK);
+/** \brief writes segments with cs_put, one at a time
+    \param cs COMSTACK handle
+    \param iov segments
+    \param iovcnt number of segments
+    \returns same as cs_put
+
+    Used by cs_put_iov for a COMSTACK type without f_put_iov.
+*/
+YAZ_EXPORT int cs_put_iov_f_put(COMSTACK cs, const struct cs_iovec *iov,
+                                int iovcnt);
 YAZ_EXPORT const char *cs_strerror(COMSTACK h);
 YAZ_EXPORT const char *cs_errmsg(int n);
 /** \brief returns COMSTACK error and additional information
@@ -136,6 +159,30 @@ YAZ_EXPORT void cs_get_host_args(const char *type_and_host, const char **args);
 YAZ_EXPORT int cs_complete_auto_head(const char *buf, int len);
 /** Returns number of bytes for complete PDU, 0 if incomplete, -1 on protocol error */
 YAZ_EXPORT int cs_complete_auto(const char *buf, int len);
+
+/** \brief state of incremental PDU completeness check
+
+    Offsets are relative to the start of the PDU. The state is valid as
+    long as the buffer checked holds the same (growing) PDU; reset it
+    with cs_complete_reset when a new PDU starts.
+ */
+struct cs_complete_state {
+    int length;   /* total length of PDU if known, 0 if unknown */
+    int resume;   /* HTTP chunk or BER member to check next, 0 if none */
+};
+
+YAZ_EXPORT void cs_complete_reset(struct cs_complete_state *st);
+/** \brief like cs_complete_auto, but resumes where the previous call left
+    \param buf buffer
+    \param len length of buffer
+    \param st state (NULL for a full check)
+    \returns number of bytes for complete PDU, 0 if incomplete, -1 on error
+ */
+YAZ_EXPORT int cs_complete_auto_r(const char *buf, int len,
+                                  struct cs_complete_state *st);
+/** \brief like cs_complete_auto_head, but resumes where the previous call left */
+YAZ_EXPORT int cs_complete_auto_head_r(const char *buf, int len,
+                                       struct cs_complete_state *st);
 YAZ_EXPORT void *cs_get_ssl(COMSTACK cs)
 #ifdef __GNUC__
     __attribute__ ((deprecated))
@@ -151,6 +198,35 @@ YAZ_EXPORT int cs_get_peer_certificate_x509(COMSTACK cs, char **buf, int *len);
 YAZ_EXPORT void cs_set_max_recv_bytes(COMSTACK cs, int max_recv_bytes);
 YAZ_EXPORT void cs_print_session_info(COMSTACK cs);
 
+/** \brief receive buffer pool counters */
+struct cs_buf_stat {
+    long hits;          /* buffers taken from pool */
+    long misses;        /* buffers allocated with xmalloc */
+    long released;      /* buffers given back to pool */
+    long freed;         /* buffers freed (pool full or size not pooled) */
+    long bytes_free;    /* bytes in free buffers held by pool */
+};
+
+/** \brief gets a receive buffer from the shared pool
+    \param size size of buffer in bytes
+    \returns buffer (which may also be freed with xfree)
+
+    Sizes 4096 << n (up to 256K) are pooled; other sizes are allocated
+    with xmalloc.
+ */
+YAZ_EXPORT char *cs_buf_get(int size);
+
+/** \brief gives a receive buffer back to the shared pool
+    \param buf buffer (in); set to NULL (out)
+    \param size size of buffer (in); set to 0 (out)
+ */
+YAZ_EXPORT void cs_buf_release(char **buf, int *size);
+
+/** \brief returns receive buffer pool counters
+    \param st counters (result)
+ */
+YAZ_EXPORT void cs_buf_get_stat(struct cs_buf_stat *st);
+
 YAZ_EXPORT int cs_parse_host(const char *uri, const char **host,
                              CS_TYPE *t, enum oid_proto *proto,
                              char **connect_host);
@@ -175,6 +251,7 @@ YAZ_EXPORT int cs_set_head_only(COMSTACK cs, int head_only);
 #define CS_FLAGS_NUMERICHOST 2
 #define CS_FLAGS_DNS_NO_BLOCK 4
 #define CS_FLAGS_CHECK_CERT 8
+#define CS_FLAGS_REUSEPORT 16
 
 YAZ_END_CDECL
 
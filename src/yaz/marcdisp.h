@@ -119,6 +119,21 @@ YAZ_EXPORT int yaz_marc_decode_buf(yaz_marc_t mt, const char *buf, int bsize,
 YAZ_EXPORT int yaz_marc_decode_wrbuf(yaz_marc_t mt, const char *buf,
                                      int bsize, WRBUF wrbuf);
 
+/** \brief converts ISO2709/MARC buffer and appends result to WRBUF
+    \param mt handle
+    \param buf input buffer
+    \param bsize size of buffer (-1 if "any size")
+    \param wrbuf WRBUF for output
+
+    Like yaz_marc_decode_wrbuf, but for MARCXML, TurboMARC, MARCXchange
+    and JSON output a well-formed record is converted as its directory
+    is read. The record is then not kept in the handle, so use this only
+    if the handle is not inspected afterwards.
+    Returns -1 on error, or size of input record (>0) if OK
+*/
+YAZ_EXPORT int yaz_marc_transcode_wrbuf(yaz_marc_t mt, const char *buf,
+                                        int bsize, WRBUF wrbuf);
+
 YAZ_EXPORT void yaz_marc_subfield_str(yaz_marc_t mt, const char *s);
 YAZ_EXPORT void yaz_marc_endline_str(yaz_marc_t mt, const char *s);
 
@@ -72,6 +72,9 @@ typedef int nmem_bool_t;
 
 /** \brief releases memory associaged with an NMEM handle
     \param n NMEM handle
+
+    The first block of the handle is kept (emptied) for reuse, unless
+    it is a large one.
 */
 YAZ_EXPORT void nmem_reset(NMEM n);
 
@@ -184,11 +187,37 @@ YAZ_EXPORT nmem_bool_t *nmem_booldup(NMEM nmem, nmem_bool_t v);
  */
 YAZ_EXPORT void nmem_transfer(NMEM dst, NMEM src);
 
+/** \brief hands over xmalloc'ed buffer to NMEM handle
+    \param n NMEM handle
+    \param buf buffer allocated with xmalloc
+    \param size size of buf in bytes (at most what was allocated)
+
+    The buffer is released (or recycled) when n is reset or destroyed.
+ */
+YAZ_EXPORT void nmem_adopt(NMEM n, void *buf, size_t size);
+
 /** \brief returns new NMEM handle
     \returns NMEM handle
  */
 YAZ_EXPORT NMEM nmem_create(void);
 
+/** \brief returns new NMEM handle with room for size bytes
+    \param size expected number of bytes to be allocated
+    \returns NMEM handle
+
+    The first block is allocated with room for size bytes (up to 1 MB)
+    so that allocations up to that size need only one block.
+ */
+YAZ_EXPORT NMEM nmem_create_with_hint(size_t size);
+
+/** \brief tells NMEM that size bytes are about to be allocated
+    \param n NMEM handle
+    \param size expected number of bytes to be allocated
+
+    The next block allocated will hold size bytes (up to 1 MB).
+ */
+YAZ_EXPORT void nmem_hint(NMEM n, size_t size);
+
 /** \brief destroys NMEM handle and memory associated with it
     \param n NMEM handle
  */
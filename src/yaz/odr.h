@@ -34,6 +34,7 @@
 #define ODR_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <yaz/yconfig.h>
@@ -144,6 +145,19 @@ typedef struct odr_arm
     char *name;
 } Odr_arm;
 
+/** \brief member of SEQUENCE for odr_sequence_fields */
+typedef struct odr_field
+{
+    int tagmode;     /* ODR_NONE, ODR_IMPLICIT or ODR_EXPLICIT */
+    int zclass;
+    int tag;
+    int opt;         /* OPTIONAL */
+    Odr_fun fun;     /* codec for member (element type if SEQUENCE OF) */
+    int offset;      /* offset of member in structure */
+    int num_offset;  /* offset of count for SEQUENCE OF; -1 otherwise */
+    const char *name;
+} Odr_field;
+
 /*
  * Error control.
  */
@@ -176,6 +190,16 @@ YAZ_EXPORT ODR odr_createmem(int direction);
 YAZ_EXPORT void odr_reset(ODR o);
 YAZ_EXPORT void odr_destroy(ODR o);
 YAZ_EXPORT void odr_setbuf(ODR o, char *buf, int len, int can_grow);
+/** \brief sets decode buffer and hands it over to the stream memory
+    \param o ODR decoding stream
+    \param buf buffer allocated with xmalloc
+    \param len length of buffer
+
+    The buffer is released together with the decoded data, i.e. on
+    odr_reset, odr_destroy or when the memory returned by odr_extract_mem
+    is destroyed. The caller must not free buf.
+*/
+YAZ_EXPORT void odr_setbuf_adopt(ODR o, char *buf, int len);
 YAZ_EXPORT char *odr_getbuf(ODR o, int *len, int *size);
 YAZ_EXPORT void *odr_malloc(ODR o, size_t size);
 YAZ_EXPORT char *odr_strdup(ODR o, const char *str);
@@ -184,6 +208,14 @@ YAZ_EXPORT char *odr_strdup_null(ODR o, const char *str);
 YAZ_EXPORT Odr_int *odr_intdup(ODR o, Odr_int v);
 YAZ_EXPORT Odr_bool *odr_booldup(ODR o, Odr_bool v);
 YAZ_EXPORT Odr_oct *odr_create_Odr_oct(ODR o, const char *buf, int sz);
+/** \brief copies octet string contents to memory handle
+    \param nmem memory handle for the copy
+    \param p octet string, possibly borrowed (odr_set_borrow)
+
+    Afterwards p->buf is NUL-terminated and independent of the
+    decode buffer.
+*/
+YAZ_EXPORT void odr_oct_detach(NMEM nmem, Odr_oct *p);
 YAZ_EXPORT NMEM odr_extract_mem(ODR o);
 YAZ_EXPORT Odr_null *odr_nullval(void);
 #define odr_release_mem(m) nmem_destroy(m)
@@ -228,6 +260,7 @@ YAZ_EXPORT int odr_integer(ODR o, Odr_int **p, int opt, const char *name);
 YAZ_EXPORT int odr_enum(ODR o, Odr_int **p, int opt, const char *name);
 YAZ_EXPORT int odr_implicit_settag(ODR o, int zclass, int tag);
 YAZ_EXPORT int ber_enclen(ODR o, int len, int lenlen, int exact);
+YAZ_EXPORT int ber_lenlen(int len);
 YAZ_EXPORT int ber_declen(const char *buf, int *len, int max);
 YAZ_EXPORT void odr_prname(ODR o, const char *name);
 YAZ_EXPORT int ber_null(ODR o);
@@ -256,10 +289,43 @@ YAZ_EXPORT int odr_cstring(ODR o, char **p, int opt, const char *name);
 YAZ_EXPORT int odr_iconv_string(ODR o, char **p, int opt, const char *name);
 YAZ_EXPORT int odr_sequence_of(ODR o, Odr_fun type, void *p, int *num,
                                const char *name);
+/** \brief codec for SEQUENCE described by a table
+    \param o ODR stream
+    \param p pointer to pointer to structure
+    \param size size of structure
+    \param f members; terminated by entry with fun = 0
+    \param opt whether SEQUENCE is OPTIONAL
+    \param name name of element (or NULL)
+    \retval 0 error
+    \retval 1 OK
+
+    This is used by yaz-asncomp -t instead of one call per member.
+*/
+YAZ_EXPORT int odr_sequence_fields(ODR o, void *p, int size,
+                                   const Odr_field *f, int opt,
+                                   const char *name);
 YAZ_EXPORT int odr_set_of(ODR o, Odr_fun type, void *p, int *num,
                           const char *name);
 YAZ_EXPORT int odr_any(ODR o, Odr_any **p, int opt, const char *name);
 
+/** \brief encodes in two passes with definite lengths
+    \param o ODR encoding stream
+    \param fun codec (e.g. z_APDU)
+    \param p pointer to pointer to data to be encoded
+    \param name name of element (or NULL)
+    \retval 0 encoding error
+    \retval 1 OK
+
+    The first pass computes the length of all constructed types
+    without writing anything. Then the buffer is allocated once and
+    the second pass writes the data with definite minimal lengths,
+    rather than patching lengths (or using indefinite lengths) as the
+    usual single pass encoding does. fun must encode the same way both
+    times.
+*/
+YAZ_EXPORT int odr_encode_sized(ODR o, Odr_fun fun, void *p,
+                                const char *name);
+
 YAZ_EXPORT int ber_any(ODR o, Odr_any **p);
 /** \brief determine whether a buffer is a complete BER buffer
     \param buf BER buffer
@@ -294,6 +360,29 @@ YAZ_EXPORT int odr_seek(ODR o, int whence, int offset);
 YAZ_EXPORT int odr_dumpBER(FILE *f, const char *buf, int len);
 YAZ_EXPORT void odr_choice_bias(ODR o, int what);
 YAZ_EXPORT void odr_choice_enable_bias(ODR o, int mode);
+/** \brief enables/disables lazy decoding of record EXTERNALs
+    \param o ODR decoding stream
+    \param mode 1=lazy, 0=decode everything (default)
+
+    In lazy mode structured records (GRS-1, OPAC, ..) in an EXTERNAL
+    are kept as raw BER (Z_External_single) until z_External_resolve
+    is called for them.
+*/
+YAZ_EXPORT void odr_set_lazy(ODR o, int mode);
+/** \brief returns lazy mode as set by odr_set_lazy */
+YAZ_EXPORT int odr_get_lazy(ODR o);
+/** \brief enables/disables borrowed octet strings on decode
+    \param o ODR decoding stream
+    \param mode 1=borrow, 0=copy (default)
+
+    In borrow mode a decoded OCTET STRING or ANY refers to the decode
+    buffer rather than a NUL-terminated copy. The buffer must outlive the
+    decoded data; odr_setbuf_adopt hands it over to the ODR
+    memory. Use odr_oct_detach for an independent copy.
+*/
+YAZ_EXPORT void odr_set_borrow(ODR o, int mode);
+/** \brief returns borrow mode as set by odr_set_borrow */
+YAZ_EXPORT int odr_get_borrow(ODR o);
 YAZ_EXPORT size_t odr_total(ODR o);
 YAZ_EXPORT char *odr_errmsg(int n);
 YAZ_EXPORT Odr_oid *odr_getoidbystr(ODR o, const char *str);
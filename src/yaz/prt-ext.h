@@ -150,6 +150,13 @@ struct Z_External
 
 /** \brief codec for BER EXTERNAL */
 YAZ_EXPORT int z_External(ODR o, Z_External **p, int opt, const char *name);
+/** \brief decodes EXTERNAL left as raw BER by lazy decoding
+    \param nmem memory for decoded structure
+    \param ext EXTERNAL (modified in place)
+    \retval 1 OK (decoded, or nothing to decode)
+    \retval 0 decoding error (ext unchanged)
+*/
+YAZ_EXPORT int z_External_resolve(NMEM nmem, Z_External *ext);
 /** \brief returns type information for OID (NULL if not known) */
 YAZ_EXPORT Z_ext_typeent *z_ext_getentbyref(const Odr_oid *oid);
 /** \brief encodes EXTERNAL record based on OID (NULL if not known) */
@@ -112,6 +112,15 @@ YAZ_EXPORT int yaz_decode_http_response_first(const char *buf, int sz, int *code
 YAZ_EXPORT int yaz_decode_http_request(ODR o, Z_HTTP_Request **hr_p);
 YAZ_EXPORT int yaz_decode_http_response(ODR o, Z_HTTP_Response **hr_p);
 YAZ_EXPORT int yaz_encode_http_response(ODR o, Z_HTTP_Response *hr);
+/** \brief encodes status line and headers of HTTP response, but no body
+    \param o ODR encoding stream
+    \param hr HTTP response; content_len is used for Content-Length
+    \retval 1 OK
+    \retval 0 failure (no room in buffer)
+
+    hr is not modified. The caller sends the content_len bytes of body.
+*/
+YAZ_EXPORT int yaz_encode_http_response_head(ODR o, Z_HTTP_Response *hr);
 YAZ_EXPORT int yaz_encode_http_request(ODR o, Z_HTTP_Request *hr);
 
 YAZ_EXPORT const char *yaz_check_location(ODR odr, const char *uri,
@@ -55,6 +55,9 @@ typedef struct ZOOM_record_p *ZOOM_record;
 typedef struct ZOOM_facet_field_p *ZOOM_facet_field;
 typedef struct ZOOM_scanset_p *ZOOM_scanset;
 typedef struct ZOOM_package_p *ZOOM_package;
+typedef struct ZOOM_event_set_p *ZOOM_event_set;
+typedef struct ZOOM_connection_pool_p *ZOOM_connection_pool;
+typedef struct ZOOM_multi_p *ZOOM_multi;
 
 typedef const char *(*ZOOM_options_callback)(void *handle, const char *name);
 
@@ -82,6 +85,58 @@ ZOOM_connection_close(ZOOM_connection c);
 ZOOM_API(void)
 ZOOM_connection_destroy(ZOOM_connection c);
 
+/** \brief creates pool of connections that may be shared by threads
+    \param options pool options (may be NULL)
+    \returns connection pool
+
+    Options: max_idle (seconds an idle connection is kept, default 60)
+    and max_per_key (idle connections kept per host/options, default 10).
+*/
+ZOOM_API(ZOOM_connection_pool)
+ZOOM_connection_pool_create(ZOOM_options options);
+
+/** \brief destroys pool and its idle connections
+    \param p connection pool
+*/
+ZOOM_API(void)
+ZOOM_connection_pool_destroy(ZOOM_connection_pool p);
+
+/** \brief gets connected connection from pool
+    \param p connection pool
+    \param options options for connection (may be NULL)
+    \param host host as for ZOOM_connection_connect
+    \param portnum port as for ZOOM_connection_connect
+    \returns connection
+
+    Returns an idle connection for the same host and connect options
+    (user, password, charset, proxy, Init parameters, ..) if there is
+    one; the connection then uses the options given here. Otherwise a
+    new connection is created and connected with ZOOM_connection_create
+    and ZOOM_connection_connect. Errors are checked as for
+    ZOOM_connection_connect.
+*/
+ZOOM_API(ZOOM_connection)
+ZOOM_connection_pool_get(ZOOM_connection_pool p, ZOOM_options options,
+                         const char *host, int portnum);
+
+/** \brief returns connection to pool
+    \param p connection pool
+    \param c connection from ZOOM_connection_pool_get
+
+    The connection is kept for reuse if it is idle, established, has
+    no connection error and no result sets. Otherwise it is destroyed.
+    Cookies and other session state of the caller are cleared.
+    The connection must not be used by the caller afterwards.
+*/
+ZOOM_API(void)
+ZOOM_connection_pool_release(ZOOM_connection_pool p, ZOOM_connection c);
+
+/** \brief returns number of idle connections in pool
+    \param p connection pool
+*/
+ZOOM_API(int)
+ZOOM_connection_pool_idle(ZOOM_connection_pool p);
+
 /* get/set option for connection */
 ZOOM_API(const char *)
 ZOOM_connection_option_get(ZOOM_connection c, const char *key);
@@ -432,6 +487,146 @@ ZOOM_options_set_int(ZOOM_options opt, const char *name, int value);
 ZOOM_API(int)
 ZOOM_event(int no, ZOOM_connection *cs);
 
+/** \brief creates set of connections for ZOOM_event_set_next
+    \returns event set
+
+    Connections are added once and stay registered for socket events
+    (epoll where available). Each call of ZOOM_event_set_next then costs
+    in proportion to the connections that are ready rather than the
+    total.
+*/
+ZOOM_API(ZOOM_event_set)
+ZOOM_event_set_create(void);
+
+/** \brief destroys event set (but not its connections)
+    \param es event set
+*/
+ZOOM_API(void)
+ZOOM_event_set_destroy(ZOOM_event_set es);
+
+/** \brief adds connection to event set
+    \param es event set
+    \param c connection
+    \retval 0 OK
+    \retval -1 connection is already in a set
+
+    A connection that is destroyed is removed from its set.
+*/
+ZOOM_API(int)
+ZOOM_event_set_add(ZOOM_event_set es, ZOOM_connection c);
+
+/** \brief removes connection from event set
+    \param es event set
+    \param c connection
+*/
+ZOOM_API(void)
+ZOOM_event_set_remove(ZOOM_event_set es, ZOOM_connection c);
+
+/** \brief wait for events on connections in set (BLOCKING)
+    \param es event set
+    \param max maximum number of events to return
+    \param cs connection for each event (array of size max)
+    \param events event type for each event (array of size max or NULL)
+    \retval 0 no event was fired and no more events are pending
+    \retval >0 number of events returned
+    \retval -1 poll failure
+
+    Like ZOOM_event, but returns up to max events of all connections that
+    became ready in one wakeup. The same connection may occur more than
+    once. Timeouts are handled for each connection by its "timeout" option.
+*/
+ZOOM_API(int)
+ZOOM_event_set_next(ZOOM_event_set es, int max, ZOOM_connection *cs,
+                    int *events);
+
+/* multi-target search */
+
+/** \brief returns merge key of record for ZOOM_multi_set_key_handler */
+typedef const char *(*ZOOM_multi_key_handler)(void *handle, ZOOM_record rec);
+
+#define ZOOM_MULTI_HITS 1
+#define ZOOM_MULTI_RECORD 2
+#define ZOOM_MULTI_FAILED 3
+
+/** \brief creates multi-target search object
+    \param options options for all targets (may be NULL)
+    \returns multi-target search object
+*/
+ZOOM_API(ZOOM_multi)
+ZOOM_multi_create(ZOOM_options options);
+
+/** \brief destroys multi-target search with its connections and result sets
+    \param m multi-target search
+*/
+ZOOM_API(void)
+ZOOM_multi_destroy(ZOOM_multi m);
+
+/** \brief sets option for all targets
+    \param m multi-target search
+    \param key option name
+    \param val option value
+*/
+ZOOM_API(void)
+ZOOM_multi_option_set(ZOOM_multi m, const char *key, const char *val);
+
+/** \brief sets merge key handler
+    \param m multi-target search
+    \param h handler returning key for record (NULL for no merge)
+    \param handle user data passed to handler
+
+    With a key handler, ZOOM_multi_next returns records in ascending
+    order of keys (strcmp), provided that each target returns its records
+    in that order. Without one, records are returned as they arrive.
+*/
+ZOOM_API(void)
+ZOOM_multi_set_key_handler(ZOOM_multi m, ZOOM_multi_key_handler h,
+                           void *handle);
+
+/** \brief adds target and starts connecting to it
+    \param m multi-target search
+    \param host host as for ZOOM_connection_connect
+    \param options options for this target (may be NULL)
+    \returns target number (0 for first target, 1 for second, ..)
+*/
+ZOOM_API(int)
+ZOOM_multi_add(ZOOM_multi m, const char *host, ZOOM_options options);
+
+/** \brief returns number of targets */
+ZOOM_API(int)
+ZOOM_multi_size(ZOOM_multi m);
+
+/** \brief returns connection of target (for errors and options) */
+ZOOM_API(ZOOM_connection)
+ZOOM_multi_connection(ZOOM_multi m, int target);
+
+/** \brief returns result set of target (NULL before ZOOM_multi_search) */
+ZOOM_API(ZOOM_resultset)
+ZOOM_multi_resultset(ZOOM_multi m, int target);
+
+/** \brief searches all targets
+    \param m multi-target search
+    \param q query
+
+    Options start and count determine the records retrieved from each
+    target. Option deadline is the number of seconds a target may use
+    for the search and retrieval before it fails with ZOOM_ERROR_TIMEOUT.
+*/
+ZOOM_API(void)
+ZOOM_multi_search(ZOOM_multi m, ZOOM_query q);
+
+/** \brief waits for next result of search (BLOCKING)
+    \param m multi-target search
+    \param target target of result
+    \param rec record for ZOOM_MULTI_RECORD (owned by result set)
+    \retval ZOOM_MULTI_HITS hit count of target is known
+    \retval ZOOM_MULTI_RECORD record from target
+    \retval ZOOM_MULTI_FAILED target failed (see ZOOM_connection_error)
+    \retval 0 search complete for all targets
+    \retval -1 poll failure
+*/
+ZOOM_API(int)
+ZOOM_multi_next(ZOOM_multi m, int *target, ZOOM_record *rec);
+
 
 /** \brief determines if connection is idle (no active or pending work)
     \param c connection
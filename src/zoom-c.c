@@ -160,6 +160,7 @@ ZOOM_task ZOOM_connection_add_task(ZOOM_connection c, int which)
     (*taskp)->which = which;
     (*taskp)->next = 0;
     clear_error(c);
+    ZOOM_event_set_touch(c);
     return *taskp;
 }
 
@@ -247,6 +248,9 @@ ZOOM_API(ZOOM_connection)
 
     c->proto = PROTO_Z3950;
     c->cs = 0;
+    c->cs_serial = 0;
+    c->event_entry = 0;
+    c->pool_key = 0;
     ZOOM_connection_set_mask(c, 0);
     c->reconnect_ok = 0;
     c->state = STATE_IDLE;
@@ -282,6 +286,8 @@ ZOOM_API(ZOOM_connection)
     c->preferred_message_size = 0;
 
     c->odr_in = odr_createmem(ODR_DECODE);
+    odr_set_lazy(c->odr_in, 1); /* records decoded by ZOOM_record_get */
+    odr_set_borrow(c->odr_in, 1); /* octets refer to the input buffer */
     c->odr_out = odr_createmem(ODR_ENCODE);
     c->odr_print = 0;
     c->odr_save = 0;
@@ -609,6 +615,7 @@ ZOOM_API(void)
         return;
     yaz_log(c->log_api, "%p ZOOM_connection_destroy", c);
 
+    ZOOM_event_set_unlink(c);
     ZOOM_memcached_destroy(c);
     if (c->cs)
         cs_close(c->cs);
@@ -641,6 +648,7 @@ ZOOM_API(void)
     xfree(c->password);
     xfree(c->sru_version);
     xfree(c->location);
+    xfree(c->pool_key);
     yaz_cookies_destroy(c->cookies);
     wrbuf_destroy(c->saveAPDU_wrbuf);
     xfree(c);
@@ -681,7 +689,6 @@ int resultsets_count(void) {
 
 ZOOM_resultset ZOOM_resultset_create(void)
 {
-    int i;
     ZOOM_resultset r = (ZOOM_resultset) xmalloc(sizeof(*r));
 
     initlog();
@@ -693,8 +700,17 @@ ZOOM_resultset ZOOM_resultset_create(void)
     r->piggyback = 1;
     r->setname = 0;
     r->step = 0;
-    for (i = 0; i<RECORD_HASH_SIZE; i++)
-        r->record_hash[i] = 0;
+    r->record_hash = 0;
+    r->record_hash_size = 0;
+    r->record_hash_num = 0;
+    r->lru_front = r->lru_back = 0;
+    r->record_chunk = 0;
+    r->cache_bytes = 0;
+    r->cache_max_bytes = 0;
+    r->cache_global_max_bytes = 0;
+    r->cache_hits = r->cache_misses = r->cache_evictions = 0;
+    r->prefetch_next = r->prefetch_end = 0;
+    r->prefetch_window = 0;
     r->r_sort_spec = 0;
     r->query = 0;
     r->connection = 0;
@@ -744,6 +760,10 @@ ZOOM_API(ZOOM_resultset)
     ZOOM_query_addref(q);
 
     r->options = ZOOM_options_create_with_parent(c->options);
+    r->cache_max_bytes =
+        ZOOM_options_get_int(r->options, "recordCacheMax", 0);
+    r->cache_global_max_bytes =
+        ZOOM_options_get_int(r->options, "recordCacheGlobalMax", 0);
 
     r->req_facets = odr_strdup_null(r->odr,
                                     ZOOM_options_get(r->options, "facets"));
@@ -918,22 +938,14 @@ int ZOOM_test_reconnect(ZOOM_connection c)
     return 1;
 }
 
-static void ZOOM_resultset_retrieve(ZOOM_resultset r,
-                                    int force_sync, int start, int count)
+static ZOOM_task resultset_retrieve_task(ZOOM_resultset r,
+                                        ZOOM_connection c,
+                                        int start, int count)
 {
     ZOOM_task task;
-    ZOOM_connection c;
     const char *cp;
     const char *syntax, *elementSetName;
 
-    if (!r)
-        return;
-    yaz_log(log_details0, "%p ZOOM_resultset_retrieve force_sync=%d start=%d"
-            " count=%d", r, force_sync, start, count);
-    c = r->connection;
-    if (!c)
-        return;
-
     if (c->host_port && c->proto == PROTO_HTTP)
     {
         if (!c->cs)
@@ -963,12 +975,90 @@ static void ZOOM_resultset_retrieve(ZOOM_resultset r,
     task->u.search.schema = cp ? xstrdup(cp) : 0;
 
     ZOOM_resultset_addref(r);
+    return task;
+}
+
+static void ZOOM_resultset_retrieve(ZOOM_resultset r,
+                                    int force_sync, int start, int count)
+{
+    ZOOM_connection c;
+
+    if (!r)
+        return;
+    yaz_log(log_details0, "%p ZOOM_resultset_retrieve force_sync=%d start=%d"
+            " count=%d", r, force_sync, start, count);
+    c = r->connection;
+    if (!c)
+        return;
+
+    resultset_retrieve_task(r, c, start, count);
 
     if (!r->connection->async || force_sync)
         while (r->connection && ZOOM_event(1, &r->connection))
             ;
 }
 
+/* Adaptive readahead (option prefetch). When records are read in
+ * sequence, the records following them are requested before they are
+ * asked for, and the window doubles for each such request up to
+ * prefetchMax records, or fewer if the average size of cached records
+ * says that the window would exceed preferredMessageSize. The request
+ * is sent right away but not waited for: its response is read by the
+ * next operation on the connection (or by ZOOM_event if async).
+ */
+static void resultset_prefetch(ZOOM_resultset r, size_t start, size_t count)
+{
+    ZOOM_connection c = r->connection;
+    ZOOM_task task;
+    size_t end = start + count;
+    size_t n;
+    int max;
+
+    if (!c || r->live_set != 2 || !ZOOM_options_get_bool(r->options,
+                                                         "prefetch", 0))
+        return;
+    if (start != r->prefetch_next)
+    {   /* random access: no readahead until sequential again */
+        r->prefetch_next = end;
+        r->prefetch_end = 0;
+        r->prefetch_window = 0;
+        return;
+    }
+    r->prefetch_next = end;
+
+    max = ZOOM_options_get_int(r->options, "prefetchMax", 256);
+    if (r->record_hash_num > 0)
+    {
+        size_t avg = r->cache_bytes / r->record_hash_num;
+        if (avg > 0 && c->preferred_message_size / avg < (size_t) max)
+            max = c->preferred_message_size / avg;
+    }
+    if (r->prefetch_window == 0)
+        r->prefetch_window = count > 8 ? count : 8;
+    if (r->prefetch_window > max)
+        r->prefetch_window = max;
+    if (r->prefetch_window <= 0)
+        return;
+
+    if (r->prefetch_end < end)
+        r->prefetch_end = end;
+    if (r->prefetch_end - end > (size_t) r->prefetch_window / 2)
+        return; /* enough requested already */
+    if (r->prefetch_end >= (size_t) r->size)
+        return;
+    n = end + r->prefetch_window - r->prefetch_end;
+    if (r->prefetch_end + n > (size_t) r->size)
+        n = r->size - r->prefetch_end;
+
+    yaz_log(log_details0, "%p resultset_prefetch start=%ld count=%ld",
+            r, (long) r->prefetch_end, (long) n);
+    task = resultset_retrieve_task(r, c, r->prefetch_end, n);
+    r->prefetch_end += n;
+    r->prefetch_window *= 2;
+    if (!c->async && c->tasks == task)
+        ZOOM_connection_exec_task(c);
+}
+
 ZOOM_API(void)
     ZOOM_resultset_records(ZOOM_resultset r, ZOOM_record *recs,
                            size_t start, size_t count)
@@ -987,6 +1077,7 @@ ZOOM_API(void)
         size_t i;
         for (i = 0; i< count; i++)
             recs[i] = ZOOM_resultset_record_immediate(r, i+start);
+        resultset_prefetch(r, start, count);
     }
 }
 
@@ -1080,6 +1171,7 @@ static zoom_ret do_connect_host(ZOOM_connection c, const char *logical_url)
     c->cs = cs_create_host2(logical_url, CS_FLAGS_DNS_NO_BLOCK, &add,
                             c->tproxy ? c->tproxy : c->proxy,
                             &c->proxy_mode);
+    c->cs_serial++;
     if (!c->proxy)
         c->proxy_mode = 0;
 
@@ -1176,6 +1268,8 @@ ZOOM_API(ZOOM_record)
         ZOOM_resultset_retrieve(r, force_sync, pos, 1);
         rec = ZOOM_resultset_record_immediate(r, pos);
     }
+    if (rec)
+        resultset_prefetch(r, pos, 1);
     return rec;
 }
 
@@ -1679,9 +1773,14 @@ static int do_read(ZOOM_connection c)
     {
         Z_GDU *gdu;
         ZOOM_Event event;
+        char *buf;
 
         odr_reset(c->odr_in);
-        odr_setbuf(c->odr_in, c->buf_in, r, 0);
+        /* odr_in takes over the buffer: decoded octets refer to it */
+        buf = c->buf_in;
+        odr_setbuf_adopt(c->odr_in, buf, r);
+        c->buf_in = 0;
+        c->len_in = 0;
         event = ZOOM_Event_create(ZOOM_EVENT_RECV_APDU);
         ZOOM_connection_put_event(c, event);
 
@@ -1703,7 +1802,7 @@ static int do_read(ZOOM_connection c)
                 {
                     FILE *ber_file = yaz_log_file();
                     if (ber_file)
-                        odr_dumpBER(ber_file, c->buf_in, r);
+                        odr_dumpBER(ber_file, buf, r);
                 }
                 ZOOM_connection_close(c);
             }
@@ -1844,6 +1943,8 @@ ZOOM_API(void)
 ZOOM_API(const char *)
     ZOOM_resultset_option_get(ZOOM_resultset r, const char *key)
 {
+    if (!strncmp(key, "recordCache", 11))
+        ZOOM_record_cache_option(r, key);
     return ZOOM_options_get(r->options, key);
 }
 
@@ -2123,6 +2224,7 @@ ZOOM_API(int) ZOOM_connection_get_socket(ZOOM_connection c)
 ZOOM_API(int) ZOOM_connection_set_mask(ZOOM_connection c, int mask)
 {
     c->mask = mask;
+    ZOOM_event_set_touch(c);
     if (!c->cs)
         return -1;
     return 0;
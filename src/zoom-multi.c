@@ -0,0 +1,442 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file zoom-multi.c
+ * \brief Implements ZOOM C multi-target search.
+ *
+ * A ZOOM_multi holds one asynchronous connection per target, all in one
+ * event set. ZOOM_multi_search queues the search on every connection
+ * and ZOOM_multi_next then reports hit counts, failures and records as
+ * they become available. With a key handler, records are merged: each
+ * target delivers records in its own order, so a record is returned
+ * when its key is less than the key of the next record of every other
+ * target (or that target has no more records).
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "zoom-p.h"
+
+#include <yaz/log.h>
+#include <yaz/xmalloc.h>
+#include <yaz/gettimeofday.h>
+
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#define MULTI_MAX_EVENTS 32
+
+struct ZOOM_multi_target {
+    ZOOM_connection c;
+    ZOOM_resultset r;
+    size_t next;          /* position of next record to return */
+    size_t limit;         /* start + count, bounded by hits */
+    int hits_known;
+    int done;             /* no more records will arrive */
+    int failed;
+    double deadline;      /* 0 for none */
+    WRBUF key;            /* merge key of record at next */
+    int key_valid;
+};
+
+struct ZOOM_multi_event {
+    int type;
+    int target;
+    struct ZOOM_multi_event *next;
+};
+
+struct ZOOM_multi_p {
+    ZOOM_options options;
+    ZOOM_event_set es;
+    struct ZOOM_multi_target *targets;
+    int num_targets;
+    int max_targets;
+    ZOOM_multi_key_handler key_handler;
+    void *key_handle;
+    struct ZOOM_multi_event *ev_front;
+    struct ZOOM_multi_event *ev_back;
+    int rr;               /* next target for unmerged records */
+};
+
+static double multi_now(void)
+{
+    struct timeval tv;
+
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void event_put(ZOOM_multi m, int type, int target)
+{
+    struct ZOOM_multi_event *ev = (struct ZOOM_multi_event *)
+        xmalloc(sizeof(*ev));
+
+    ev->type = type;
+    ev->target = target;
+    ev->next = 0;
+    if (m->ev_back)
+        m->ev_back->next = ev;
+    else
+        m->ev_front = ev;
+    m->ev_back = ev;
+}
+
+static int event_get(ZOOM_multi m, int *target)
+{
+    struct ZOOM_multi_event *ev = m->ev_front;
+    int type;
+
+    if (!ev)
+        return 0;
+    m->ev_front = ev->next;
+    if (!m->ev_front)
+        m->ev_back = 0;
+    type = ev->type;
+    *target = ev->target;
+    xfree(ev);
+    return type;
+}
+
+ZOOM_API(ZOOM_multi)
+    ZOOM_multi_create(ZOOM_options options)
+{
+    ZOOM_multi m = (ZOOM_multi) xmalloc(sizeof(*m));
+
+    m->options = ZOOM_options_create_with_parent(options);
+    m->es = ZOOM_event_set_create();
+    m->num_targets = 0;
+    m->max_targets = 0;
+    m->targets = 0;
+    m->key_handler = 0;
+    m->key_handle = 0;
+    m->ev_front = m->ev_back = 0;
+    m->rr = 0;
+    return m;
+}
+
+ZOOM_API(void)
+    ZOOM_multi_destroy(ZOOM_multi m)
+{
+    int i, target;
+
+    if (!m)
+        return;
+    while (event_get(m, &target))
+        ;
+    for (i = 0; i < m->num_targets; i++)
+    {
+        struct ZOOM_multi_target *t = m->targets + i;
+        ZOOM_resultset_destroy(t->r);
+        ZOOM_connection_destroy(t->c);
+        wrbuf_destroy(t->key);
+    }
+    xfree(m->targets);
+    ZOOM_event_set_destroy(m->es);
+    ZOOM_options_destroy(m->options);
+    xfree(m);
+}
+
+ZOOM_API(void)
+    ZOOM_multi_option_set(ZOOM_multi m, const char *key, const char *val)
+{
+    ZOOM_options_set(m->options, key, val);
+}
+
+ZOOM_API(void)
+    ZOOM_multi_set_key_handler(ZOOM_multi m, ZOOM_multi_key_handler h,
+                               void *handle)
+{
+    m->key_handler = h;
+    m->key_handle = handle;
+}
+
+ZOOM_API(int)
+    ZOOM_multi_add(ZOOM_multi m, const char *host, ZOOM_options options)
+{
+    struct ZOOM_multi_target *t;
+    ZOOM_options o;
+
+    if (m->num_targets == m->max_targets)
+    {
+        m->max_targets = m->max_targets ? 2 * m->max_targets : 8;
+        m->targets = (struct ZOOM_multi_target *)
+            xrealloc(m->targets, m->max_targets * sizeof(*m->targets));
+    }
+    t = m->targets + m->num_targets;
+    /* options of target override those of multi */
+    o = ZOOM_options_create_with_parent2(options, m->options);
+    t->c = ZOOM_connection_create(o);
+    ZOOM_options_destroy(o);
+    ZOOM_connection_option_set(t->c, "async", "1");
+    t->r = 0;
+    t->next = t->limit = 0;
+    t->hits_known = 0;
+    t->done = 1;
+    t->failed = 0;
+    t->deadline = 0.0;
+    t->key = wrbuf_alloc();
+    t->key_valid = 0;
+    ZOOM_connection_connect(t->c, host, 0);
+    ZOOM_event_set_add(m->es, t->c);
+    return m->num_targets++;
+}
+
+ZOOM_API(int)
+    ZOOM_multi_size(ZOOM_multi m)
+{
+    return m->num_targets;
+}
+
+ZOOM_API(ZOOM_connection)
+    ZOOM_multi_connection(ZOOM_multi m, int target)
+{
+    if (target < 0 || target >= m->num_targets)
+        return 0;
+    return m->targets[target].c;
+}
+
+ZOOM_API(ZOOM_resultset)
+    ZOOM_multi_resultset(ZOOM_multi m, int target)
+{
+    if (target < 0 || target >= m->num_targets)
+        return 0;
+    return m->targets[target].r;
+}
+
+ZOOM_API(void)
+    ZOOM_multi_search(ZOOM_multi m, ZOOM_query q)
+{
+    double now = multi_now();
+    int i, target;
+
+    while (event_get(m, &target))
+        ;
+    m->rr = 0;
+    for (i = 0; i < m->num_targets; i++)
+    {
+        struct ZOOM_multi_target *t = m->targets + i;
+        const char *deadline;
+
+        ZOOM_resultset_destroy(t->r);
+        if (!t->c->cs && !t->c->tasks)  /* failed or timed out */
+            ZOOM_connection_connect(t->c, 0, 0);
+        if (!t->c->event_entry)
+            ZOOM_event_set_add(m->es, t->c);
+        t->r = ZOOM_connection_search(t->c, q);
+        t->next = ZOOM_options_get_int(t->r->options, "start", 0);
+        t->limit = t->next + ZOOM_options_get_int(t->r->options, "count", 0);
+        t->hits_known = 0;
+        t->done = 0;
+        t->failed = 0;
+        t->key_valid = 0;
+        deadline = ZOOM_connection_option_get(t->c, "deadline");
+        t->deadline = (deadline && *deadline) ? now + atof(deadline) : 0.0;
+    }
+}
+
+static void target_fail(ZOOM_multi m, int i)
+{
+    struct ZOOM_multi_target *t = m->targets + i;
+
+    t->done = 1;
+    t->failed = 1;
+    event_put(m, ZOOM_MULTI_FAILED, i);
+}
+
+static void expire_deadlines(ZOOM_multi m, double now, int *msec)
+{
+    int i;
+
+    *msec = -1;
+    for (i = 0; i < m->num_targets; i++)
+    {
+        struct ZOOM_multi_target *t = m->targets + i;
+
+        if (t->done || t->deadline == 0.0)
+            continue;
+        if (t->deadline <= now)
+        {
+            yaz_log(t->c->log_details, "%p ZOOM_multi deadline", t->c);
+            ZOOM_event_set_remove(m->es, t->c);
+            ZOOM_connection_close(t->c);
+            ZOOM_set_error(t->c, ZOOM_ERROR_TIMEOUT, "deadline");
+            ZOOM_connection_remove_tasks(t->c);
+            ZOOM_connection_remove_events(t->c);
+            target_fail(m, i);
+        }
+        else
+        {
+            int left = (int) ((t->deadline - now) * 1000.0) + 1;
+            if (*msec < 0 || left < *msec)
+                *msec = left;
+        }
+    }
+}
+
+static void handle_event(ZOOM_multi m, ZOOM_connection c, int event)
+{
+    int i;
+    struct ZOOM_multi_target *t;
+
+    for (i = 0; i < m->num_targets; i++)
+        if (m->targets[i].c == c)
+            break;
+    if (i == m->num_targets)
+        return;
+    t = m->targets + i;
+    if (t->done || !t->r)
+        return;
+    switch (event)
+    {
+    case ZOOM_EVENT_RECV_SEARCH:
+        if (!t->hits_known)
+        {
+            size_t size = ZOOM_resultset_size(t->r);
+            t->hits_known = 1;
+            if (t->limit > size)
+                t->limit = size;
+            event_put(m, ZOOM_MULTI_HITS, i);
+        }
+        break;
+    case ZOOM_EVENT_END:
+        if (ZOOM_connection_errcode(c))
+            target_fail(m, i);
+        else
+        {
+            t->done = 1;
+            if (!t->hits_known)
+            {
+                t->hits_known = 1;
+                event_put(m, ZOOM_MULTI_HITS, i);
+            }
+        }
+        break;
+    }
+}
+
+static ZOOM_record target_head(struct ZOOM_multi_target *t)
+{
+    if (!t->r)
+        return 0;
+    while (t->next < t->limit)
+    {
+        ZOOM_record rec = ZOOM_resultset_record_immediate(t->r, t->next);
+        if (rec || !t->done)
+            return rec;
+        /* target is done and record is missing (evicted from cache,
+           say): it will not arrive, so go on with the next one */
+        t->next++;
+        t->key_valid = 0;
+    }
+    return 0;
+}
+
+/* returns 1 if a record could be returned, 0 if must wait */
+static int multi_emit(ZOOM_multi m, int *target, ZOOM_record *recp,
+                      int *exhausted)
+{
+    int i, best = -1;
+    ZOOM_record best_rec = 0;
+
+    *exhausted = 1;
+    for (i = 0; i < m->num_targets; i++)
+    {
+        int j = m->key_handler ? i : (m->rr + i) % m->num_targets;
+        struct ZOOM_multi_target *t = m->targets + j;
+        ZOOM_record rec = target_head(t);
+
+        if (!rec)
+        {
+            if (t->r && !t->done && t->next < t->limit)
+            {
+                *exhausted = 0;
+                if (m->key_handler)
+                    return 0; /* target may deliver a lesser key */
+            }
+            continue;
+        }
+        *exhausted = 0;
+        if (!m->key_handler)
+        {
+            best = j;
+            best_rec = rec;
+            m->rr = j + 1;
+            break;
+        }
+        if (!t->key_valid)
+        {
+            const char *key = m->key_handler(m->key_handle, rec);
+            wrbuf_rewind(t->key);
+            wrbuf_puts(t->key, key ? key : "");
+            t->key_valid = 1;
+        }
+        if (best == -1 ||
+            strcmp(wrbuf_cstr(t->key), wrbuf_cstr(m->targets[best].key)) < 0)
+        {
+            best = j;
+            best_rec = rec;
+        }
+    }
+    if (best == -1)
+        return 0;
+    m->targets[best].next++;
+    m->targets[best].key_valid = 0;
+    *target = best;
+    *recp = best_rec;
+    return 1;
+}
+
+ZOOM_API(int)
+    ZOOM_multi_next(ZOOM_multi m, int *target, ZOOM_record *recp)
+{
+    ZOOM_connection cs[MULTI_MAX_EVENTS];
+    int events[MULTI_MAX_EVENTS];
+
+    if (recp)
+        *recp = 0;
+    while (1)
+    {
+        ZOOM_record rec;
+        int i, n, type, msec, exhausted;
+
+        type = event_get(m, target);
+        if (type)
+            return type;
+        expire_deadlines(m, multi_now(), &msec);
+        if (m->ev_front)
+            continue;
+        if (multi_emit(m, target, &rec, &exhausted))
+        {
+            if (recp)
+                *recp = rec;
+            return ZOOM_MULTI_RECORD;
+        }
+        if (exhausted)
+            return 0;
+        n = ZOOM_event_set_wait(m->es, MULTI_MAX_EVENTS, cs, events, msec);
+        if (n == -1)
+            return -1;
+        if (n == 0)
+        {   /* nothing pending on any connection */
+            for (i = 0; i < m->num_targets; i++)
+                m->targets[i].done = 1;
+        }
+        for (i = 0; i < n; i++)
+            handle_event(m, cs[i], events[i]);
+    }
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -16,11 +16,17 @@
 #include <yaz/xmalloc.h>
 #include <yaz/snprintf.h>
 
+#define OPTIONS_HASH_SIZE 31
+
 struct ZOOM_options_entry {
     char *name;
+    unsigned hash;            /* of `name' */
     char *value;
     int len;                  /* of `value', which may contain NULs */
-    struct ZOOM_options_entry *next;
+    int int_value;            /* `value' parsed when set */
+    int bool_value;
+    struct ZOOM_options_entry *next;       /* in order of creation */
+    struct ZOOM_options_entry *hash_next;  /* in hash bucket */
 };
 
 struct ZOOM_options_p {
@@ -28,31 +34,94 @@ struct ZOOM_options_p {
     void *callback_handle;
     ZOOM_options_callback callback_func;
     struct ZOOM_options_entry *entries;
+    struct ZOOM_options_entry *hash[OPTIONS_HASH_SIZE];
     ZOOM_options parent1;
     ZOOM_options parent2;
 };
 
+static unsigned options_hash(const char *name)
+{
+    unsigned h = 0;
+
+    while (*name)
+        h = h * 65599 + (unsigned char) *name++;
+    return h;
+}
+
+static int bool_value(const char *v)
+{
+    if (!strcmp(v, "1") || !strcmp(v, "T"))
+        return 1;
+    return 0;
+}
+
 static void set_value(struct ZOOM_options_entry **e,
                       const char *value, int len)
 {
     (*e)->value = 0;
     (*e)->len = 0;
+    (*e)->int_value = 0;
+    (*e)->bool_value = 0;
     if (value)
     {
         (*e)->value = (char *) xmalloc(len+1);
         memcpy((*e)->value, value, len);
         (*e)->value[len] = '\0';
         (*e)->len = len;
+        (*e)->int_value = atoi((*e)->value);
+        (*e)->bool_value = bool_value((*e)->value);
     }
 }
 
-static void append_entry(struct ZOOM_options_entry **e,
-                         const char *name, const char *value, int len)
+static void append_entry(ZOOM_options opt, struct ZOOM_options_entry **e,
+                         const char *name, unsigned h,
+                         const char *value, int len)
 {
+    struct ZOOM_options_entry **bucket = &opt->hash[h % OPTIONS_HASH_SIZE];
+
     *e = (struct ZOOM_options_entry *) xmalloc(sizeof(**e));
     (*e)->name = xstrdup(name);
+    (*e)->hash = h;
     set_value(e, value, len);
     (*e)->next = 0;
+    (*e)->hash_next = *bucket;
+    *bucket = *e;
+}
+
+static struct ZOOM_options_entry *lookup_entry(ZOOM_options opt,
+                                               const char *name, unsigned h)
+{
+    struct ZOOM_options_entry *e = opt->hash[h % OPTIONS_HASH_SIZE];
+
+    for (; e; e = e->hash_next)
+        if (e->hash == h && !strcmp(e->name, name))
+            break;
+    return e;
+}
+
+/* looks up name through parents. Returns entry or callback value in *cv */
+static struct ZOOM_options_entry *find_entry(ZOOM_options opt,
+                                             const char *name, unsigned h,
+                                             const char **cv)
+{
+    struct ZOOM_options_entry *e;
+
+    if (!opt)
+        return 0;
+    if (opt->callback_func)
+    {
+        *cv = (*opt->callback_func)(opt->callback_handle, name);
+        if (*cv)
+            return 0;
+    }
+    e = lookup_entry(opt, name, h);
+    if (!e || !e->value)
+    {
+        e = find_entry(opt->parent1, name, h, cv);
+        if ((!e || !e->value) && !*cv)
+            e = find_entry(opt->parent2, name, h, cv);
+    }
+    return e;
 }
 
 ZOOM_API(ZOOM_options)
@@ -68,7 +137,8 @@ ZOOM_API(ZOOM_options)
 
         while(src_e)
         {
-            append_entry(dst_e, src_e->name, src_e->value, src_e->len);
+            append_entry(dst, dst_e, src_e->name, src_e->hash,
+                         src_e->value, src_e->len);
             dst_e = &(*dst_e)->next;
             src_e = src_e->next;
         }
@@ -96,11 +166,14 @@ ZOOM_API(ZOOM_options)
                                      ZOOM_options parent2)
 {
     ZOOM_options opt = (ZOOM_options) xmalloc(sizeof(*opt));
+    int i;
 
     opt->refcount = 1;
     opt->callback_func = 0;
     opt->callback_handle = 0;
     opt->entries = 0;
+    for (i = 0; i < OPTIONS_HASH_SIZE; i++)
+        opt->hash[i] = 0;
     opt->parent1= parent1;
     if (parent1)
         (parent1->refcount)++;
@@ -162,19 +235,19 @@ ZOOM_API(void)
                       int len)
 {
     struct ZOOM_options_entry **e;
+    unsigned h = options_hash(name);
+    struct ZOOM_options_entry *f = lookup_entry(opt, name, h);
 
+    if (f)
+    {
+        xfree(f->value);
+        set_value(&f, value, len);
+        return;
+    }
     e = &opt->entries;
     while (*e)
-    {
-        if (!strcmp((*e)->name, name))
-        {
-            xfree((*e)->value);
-            set_value(e, value, len);
-            return;
-        }
         e = &(*e)->next;
-    }
-    append_entry(e, name, value, len);
+    append_entry(opt, e, name, h, value, len);
 }
 
 ZOOM_API(void)
@@ -187,29 +260,15 @@ ZOOM_API(const char *)
     ZOOM_options_getl(ZOOM_options opt, const char *name, int *lenp)
 {
     const char *v = 0;
-    if (!opt)
-        return 0;
-    if (opt->callback_func)
-    {
-        v = (*opt->callback_func)(opt->callback_handle, name);
-        if (v)
-            *lenp = strlen(v);
-    }
-    if (!v)
+    struct ZOOM_options_entry *e = find_entry(opt, name, options_hash(name),
+                                              &v);
+    if (v)
+        *lenp = strlen(v);
+    else if (e && e->value)
     {
-        struct ZOOM_options_entry *e;
-        for (e = opt->entries; e; e = e->next)
-            if (!strcmp(e->name, name))
-            {
-                v = e->value;
-                *lenp = e->len;
-                break;
-            }
+        v = e->value;
+        *lenp = e->len;
     }
-    if (!v)
-        v = ZOOM_options_getl(opt->parent1, name, lenp);
-    if (!v)
-        v = ZOOM_options_getl(opt->parent2, name, lenp);
     return v;
 }
 
@@ -223,23 +282,27 @@ ZOOM_API(const char *)
 ZOOM_API(int)
     ZOOM_options_get_bool(ZOOM_options opt, const char *name, int defa)
 {
-    const char *v = ZOOM_options_get(opt, name);
-
-    if (!v)
+    const char *v = 0;
+    struct ZOOM_options_entry *e = find_entry(opt, name, options_hash(name),
+                                              &v);
+    if (v)
+        return bool_value(v);
+    if (!e || !e->value)
         return defa;
-    if (!strcmp(v, "1") || !strcmp(v, "T"))
-        return 1;
-    return 0;
+    return e->bool_value;
 }
 
 ZOOM_API(int)
     ZOOM_options_get_int(ZOOM_options opt, const char *name, int defa)
 {
-    const char *v = ZOOM_options_get(opt, name);
-
-    if (!v || !*v)
+    const char *v = 0;
+    struct ZOOM_options_entry *e = find_entry(opt, name, options_hash(name),
+                                              &v);
+    if (v)
+        return *v ? atoi(v) : defa;
+    if (!e || !e->value || !*e->value)
         return defa;
-    return atoi(v);
+    return e->int_value;
 }
 
 ZOOM_API(void)
@@ -65,6 +65,7 @@ typedef struct ZOOM_task_p *ZOOM_task;
 struct ZOOM_connection_p {
     enum oid_proto proto;
     COMSTACK cs;
+    int cs_serial;    /* changes whenever a new cs is created */
     char *host_port;
     int error;
     char *addinfo;
@@ -124,11 +125,12 @@ struct ZOOM_connection_p {
 #endif
     int expire_search;
     int expire_record;
+    struct ZOOM_event_set_entry *event_entry; /* ZOOM_event_set_add */
+    char *pool_key; /* ZOOM_connection_pool_get */
 };
 
 typedef struct ZOOM_record_cache_p *ZOOM_record_cache;
-
-#define RECORD_HASH_SIZE  131
+typedef struct ZOOM_record_chunk_p *ZOOM_record_chunk;
 
 struct ZOOM_resultset_p {
     Z_SortKeySpecList *r_sort_spec;
@@ -139,7 +141,21 @@ struct ZOOM_resultset_p {
     int piggyback;
     char *setname;
     ODR odr;
-    ZOOM_record_cache record_hash[RECORD_HASH_SIZE];
+    ZOOM_record_cache *record_hash;
+    int record_hash_size;     /* number of buckets, power of 2 (or 0) */
+    int record_hash_num;      /* number of cached records */
+    ZOOM_record_cache lru_front; /* least recently used record */
+    ZOOM_record_cache lru_back;
+    ZOOM_record_chunk record_chunk; /* response being cached */
+    size_t cache_bytes;
+    size_t cache_max_bytes;   /* recordCacheMax; 0 for unlimited */
+    size_t cache_global_max_bytes; /* recordCacheGlobalMax */
+    int cache_hits;
+    int cache_misses;
+    int cache_evictions;
+    size_t prefetch_next;     /* position following last read */
+    size_t prefetch_end;      /* end of records requested in advance */
+    int prefetch_window;
     ZOOM_options options;
     ZOOM_connection connection;
     char **databaseNames;
@@ -236,6 +252,10 @@ void ZOOM_set_error(ZOOM_connection c, int error, const char *addinfo);
 
 ZOOM_Event ZOOM_Event_create(int kind);
 void ZOOM_connection_put_event(ZOOM_connection c, ZOOM_Event event);
+void ZOOM_event_set_touch(ZOOM_connection c);
+void ZOOM_event_set_unlink(ZOOM_connection c);
+int ZOOM_event_set_wait(ZOOM_event_set es, int max, ZOOM_connection *cs,
+                        int *events, int max_msec);
 
 zoom_ret ZOOM_connection_Z3950_search(ZOOM_connection c);
 zoom_ret ZOOM_connection_Z3950_send_scan(ZOOM_connection c);
@@ -259,6 +279,9 @@ void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
                            const char *syntax, const char *elementSetName,
                            const char *schema,
                            Z_SRW_diagnostic *diag);
+void ZOOM_record_cache_chunk_begin(ZOOM_resultset r);
+void ZOOM_record_cache_chunk_end(ZOOM_resultset r, NMEM nmem);
+void ZOOM_record_cache_option(ZOOM_resultset r, const char *key);
 
 Z_Query *ZOOM_query_get_Z_Query(ZOOM_query s);
 Z_SortKeySpecList *ZOOM_query_get_sortspec(ZOOM_query s);
@@ -0,0 +1,384 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file zoom-pool.c
+ * \brief Implements ZOOM C connection pool.
+ *
+ * Idle connections are kept in a hash on a key made of the host string
+ * and the options that are used when connecting (authentication, charset,
+ * proxy, Init parameters ..), whether given as options or as name=value,
+ * prefixes of the host string. The same idle connections are also on a
+ * list in the order they were released, so that expired ones are found
+ * at the front. All pool operations are protected by a mutex; a
+ * connection is only used by the thread that got it from the pool.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include "zoom-p.h"
+
+#include <yaz/log.h>
+#include <yaz/xmalloc.h>
+#include <yaz/poll.h>
+
+#define POOL_HASH_SIZE 61
+
+struct ZOOM_pool_entry {
+    ZOOM_connection c;
+    unsigned hash;
+    time_t released;
+    struct ZOOM_pool_entry *key_next;  /* same bucket, most recent first */
+    struct ZOOM_pool_entry *key_prev;
+    struct ZOOM_pool_entry *age_next;  /* all idle, oldest first */
+    struct ZOOM_pool_entry *age_prev;
+};
+
+struct ZOOM_connection_pool_p {
+    YAZ_MUTEX mutex;
+    int max_idle;
+    int max_per_key;
+    struct ZOOM_pool_entry *buckets[POOL_HASH_SIZE];
+    struct ZOOM_pool_entry *age_front;
+    struct ZOOM_pool_entry *age_back;
+    int num_idle;
+};
+
+/* options read by ZOOM_connection_connect and the Init request */
+static const char *key_options[] = {
+    "proxy", "tproxy", "charset", "lang", "sru", "sru_version",
+    "cookie", "clientIP", "group", "user", "password", "pass",
+    "authenticationMode", "maximumRecordSize", "preferredMessageSize",
+    "implementationId", "implementationName", "implementationVersion",
+    "cert_fname", "memcached", "redis", 0
+};
+
+/* sets options of the name=value, prefixes of host string, as
+   ZOOM_connection_connect does. Returns rest of host string (xmalloc'ed) */
+static char *host_options(ZOOM_options options, const char *host)
+{
+    char *buf = xstrdup(host ? host : "");
+    char *remainder = buf;
+    char *pcolon = strchr(remainder, ':');
+    char *pcomma;
+    char *pequals;
+
+    while ((pcomma = strchr(remainder, ',')) != 0 &&
+           (pcolon == 0 || pcomma < pcolon))
+    {
+        *pcomma = '\0';
+        if ((pequals = strchr(remainder, '=')) != 0)
+        {
+            *pequals = '\0';
+            ZOOM_options_set(options, remainder, pequals + 1);
+        }
+        remainder = pcomma + 1;
+    }
+    remainder = xstrdup(remainder);
+    xfree(buf);
+    return remainder;
+}
+
+/* options of host string take precedence over options */
+static char *pool_key(ZOOM_options options, ZOOM_options host_opts,
+                      const char *host, int portnum)
+{
+    WRBUF w = wrbuf_alloc();
+    char *key;
+    int i;
+
+    wrbuf_puts(w, host);
+    if (portnum)
+        wrbuf_printf(w, ":%d", portnum);
+    for (i = 0; key_options[i]; i++)
+    {
+        const char *v = ZOOM_options_get(host_opts, key_options[i]);
+        if (!v)
+            v = ZOOM_options_get(options, key_options[i]);
+        if (v)
+            wrbuf_printf(w, "\n%s=%s", key_options[i], v);
+    }
+    key = xstrdup(wrbuf_cstr(w));
+    wrbuf_destroy(w);
+    return key;
+}
+
+static unsigned pool_hash(const char *key)
+{
+    unsigned h = 0;
+    while (*key)
+        h = h * 65599 + (unsigned char) *key++;
+    return h;
+}
+
+static void entry_unlink(ZOOM_connection_pool p, struct ZOOM_pool_entry *e)
+{
+    if (e->key_prev)
+        e->key_prev->key_next = e->key_next;
+    else
+        p->buckets[e->hash % POOL_HASH_SIZE] = e->key_next;
+    if (e->key_next)
+        e->key_next->key_prev = e->key_prev;
+
+    if (e->age_prev)
+        e->age_prev->age_next = e->age_next;
+    else
+        p->age_front = e->age_next;
+    if (e->age_next)
+        e->age_next->age_prev = e->age_prev;
+    else
+        p->age_back = e->age_prev;
+    p->num_idle--;
+}
+
+/* moves expired entries to list *expired (linked by age_next) */
+static void pool_expire(ZOOM_connection_pool p, time_t now,
+                        struct ZOOM_pool_entry **expired)
+{
+    struct ZOOM_pool_entry *e;
+
+    while ((e = p->age_front) && now - e->released >= p->max_idle)
+    {
+        entry_unlink(p, e);
+        e->age_next = *expired;
+        *expired = e;
+    }
+}
+
+static void destroy_entries(struct ZOOM_pool_entry *e)
+{
+    while (e)
+    {
+        struct ZOOM_pool_entry *e_next = e->age_next;
+        yaz_log(e->c->log_details, "%p ZOOM_connection_pool evict", e->c);
+        ZOOM_connection_destroy(e->c);
+        xfree(e);
+        e = e_next;
+    }
+}
+
+/* idle connection still usable: no data (or EOF) from server */
+static int connection_alive(ZOOM_connection c)
+{
+    struct yaz_poll_fd fd;
+
+    if (!c->cs || c->state != STATE_ESTABLISHED)
+        return 0;
+    fd.fd = cs_fileno(c->cs);
+    fd.input_mask = yaz_poll_read;
+    fd.client_data = 0;
+    if (yaz_poll(&fd, 1, 0, 0) != 0)
+        return 0;
+    return 1;
+}
+
+/* connection may go back to pool: finished and no connection error */
+static int connection_reusable(ZOOM_connection c)
+{
+    if (!c->pool_key || c->tasks || c->resultsets)
+        return 0;
+    if (!c->cs || c->state != STATE_ESTABLISHED)
+        return 0;
+    if (c->error && c->diagset && !strcmp(c->diagset, "ZOOM"))
+        return 0;
+    return 1;
+}
+
+/* forgets what the session of the releasing user left on connection */
+static void connection_reset_session(ZOOM_connection c)
+{
+    yaz_cookies_destroy(c->cookies);
+    c->cookies = yaz_cookies_create();
+    xfree(c->location);
+    c->location = 0;
+    c->no_redirects = 0;
+    ZOOM_connection_option_set(c, "saveAPDU", 0);
+    ZOOM_connection_remove_events(c);
+    ZOOM_set_error(c, ZOOM_ERROR_NONE, 0);
+    c->last_event = ZOOM_EVENT_NONE;
+}
+
+ZOOM_API(ZOOM_connection_pool)
+    ZOOM_connection_pool_create(ZOOM_options options)
+{
+    ZOOM_connection_pool p = (ZOOM_connection_pool) xmalloc(sizeof(*p));
+    int i;
+
+    p->mutex = 0;
+    yaz_mutex_create(&p->mutex);
+    p->max_idle = ZOOM_options_get_int(options, "max_idle", 60);
+    p->max_per_key = ZOOM_options_get_int(options, "max_per_key", 10);
+    for (i = 0; i < POOL_HASH_SIZE; i++)
+        p->buckets[i] = 0;
+    p->age_front = p->age_back = 0;
+    p->num_idle = 0;
+    return p;
+}
+
+ZOOM_API(void)
+    ZOOM_connection_pool_destroy(ZOOM_connection_pool p)
+{
+    if (!p)
+        return;
+    destroy_entries(p->age_front);
+    yaz_mutex_destroy(&p->mutex);
+    xfree(p);
+}
+
+ZOOM_API(ZOOM_connection)
+    ZOOM_connection_pool_get(ZOOM_connection_pool p, ZOOM_options options,
+                             const char *host, int portnum)
+{
+    ZOOM_options host_opts = ZOOM_options_create();
+    char *rest = host_options(host_opts, host);
+    char *key = pool_key(options, host_opts, rest, portnum);
+    unsigned h = pool_hash(key);
+    struct ZOOM_pool_entry *expired = 0;
+    struct ZOOM_pool_entry *e;
+    ZOOM_connection c = 0;
+
+    xfree(rest);
+    yaz_mutex_enter(p->mutex);
+    pool_expire(p, time(0), &expired);
+    e = p->buckets[h % POOL_HASH_SIZE];
+    while (e)
+    {
+        struct ZOOM_pool_entry *e_next = e->key_next;
+        if (e->hash == h && !strcmp(e->c->pool_key, key))
+        {
+            entry_unlink(p, e);
+            if (connection_alive(e->c))
+            {
+                c = e->c;
+                xfree(e);
+                break;
+            }
+            e->age_next = expired;
+            expired = e;
+        }
+        e = e_next;
+    }
+    yaz_mutex_leave(p->mutex);
+    destroy_entries(expired);
+
+    if (c)
+    {
+        yaz_log(c->log_api, "%p ZOOM_connection_pool_get reuse host=%s",
+                c, c->host_port);
+        xfree(key);
+        /* options of this user and those of the host string, which
+           ZOOM_connection_connect would set; connection level settings
+           are kept */
+        ZOOM_options_destroy(c->options);
+        c->options = ZOOM_options_create_with_parent2(host_opts, options);
+        ZOOM_options_set(c->options, "host", c->host_port);
+        c->async = ZOOM_options_get_bool(c->options, "async", 0);
+        ZOOM_set_error(c, ZOOM_ERROR_NONE, 0);
+        /* server may have closed it since: reconnect on first use */
+        c->reconnect_ok = 1;
+    }
+    else
+    {
+        c = ZOOM_connection_create(options);
+        c->pool_key = key;
+        yaz_log(c->log_api, "%p ZOOM_connection_pool_get new host=%s",
+                c, host ? host : "null");
+        ZOOM_connection_connect(c, host, portnum);
+    }
+    ZOOM_options_destroy(host_opts);
+    return c;
+}
+
+ZOOM_API(void)
+    ZOOM_connection_pool_release(ZOOM_connection_pool p, ZOOM_connection c)
+{
+    struct ZOOM_pool_entry *expired = 0;
+    struct ZOOM_pool_entry *e, **bucket;
+    time_t now = time(0);
+    int n = 0;
+
+    if (!c)
+        return;
+    ZOOM_event_set_unlink(c);
+    /* in sync mode, readahead (option prefetch) may have a request
+       outstanding. Its response must be read before another user */
+    if (!c->async)
+        while (c->tasks && ZOOM_event(1, &c))
+            ;
+    if (!connection_reusable(c))
+    {
+        yaz_log(c->log_api, "%p ZOOM_connection_pool_release destroy", c);
+        ZOOM_connection_destroy(c);
+        return;
+    }
+    yaz_log(c->log_api, "%p ZOOM_connection_pool_release idle", c);
+    /* drop reference to options of this user, which may belong to
+       another thread than the one that destroys or reuses c */
+    ZOOM_options_destroy(c->options);
+    c->options = ZOOM_options_create();
+    ZOOM_options_set(c->options, "host", c->host_port);
+    connection_reset_session(c);
+    e = (struct ZOOM_pool_entry *) xmalloc(sizeof(*e));
+    e->c = c;
+    e->hash = pool_hash(c->pool_key);
+    e->released = now;
+
+    yaz_mutex_enter(p->mutex);
+    pool_expire(p, now, &expired);
+    bucket = &p->buckets[e->hash % POOL_HASH_SIZE];
+    if (p->max_per_key > 0)
+    {
+        struct ZOOM_pool_entry *e1 = *bucket;
+        for (; e1; e1 = e1->key_next)
+            if (e1->hash == e->hash && !strcmp(e1->c->pool_key, c->pool_key))
+                n++;
+    }
+    if (n >= p->max_per_key || p->max_idle <= 0)
+    {
+        e->age_next = expired;
+        expired = e;
+    }
+    else
+    {
+        e->key_prev = 0;
+        e->key_next = *bucket;
+        if (*bucket)
+            (*bucket)->key_prev = e;
+        *bucket = e;
+
+        e->age_next = 0;
+        e->age_prev = p->age_back;
+        if (p->age_back)
+            p->age_back->age_next = e;
+        else
+            p->age_front = e;
+        p->age_back = e;
+        p->num_idle++;
+    }
+    yaz_mutex_leave(p->mutex);
+    destroy_entries(expired);
+}
+
+ZOOM_API(int)
+    ZOOM_connection_pool_idle(ZOOM_connection_pool p)
+{
+    int n;
+
+    yaz_mutex_enter(p->mutex);
+    n = p->num_idle;
+    yaz_mutex_leave(p->mutex);
+    return n;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
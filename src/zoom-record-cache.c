@@ -18,6 +18,11 @@
 #include <yaz/diagbib1.h>
 #include <yaz/record_render.h>
 #include <yaz/shptr.h>
+#include <yaz/snprintf.h>
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
 
 #if SHPTR
 YAZ_SHPTR_TYPE(WRBUF)
@@ -46,14 +51,171 @@ struct ZOOM_record_cache_p {
     char *syntax;
     char *schema;
     int pos;
-    ZOOM_record_cache next;
+    ZOOM_record_chunk chunk;
+    ZOOM_record_cache next;     /* hash chain */
+    ZOOM_record_cache lru_prev;
+    ZOOM_record_cache lru_next;
+};
+
+/* memory of a response that records refer to. Freed when the last
+   record referring to it is evicted */
+struct ZOOM_record_chunk_p {
+    NMEM nmem;
+    size_t bytes;
+    int refcount;
 };
 
-static size_t record_hash(int pos)
+#define RECORD_HASH_INITIAL 64
+
+static YAZ_MUTEX g_cache_mutex = 0;
+static size_t g_cache_bytes = 0;
+#if YAZ_POSIX_THREADS
+static pthread_once_t g_cache_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void ZOOM_record_release(ZOOM_record rec);
+
+static void cache_mutex_create(void)
+{
+    yaz_mutex_create(&g_cache_mutex);
+}
+
+/* adds (or subtracts) n bytes to cache size of r and global size.
+   Returns global size */
+static size_t cache_account(ZOOM_resultset r, size_t n, int add)
+{
+    size_t total;
+
+#if YAZ_POSIX_THREADS
+    pthread_once(&g_cache_once, cache_mutex_create);
+#else
+    if (g_cache_mutex == 0)
+        cache_mutex_create();
+#endif
+    yaz_mutex_enter(g_cache_mutex);
+    if (add)
+    {
+        r->cache_bytes += n;
+        g_cache_bytes += n;
+    }
+    else
+    {
+        r->cache_bytes -= n;
+        g_cache_bytes -= n;
+    }
+    total = g_cache_bytes;
+    yaz_mutex_leave(g_cache_mutex);
+    return total;
+}
+
+static char *strdup_null(const char *s)
+{
+    return s ? xstrdup(s) : 0;
+}
+
+static size_t record_hash(ZOOM_resultset r, int pos)
 {
     if (pos < 0)
         pos = 0;
-    return pos % RECORD_HASH_SIZE;
+    return pos & (r->record_hash_size - 1);
+}
+
+static void record_hash_resize(ZOOM_resultset r, int size)
+{
+    ZOOM_record_cache *old_hash = r->record_hash;
+    int i, old_size = r->record_hash_size;
+
+    r->record_hash = (ZOOM_record_cache *)
+        xmalloc(size * sizeof(*r->record_hash));
+    r->record_hash_size = size;
+    for (i = 0; i < size; i++)
+        r->record_hash[i] = 0;
+    for (i = 0; i < old_size; i++)
+    {
+        ZOOM_record_cache rc, rc_next;
+        for (rc = old_hash[i]; rc; rc = rc_next)
+        {
+            size_t h = record_hash(r, rc->pos);
+            rc_next = rc->next;
+            rc->next = r->record_hash[h];
+            r->record_hash[h] = rc;
+        }
+    }
+    xfree(old_hash);
+}
+
+static void lru_unlink(ZOOM_resultset r, ZOOM_record_cache rc)
+{
+    if (rc->lru_prev)
+        rc->lru_prev->lru_next = rc->lru_next;
+    else
+        r->lru_front = rc->lru_next;
+    if (rc->lru_next)
+        rc->lru_next->lru_prev = rc->lru_prev;
+    else
+        r->lru_back = rc->lru_prev;
+}
+
+static void lru_append(ZOOM_resultset r, ZOOM_record_cache rc)
+{
+    rc->lru_next = 0;
+    rc->lru_prev = r->lru_back;
+    if (r->lru_back)
+        r->lru_back->lru_next = rc;
+    else
+        r->lru_front = rc;
+    r->lru_back = rc;
+}
+
+static void chunk_unref(ZOOM_resultset r, ZOOM_record_chunk chunk)
+{
+    if (chunk && --(chunk->refcount) == 0)
+    {
+        cache_account(r, chunk->bytes, 0);
+        nmem_destroy(chunk->nmem);
+        xfree(chunk);
+    }
+}
+
+static void record_cache_free(ZOOM_resultset r, ZOOM_record_cache rc)
+{
+    ZOOM_record_cache *rcp = &r->record_hash[record_hash(r, rc->pos)];
+
+    while (*rcp != rc)
+        rcp = &(*rcp)->next;
+    *rcp = rc->next;
+    lru_unlink(r, rc);
+    r->record_hash_num--;
+
+    ZOOM_record_release(&rc->rec);
+    chunk_unref(r, rc->chunk);
+    xfree(rc->elementSetName);
+    xfree(rc->syntax);
+    xfree(rc->schema);
+    xfree(rc);
+    cache_account(r, sizeof(*rc), 0);
+}
+
+/* evicts least recently used records while over budget, but not those
+   of the response being cached */
+static void record_cache_evict(ZOOM_resultset r, size_t global_bytes)
+{
+    ZOOM_record_cache rc;
+
+    while ((rc = r->lru_front) &&
+           !(r->record_chunk && rc->chunk == r->record_chunk))
+    {
+        if (r->cache_max_bytes && r->cache_bytes > r->cache_max_bytes)
+            ;
+        else if (r->cache_global_max_bytes &&
+                 global_bytes > r->cache_global_max_bytes)
+            ;
+        else
+            break;
+        record_cache_free(r, rc);
+        r->cache_evictions++;
+        global_bytes = cache_account(r, 0, 1);
+    }
 }
 
 static ZOOM_record record_cache_add(ZOOM_resultset r,
@@ -69,17 +231,28 @@ static ZOOM_record record_cache_add(ZOOM_resultset r,
     ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
     ZOOM_connection_put_event(r->connection, event);
 
-    for (rc = r->record_hash[record_hash(pos)]; rc; rc = rc->next)
+    if (r->record_hash_size)
     {
-        if (pos == rc->pos
-            && yaz_strcmp_null(schema, rc->schema) == 0
-            && yaz_strcmp_null(elementSetName,rc->elementSetName) == 0
-            && yaz_strcmp_null(syntax, rc->syntax) == 0)
-            break;
+        for (rc = r->record_hash[record_hash(r, pos)]; rc; rc = rc->next)
+        {
+            if (pos == rc->pos
+                && yaz_strcmp_null(schema, rc->schema) == 0
+                && yaz_strcmp_null(elementSetName,rc->elementSetName) == 0
+                && yaz_strcmp_null(syntax, rc->syntax) == 0)
+                break;
+        }
     }
-    if (!rc)
+    if (rc)
+        lru_unlink(r, rc);
+    else
     {
-        rc = (ZOOM_record_cache) odr_malloc(r->odr, sizeof(*rc));
+        size_t h;
+
+        if (r->record_hash_num >= 2 * r->record_hash_size)
+            record_hash_resize(r, r->record_hash_size ?
+                               2 * r->record_hash_size : RECORD_HASH_INITIAL);
+        rc = (ZOOM_record_cache) xmalloc(sizeof(*rc));
+        cache_account(r, sizeof(*rc), 1);
         rc->rec.odr = 0;
 #if SHPTR
         YAZ_SHPTR_INC(r->record_wrbuf);
@@ -87,20 +260,30 @@ static ZOOM_record record_cache_add(ZOOM_resultset r,
 #else
         rc->rec.wrbuf = 0;
 #endif
-        rc->elementSetName = odr_strdup_null(r->odr, elementSetName);
+        rc->elementSetName = strdup_null(elementSetName);
 
-        rc->syntax = odr_strdup_null(r->odr, syntax);
+        rc->syntax = strdup_null(syntax);
 
-        rc->schema = odr_strdup_null(r->odr, schema);
+        rc->schema = strdup_null(schema);
 
         rc->pos = pos;
-        rc->next = r->record_hash[record_hash(pos)];
-        r->record_hash[record_hash(pos)] = rc;
-
+        rc->chunk = 0;
+        h = record_hash(r, pos);
+        rc->next = r->record_hash[h];
+        r->record_hash[h] = rc;
+        r->record_hash_num++;
+    }
+    lru_append(r, rc);
+    if (rc->chunk != r->record_chunk)
+    {
+        chunk_unref(r, rc->chunk);
+        rc->chunk = r->record_chunk;
+        if (rc->chunk)
+            (rc->chunk->refcount)++;
     }
 
     rc->rec.npr = npr;
-    rc->rec.schema = odr_strdup_null(r->odr, schema);
+    rc->rec.schema = rc->schema;
     rc->rec.diag_set = 0;
     rc->rec.diag_uri = 0;
     rc->rec.diag_message = 0;
@@ -132,6 +315,66 @@ void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
     ZOOM_memcached_add(r, npr, pos, syntax, elementSetName, schema, diag);
 }
 
+/* records added until ZOOM_record_cache_chunk_end refer to its memory */
+void ZOOM_record_cache_chunk_begin(ZOOM_resultset r)
+{
+    ZOOM_record_chunk chunk = (ZOOM_record_chunk) xmalloc(sizeof(*chunk));
+
+    chunk_unref(r, r->record_chunk);
+    chunk->nmem = 0;
+    chunk->bytes = 0;
+    chunk->refcount = 1;
+    r->record_chunk = chunk;
+}
+
+/* nmem: response memory that records added since chunk_begin refer to */
+void ZOOM_record_cache_chunk_end(ZOOM_resultset r, NMEM nmem)
+{
+    ZOOM_record_chunk chunk = r->record_chunk;
+
+    if (!chunk)
+        return;
+    if (chunk->refcount == 1)
+    {   /* no records: the response may still be in use by caller */
+        nmem_transfer(odr_getmem(r->odr), nmem);
+        nmem_destroy(nmem);
+    }
+    else
+    {
+        chunk->nmem = nmem;
+        chunk->bytes = nmem_total(nmem);
+        record_cache_evict(r, cache_account(r, chunk->bytes, 1));
+    }
+    r->record_chunk = 0;
+    chunk_unref(r, chunk);
+}
+
+/* sets statistics option key, if changed, so that values returned
+   earlier stay valid */
+void ZOOM_record_cache_option(ZOOM_resultset r, const char *key)
+{
+    char buf[30];
+    const char *cur;
+    size_t v;
+
+    if (!strcmp(key, "recordCacheHits"))
+        v = r->cache_hits;
+    else if (!strcmp(key, "recordCacheMisses"))
+        v = r->cache_misses;
+    else if (!strcmp(key, "recordCacheEvictions"))
+        v = r->cache_evictions;
+    else if (!strcmp(key, "recordCacheRecords"))
+        v = r->record_hash_num;
+    else if (!strcmp(key, "recordCacheBytes"))
+        v = r->cache_bytes;
+    else
+        return;
+    yaz_snprintf(buf, sizeof(buf), "%lu", (unsigned long) v);
+    cur = ZOOM_options_get(r->options, key);
+    if (!cur || strcmp(cur, buf))
+        ZOOM_options_set(r->options, key, buf);
+}
+
 ZOOM_record ZOOM_record_cache_lookup_i(ZOOM_resultset r, int pos,
                                        const char *syntax,
                                        const char *elementSetName,
@@ -139,7 +382,9 @@ ZOOM_record ZOOM_record_cache_lookup_i(ZOOM_resultset r, int pos,
 {
     ZOOM_record_cache rc;
 
-    for (rc = r->record_hash[record_hash(pos)]; rc; rc = rc->next)
+    if (!r->record_hash_size)
+        return 0;
+    for (rc = r->record_hash[record_hash(r, pos)]; rc; rc = rc->next)
     {
         if (pos == rc->pos)
         {
@@ -149,6 +394,11 @@ ZOOM_record ZOOM_record_cache_lookup_i(ZOOM_resultset r, int pos,
                 continue;
             if (yaz_strcmp_null(syntax, rc->syntax))
                 continue;
+            if (rc != r->lru_back)
+            {
+                lru_unlink(r, rc);
+                lru_append(r, rc);
+            }
             return &rc->rec;
         }
     }
@@ -167,12 +417,17 @@ ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
     {
         ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
         ZOOM_connection_put_event(r->connection, event);
+        r->cache_hits++;
         return rec;
     }
     npr = ZOOM_memcached_lookup(r, pos, syntax, elementSetName, schema);
     if (npr)
+    {
+        r->cache_hits++;
         return record_cache_add(r, npr, pos, syntax, elementSetName,
                                 schema, 0);
+    }
+    r->cache_misses++;
     return 0;
 }
 
@@ -228,16 +483,13 @@ static void ZOOM_record_release(ZOOM_record rec)
 ZOOM_API(void)
     ZOOM_resultset_cache_reset(ZOOM_resultset r)
 {
-    int i;
-    for (i = 0; i<RECORD_HASH_SIZE; i++)
-    {
-        ZOOM_record_cache rc;
-        for (rc = r->record_hash[i]; rc; rc = rc->next)
-        {
-            ZOOM_record_release(&rc->rec);
-        }
-        r->record_hash[i] = 0;
-    }
+    while (r->lru_front)
+        record_cache_free(r, r->lru_front);
+    xfree(r->record_hash);
+    r->record_hash = 0;
+    r->record_hash_size = 0;
+    chunk_unref(r, r->record_chunk);
+    r->record_chunk = 0;
 }
 
 
@@ -252,6 +504,13 @@ ZOOM_API(const char *)
     if (!rec || !rec->npr)
         return 0;
 
+    if (rec->npr->which == Z_NamePlusRecord_databaseRecord &&
+        rec->npr->u.databaseRecord->which == Z_External_single)
+    {   /* left undecoded by odr_set_lazy. Decode on first access */
+        if (!rec->odr)
+            rec->odr = odr_createmem(ODR_DECODE);
+        z_External_resolve(odr_getmem(rec->odr), rec->npr->u.databaseRecord);
+    }
 #if SHPTR
     if (!rec->record_wrbuf)
     {
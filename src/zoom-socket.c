@@ -5,6 +5,13 @@
 /**
  * \file zoom-socket.c
  * \brief Implements ZOOM C socket interface.
+ *
+ * ZOOM_event polls all connections given on each call. An event set
+ * (ZOOM_event_set) keeps its connections registered instead: with epoll
+ * a connection is only re-registered when its socket or mask changes.
+ * Connections that may have work to do (new task, pending events, socket
+ * activity) are put on a ready queue, and only those are processed.
+ * Timeouts are kept in a binary heap, as in the GFS event loop.
  */
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -13,10 +20,11 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
-#include <yaz/zoom.h>
+#include "zoom-p.h"
 
 #include <yaz/log.h>
 #include <yaz/xmalloc.h>
+#include <yaz/gettimeofday.h>
 
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -24,6 +32,12 @@
 #if HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <yaz/poll.h>
 
@@ -108,6 +122,554 @@ ZOOM_API(int)
     return ZOOM_event_nonblock(no, cs);
 }
 
+#define EVENT_SET_MAX_EVENTS 128
+
+struct ZOOM_event_set_entry {
+    ZOOM_connection c;
+    ZOOM_event_set es;
+    int fd;                 /* registered socket, -1 for none */
+    int cs_serial;          /* COMSTACK of fd (cs_serial of connection) */
+    int mask;               /* registered ZOOM_SELECT_.. mask */
+    int queued;
+    double last_event;      /* time of last activity */
+    double timer_due;       /* position in timer heap */
+    int timer_index;        /* -1 if not in timer heap */
+    struct ZOOM_event_set_entry *ready_prev;
+    struct ZOOM_event_set_entry *ready_next;
+    struct ZOOM_event_set_entry *prev;
+    struct ZOOM_event_set_entry *next;
+};
+
+struct ZOOM_event_set_p {
+    struct ZOOM_event_set_entry *entries;
+    struct ZOOM_event_set_entry *ready_front;
+    struct ZOOM_event_set_entry *ready_back;
+    struct ZOOM_event_set_entry *current;  /* being processed */
+    int num_waiting;        /* entries with a mask */
+    struct ZOOM_event_set_entry **timers;  /* heap by timer_due */
+    int num_timers;
+    int timers_size;
+    int epoll_fd;           /* -1: yaz_poll over entries */
+    struct ZOOM_event_set_entry **fd_entries;
+    int fd_entries_size;
+#if HAVE_SYS_EPOLL_H
+    struct epoll_event events[EVENT_SET_MAX_EVENTS];
+#endif
+    struct yaz_poll_fd *fds;
+    int fds_size;
+};
+
+static double event_set_now(void)
+{
+    struct timeval tv;
+
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void ready_put(ZOOM_event_set es, struct ZOOM_event_set_entry *e)
+{
+    if (e->queued || e == es->current)
+        return;
+    e->queued = 1;
+    e->ready_next = 0;
+    e->ready_prev = es->ready_back;
+    if (es->ready_back)
+        es->ready_back->ready_next = e;
+    else
+        es->ready_front = e;
+    es->ready_back = e;
+}
+
+static void ready_remove(ZOOM_event_set es, struct ZOOM_event_set_entry *e)
+{
+    if (!e->queued)
+        return;
+    e->queued = 0;
+    if (e->ready_prev)
+        e->ready_prev->ready_next = e->ready_next;
+    else
+        es->ready_front = e->ready_next;
+    if (e->ready_next)
+        e->ready_next->ready_prev = e->ready_prev;
+    else
+        es->ready_back = e->ready_prev;
+}
+
+static void timer_set(ZOOM_event_set es, int i,
+                      struct ZOOM_event_set_entry *e)
+{
+    es->timers[i] = e;
+    e->timer_index = i;
+}
+
+static void timer_sift_up(ZOOM_event_set es, int i)
+{
+    struct ZOOM_event_set_entry *e = es->timers[i];
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (es->timers[parent]->timer_due <= e->timer_due)
+            break;
+        timer_set(es, i, es->timers[parent]);
+        i = parent;
+    }
+    timer_set(es, i, e);
+}
+
+static void timer_sift_down(ZOOM_event_set es, int i)
+{
+    struct ZOOM_event_set_entry *e = es->timers[i];
+
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= es->num_timers)
+            break;
+        if (child + 1 < es->num_timers &&
+            es->timers[child + 1]->timer_due < es->timers[child]->timer_due)
+            child++;
+        if (e->timer_due <= es->timers[child]->timer_due)
+            break;
+        timer_set(es, i, es->timers[child]);
+        i = child;
+    }
+    timer_set(es, i, e);
+}
+
+static void timer_update(ZOOM_event_set es, struct ZOOM_event_set_entry *e)
+{
+    if (e->timer_index == -1)
+    {
+        if (es->num_timers == es->timers_size)
+        {
+            es->timers_size = 2 * es->timers_size + 16;
+            es->timers = (struct ZOOM_event_set_entry **)
+                xrealloc(es->timers, es->timers_size * sizeof(*es->timers));
+        }
+        timer_set(es, es->num_timers++, e);
+        timer_sift_up(es, e->timer_index);
+    }
+    else
+    {
+        timer_sift_up(es, e->timer_index);
+        timer_sift_down(es, e->timer_index);
+    }
+}
+
+static void timer_remove(ZOOM_event_set es, struct ZOOM_event_set_entry *e)
+{
+    int i = e->timer_index;
+
+    if (i == -1)
+        return;
+    e->timer_index = -1;
+    if (--es->num_timers > i)
+    {
+        timer_set(es, i, es->timers[es->num_timers]);
+        timer_update(es, es->timers[i]);
+    }
+}
+
+/* registers socket and mask of entry. fd = -1 removes registration.
+   renew is set if the socket is a new one, even if fd is the same */
+static void register_entry(ZOOM_event_set es, struct ZOOM_event_set_entry *e,
+                           int fd, int mask, int renew)
+{
+    if (!e->mask && mask)
+        es->num_waiting++;
+    else if (e->mask && !mask)
+        es->num_waiting--;
+#if HAVE_SYS_EPOLL_H
+    if (es->epoll_fd != -1)
+    {
+        struct epoll_event ev;
+        int op = EPOLL_CTL_MOD;
+
+        memset(&ev, 0, sizeof(ev));
+        if (e->fd != -1 && (!mask || e->fd != fd || renew))
+        {
+            /* the socket may be closed (and reused) already. Only an
+               entry that still owns the descriptor removes it */
+            if (es->fd_entries[e->fd] == e)
+            {
+                epoll_ctl(es->epoll_fd, EPOLL_CTL_DEL, e->fd, &ev);
+                es->fd_entries[e->fd] = 0;
+            }
+            e->fd = -1;
+        }
+        if (mask)
+        {
+            struct ZOOM_event_set_entry *owner;
+
+            if (fd >= es->fd_entries_size)
+            {
+                int i, old_size = es->fd_entries_size;
+
+                es->fd_entries_size = 2 * fd + 16;
+                es->fd_entries = (struct ZOOM_event_set_entry **)
+                    xrealloc(es->fd_entries,
+                             es->fd_entries_size * sizeof(*es->fd_entries));
+                for (i = old_size; i < es->fd_entries_size; i++)
+                    es->fd_entries[i] = 0;
+            }
+            owner = es->fd_entries[fd];
+            if (owner && owner != e)
+            {
+                /* socket of owner was closed; descriptor now used by e */
+                if (owner->mask)
+                    es->num_waiting--;
+                owner->fd = -1;
+                owner->mask = 0;
+                ready_put(es, owner);
+            }
+            if (mask & ZOOM_SELECT_READ)
+                ev.events |= EPOLLIN;
+            if (mask & ZOOM_SELECT_WRITE)
+                ev.events |= EPOLLOUT;
+            ev.data.fd = fd;
+            if (e->fd == -1)
+                op = EPOLL_CTL_ADD;
+            if (epoll_ctl(es->epoll_fd, op, fd, &ev) < 0)
+            {
+                /* a socket closed and created again may get the same
+                   descriptor; the registration went with the old one */
+                if (op == EPOLL_CTL_ADD && errno == EEXIST)
+                    op = EPOLL_CTL_MOD;
+                else if (op == EPOLL_CTL_MOD && errno == ENOENT)
+                    op = EPOLL_CTL_ADD;
+                else
+                    op = -1;
+                if (op == -1 || epoll_ctl(es->epoll_fd, op, fd, &ev) < 0)
+                    yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_ctl fd=%d", fd);
+            }
+            es->fd_entries[fd] = e;
+        }
+    }
+#endif
+    e->fd = mask ? fd : -1;
+    e->mask = mask;
+}
+
+/* brings registration and timer of entry up to date with connection */
+static void sync_entry(ZOOM_event_set es, struct ZOOM_event_set_entry *e,
+                       double now)
+{
+    int fd = ZOOM_connection_get_socket(e->c);
+    int mask = fd == -1 ? 0 : ZOOM_connection_get_mask(e->c);
+    /* a reconnect may get the same descriptor, but the registration
+       went with the old socket */
+    int renew = e->fd != -1 && e->cs_serial != e->c->cs_serial;
+
+    if (fd != e->fd || mask != e->mask || renew)
+    {
+        register_entry(es, e, fd, mask, renew);
+        e->cs_serial = e->c->cs_serial;
+        e->last_event = now;
+    }
+    if (mask)
+    {
+        int timeout = ZOOM_connection_get_timeout(e->c);
+        if (timeout > 0)
+        {
+            if (e->timer_index == -1 ||
+                e->timer_due > e->last_event + timeout)
+            {
+                e->timer_due = e->last_event + timeout;
+                timer_update(es, e);
+            }
+            return;
+        }
+    }
+    timer_remove(es, e);
+}
+
+static void fire_socket(ZOOM_event_set es, struct ZOOM_event_set_entry *e,
+                        int mask, double now)
+{
+    e->last_event = now;
+    ready_put(es, e);
+    ZOOM_connection_fire_event_socket(e->c, mask);
+}
+
+/* fires timeouts that are due. Returns milliseconds to next one or -1 */
+static int expire_timers(ZOOM_event_set es, double now)
+{
+    struct ZOOM_event_set_entry *e;
+
+    while (es->num_timers && (e = es->timers[0])->timer_due <= now)
+    {
+        int timeout = ZOOM_connection_get_timeout(e->c);
+        double due = e->last_event + timeout;
+
+        if (timeout <= 0)
+            timer_remove(es, e);
+        else if (due <= now)
+        {
+            timer_remove(es, e);
+            ready_put(es, e);
+            ZOOM_connection_fire_event_timeout(e->c);
+        }
+        else
+        {
+            /* activity since timer was scheduled */
+            e->timer_due = due;
+            timer_sift_down(es, 0);
+        }
+    }
+    if (!es->num_timers)
+        return -1;
+    return (int) ((es->timers[0]->timer_due - now) * 1000.0) + 1;
+}
+
+static int wait_sockets(ZOOM_event_set es, int msec)
+{
+    double now;
+    int i, r;
+
+#if HAVE_SYS_EPOLL_H
+    if (es->epoll_fd != -1)
+    {
+        r = epoll_wait(es->epoll_fd, es->events, EVENT_SET_MAX_EVENTS, msec);
+        now = event_set_now();
+        for (i = 0; i < r; i++)
+        {
+            unsigned events = es->events[i].events;
+            int fd = es->events[i].data.fd;
+            int mask = 0;
+
+            if (fd >= es->fd_entries_size || !es->fd_entries[fd])
+                continue;
+            if (events & EPOLLIN)
+                mask |= ZOOM_SELECT_READ;
+            if (events & EPOLLOUT)
+                mask |= ZOOM_SELECT_WRITE;
+            if (events & ~(EPOLLIN | EPOLLOUT))
+                mask |= ZOOM_SELECT_EXCEPT;
+            fire_socket(es, es->fd_entries[fd], mask, now);
+        }
+        return r;
+    }
+#endif
+    {
+        struct ZOOM_event_set_entry *e;
+        int nfds = 0;
+
+        if (es->fds_size < es->num_waiting)
+        {
+            es->fds_size = 2 * es->num_waiting;
+            es->fds = (struct yaz_poll_fd *)
+                xrealloc(es->fds, es->fds_size * sizeof(*es->fds));
+        }
+        for (e = es->entries; e; e = e->next)
+            if (e->mask)
+            {
+                enum yaz_poll_mask input_mask = yaz_poll_none;
+
+                if (e->mask & ZOOM_SELECT_READ)
+                    yaz_poll_add(input_mask, yaz_poll_read);
+                if (e->mask & ZOOM_SELECT_WRITE)
+                    yaz_poll_add(input_mask, yaz_poll_write);
+                if (e->mask & ZOOM_SELECT_EXCEPT)
+                    yaz_poll_add(input_mask, yaz_poll_except);
+                es->fds[nfds].fd = e->fd;
+                es->fds[nfds].input_mask = input_mask;
+                es->fds[nfds].client_data = e;
+                nfds++;
+            }
+        if (msec < 0)
+            r = yaz_poll(es->fds, nfds, -1, 0);
+        else
+            r = yaz_poll(es->fds, nfds, msec / 1000, (msec % 1000) * 1000000);
+        now = event_set_now();
+        for (i = 0; r > 0 && i < nfds; i++)
+        {
+            enum yaz_poll_mask output_mask = es->fds[i].output_mask;
+            int mask = 0;
+
+            if (output_mask & yaz_poll_read)
+                mask |= ZOOM_SELECT_READ;
+            if (output_mask & yaz_poll_write)
+                mask |= ZOOM_SELECT_WRITE;
+            if (output_mask & yaz_poll_except)
+                mask |= ZOOM_SELECT_EXCEPT;
+            if (mask)
+                fire_socket(es, (struct ZOOM_event_set_entry *)
+                            es->fds[i].client_data, mask, now);
+        }
+        return r;
+    }
+}
+
+ZOOM_API(ZOOM_event_set)
+    ZOOM_event_set_create(void)
+{
+    ZOOM_event_set es = (ZOOM_event_set) xmalloc(sizeof(*es));
+
+    es->entries = 0;
+    es->ready_front = es->ready_back = 0;
+    es->current = 0;
+    es->num_waiting = 0;
+    es->timers = 0;
+    es->num_timers = 0;
+    es->timers_size = 0;
+    es->fd_entries = 0;
+    es->fd_entries_size = 0;
+    es->fds = 0;
+    es->fds_size = 0;
+    es->epoll_fd = -1;
+#if HAVE_SYS_EPOLL_H
+    es->epoll_fd = epoll_create(EVENT_SET_MAX_EVENTS);
+    if (es->epoll_fd == -1)
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_create");
+#endif
+    return es;
+}
+
+ZOOM_API(void)
+    ZOOM_event_set_destroy(ZOOM_event_set es)
+{
+    if (!es)
+        return;
+    while (es->entries)
+        ZOOM_event_set_remove(es, es->entries->c);
+#if HAVE_SYS_EPOLL_H
+    if (es->epoll_fd != -1)
+        close(es->epoll_fd);
+#endif
+    xfree(es->timers);
+    xfree(es->fd_entries);
+    xfree(es->fds);
+    xfree(es);
+}
+
+ZOOM_API(int)
+    ZOOM_event_set_add(ZOOM_event_set es, ZOOM_connection c)
+{
+    struct ZOOM_event_set_entry *e;
+
+    if (c->event_entry)
+        return -1;
+    e = (struct ZOOM_event_set_entry *) xmalloc(sizeof(*e));
+    e->c = c;
+    e->es = es;
+    e->fd = -1;
+    e->cs_serial = c->cs_serial;
+    e->mask = 0;
+    e->queued = 0;
+    e->last_event = 0.0;
+    e->timer_due = 0.0;
+    e->timer_index = -1;
+    e->prev = 0;
+    e->next = es->entries;
+    if (e->next)
+        e->next->prev = e;
+    es->entries = e;
+    c->event_entry = e;
+    ready_put(es, e);
+    return 0;
+}
+
+ZOOM_API(void)
+    ZOOM_event_set_remove(ZOOM_event_set es, ZOOM_connection c)
+{
+    struct ZOOM_event_set_entry *e = c->event_entry;
+
+    if (!e || e->es != es)
+        return;
+    register_entry(es, e, -1, 0, 0);
+    timer_remove(es, e);
+    ready_remove(es, e);
+    if (es->current == e)
+        es->current = 0;
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        es->entries = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    c->event_entry = 0;
+    xfree(e);
+}
+
+void ZOOM_event_set_unlink(ZOOM_connection c)
+{
+    if (c->event_entry)
+        ZOOM_event_set_remove(c->event_entry->es, c);
+}
+
+void ZOOM_event_set_touch(ZOOM_connection c)
+{
+    if (c->event_entry)
+        ready_put(c->event_entry->es, c->event_entry);
+}
+
+ZOOM_API(int)
+    ZOOM_event_set_next(ZOOM_event_set es, int max, ZOOM_connection *cs,
+                        int *events)
+{
+    return ZOOM_event_set_wait(es, max, cs, events, -1);
+}
+
+/* as ZOOM_event_set_next, but returns -2 if no events occurred within
+   max_msec milliseconds (unless max_msec is negative) */
+int ZOOM_event_set_wait(ZOOM_event_set es, int max, ZOOM_connection *cs,
+                        int *events, int max_msec)
+{
+    int n = 0;
+    double until = 0.0;
+
+    if (max_msec >= 0)
+        until = event_set_now() + max_msec / 1000.0;
+    while (1)
+    {
+        struct ZOOM_event_set_entry *e;
+        double now = event_set_now();
+        int msec;
+
+        while (n < max && (e = es->ready_front))
+        {
+            ZOOM_connection c = e->c;
+
+            ready_remove(es, e);
+            es->current = e;
+            if (ZOOM_connection_process(c))
+            {
+                cs[n] = c;
+                if (events)
+                    events[n] = ZOOM_connection_last_event(c);
+                n++;
+                es->current = 0;
+                ready_put(es, e); /* may have more events */
+            }
+            es->current = 0;
+            if (c->event_entry == e)
+                sync_entry(es, e, now);
+        }
+        if (n > 0)
+            return n;
+        msec = expire_timers(es, now);
+        if (es->ready_front)
+            continue;
+        if (!es->num_waiting)
+            return 0;
+        if (max_msec >= 0)
+        {
+            int left = (int) ((until - now) * 1000.0);
+            if (left <= 0)
+                return -2;
+            if (msec < 0 || msec > left)
+                msec = left;
+        }
+        if (wait_sockets(es, msec) < 0 && errno != EINTR)
+        {
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "ZOOM_event_set_next");
+            return -1;
+        }
+    }
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
@@ -255,7 +255,6 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
     ZOOM_resultset resultset = 0;
     int *start, *count;
     int i;
-    NMEM nmem;
     ZOOM_Event event;
     const char *syntax, *elementSetName, *schema;
 
@@ -328,6 +327,7 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
         if (res->suggestions)
             ZOOM_resultset_option_set(resultset, "suggestions",
                                       res->suggestions);
+        ZOOM_record_cache_chunk_begin(resultset);
         for (i = 0; i < res->num_records; i++)
         {
             int pos = c->tasks->u.search.start + i;
@@ -380,9 +380,7 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
         if (*count < 0)
             *count = 0;
         *start += i;
-        nmem = odr_extract_mem(c->odr_in);
-        nmem_transfer(odr_getmem(resultset->odr), nmem);
-        nmem_destroy(nmem);
+        ZOOM_record_cache_chunk_end(resultset, odr_extract_mem(c->odr_in));
 
         return ZOOM_connection_srw_send_search(c);
     }
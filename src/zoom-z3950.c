@@ -1401,6 +1401,19 @@ static void handle_Z3950_scan_response(ZOOM_connection c, Z_ScanResponse *res)
     scan->scan_response = res;
     scan->srw_scan_response = 0;
     nmem_transfer(odr_getmem(scan->odr), nmem);
+    if (res->entries && res->entries->entries)
+    {
+        /* terms are returned as strings by ZOOM_scanset_term */
+        int i;
+        for (i = 0; i < res->entries->num_entries; i++)
+        {
+            Z_Entry *e = res->entries->entries[i];
+            if (e->which == Z_Entry_termInfo
+                && e->u.termInfo->term->which == Z_Term_general)
+                odr_oct_detach(odr_getmem(scan->odr),
+                               e->u.termInfo->term->u.general);
+        }
+    }
     if (res->stepSize)
         ZOOM_options_set_int(scan->options, "stepSize", *res->stepSize);
     if (res->positionOfTerm)
@@ -1452,9 +1465,9 @@ static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
         if (sr && sr->which == Z_Records_DBOSD)
         {
             int i;
-            NMEM nmem = odr_extract_mem(c->odr_in);
             Z_NamePlusRecordList *p =
                 sr->u.databaseOrSurDiagnostics;
+            ZOOM_record_cache_chunk_begin(resultset);
             for (i = 0; i < p->num_records; i++)
             {
                 ZOOM_record_cache_add(resultset, p->records[i], i + *start,
@@ -1468,9 +1481,6 @@ static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
                     "handle_records resultset=%p start=%d count=%d",
                     resultset, *start, *count);
 
-            /* transfer our response to search_nmem .. we need it later */
-            nmem_transfer(odr_getmem(resultset->odr), nmem);
-            nmem_destroy(nmem);
             if (present_phase && p->num_records == 0)
             {
                 /* present response and we didn't get any records! */
@@ -1483,6 +1493,9 @@ static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
                                       syntax, elementSetName, schema, 0);
                 *count = 0;
             }
+            /* records refer to our response .. keep it with them */
+            ZOOM_record_cache_chunk_end(resultset,
+                                        odr_extract_mem(c->odr_in));
         }
         else if (present_phase)
         {
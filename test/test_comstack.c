@@ -14,6 +14,8 @@
 #include <yaz/test.h>
 #include <yaz/comstack.h>
 #include <yaz/tcpip.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
 
 static void tst_http_request(void)
 {
@@ -434,6 +436,175 @@ static int comstack_example(const char *server_address_str)
     return 0;
 }
 
+/* checks that incremental check agrees with cs_complete_auto for
+   every prefix of buf */
+static int check_complete_r(const char *buf, int len)
+{
+    struct cs_complete_state st;
+    int i;
+
+    cs_complete_reset(&st);
+    for (i = 0; i <= len; i++)
+    {
+        int r = cs_complete_auto_r(buf, i, &st);
+        if (r != cs_complete_auto(buf, i))
+            return 0;
+        if (r)
+            cs_complete_reset(&st);
+    }
+    return 1;
+}
+
+static void tst_complete_incremental(void)
+{
+    const char *http_len =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "0123456789"
+        "HTTP/1.1 200 OK\r\n";
+    const char *http_chunked =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "3\r\nabc\r\n"
+        "a\r\n0123456789\r\n"
+        "1; ext\r\nx\r\n"
+        "0\r\n"
+        "X-Trailer: y\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n";
+    const char *http_req =
+        "GET / HTTP/1.1\r\n"
+        "Host: x\r\n"
+        "\r\n";
+    /* SEQUENCE (indefinite) of OCTET STRING and SEQUENCE (indefinite) */
+    const char ber_indef[] = {
+        0x30, 0x80,
+        0x04, 0x03, 'a', 'b', 'c',
+        0x30, 0x80, 0x04, 0x01, 'x', 0x00, 0x00,
+        0x04, 0x02, 'y', 'z',
+        0x00, 0x00,
+        0x04, 0x01, 'q'
+    };
+    const char ber_def[] = {
+        0x30, 0x0a,
+        0x04, 0x03, 'a', 'b', 'c',
+        0x04, 0x03, 'd', 'e', 'f',
+        0x30, 0x00,
+        0x04, 0x01, 'q'
+    };
+    struct cs_complete_state st;
+
+    YAZ_CHECK(check_complete_r(http_len, strlen(http_len)));
+    YAZ_CHECK(check_complete_r(http_chunked, strlen(http_chunked)));
+    YAZ_CHECK(check_complete_r(http_req, strlen(http_req)));
+    YAZ_CHECK(check_complete_r(ber_indef, sizeof(ber_indef)));
+    YAZ_CHECK(check_complete_r(ber_def, sizeof(ber_def)));
+
+    cs_complete_reset(&st);
+    YAZ_CHECK_EQ(cs_complete_auto_r(http_len, 45, &st), 0);
+    YAZ_CHECK_EQ(st.length, 49);
+    YAZ_CHECK_EQ(cs_complete_auto_r(http_len, 49, &st), 49);
+
+    cs_complete_reset(&st);
+    YAZ_CHECK_EQ(cs_complete_auto_r(http_chunked, 70, &st), 0);
+    YAZ_CHECK(st.resume > 0);
+    YAZ_CHECK_EQ(cs_complete_auto_r(http_chunked, strlen(http_chunked),
+                                    &st), 100);
+
+    cs_complete_reset(&st);
+    YAZ_CHECK_EQ(cs_complete_auto_head_r(http_len, 30, &st), 0);
+    YAZ_CHECK_EQ(cs_complete_auto_head_r(http_len, 39, &st), 39);
+}
+
+/* content of about size bytes, in chunks/members of 4K */
+static char *make_pdu(int size, int http, int *len)
+{
+    const int chunk = 4096;
+    char *buf = (char *) malloc(size + size / 64 + 100);
+    int i = 0;
+
+    if (http)
+    {
+        strcpy(buf, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        i = strlen(buf);
+    }
+    else
+    {
+        buf[i++] = 0x30;
+        buf[i++] = 0x80;
+    }
+    while (size > 0)
+    {
+        if (http)
+        {
+            i += sprintf(buf + i, "%x\r\n", chunk);
+            memset(buf + i, 'x', chunk);
+            i += chunk;
+            buf[i++] = '\r';
+            buf[i++] = '\n';
+        }
+        else
+        {
+            buf[i++] = 0x04;
+            buf[i++] = 0x82;
+            buf[i++] = chunk >> 8;
+            buf[i++] = chunk & 255;
+            memset(buf + i, 'x', chunk);
+            i += chunk;
+        }
+        size -= chunk;
+    }
+    if (http)
+    {
+        strcpy(buf + i, "0\r\n\r\n");
+        i += 5;
+    }
+    else
+    {
+        buf[i++] = 0;
+        buf[i++] = 0;
+    }
+    *len = i;
+    return buf;
+}
+
+/* feeds PDU in 4K pieces, as tcpip_get does */
+static void tst_complete_bench(int size, int full)
+{
+    int http;
+
+    for (http = 0; http < 2; http++)
+    {
+        int len, i, r = 0;
+        char *buf = make_pdu(size, http, &len);
+        struct cs_complete_state st;
+        yaz_timing_t t;
+
+        t = yaz_timing_create();
+        cs_complete_reset(&st);
+        for (i = 4096; !r; i += 4096)
+            r = cs_complete_auto_r(buf, i > len ? len : i, &st);
+        yaz_timing_stop(t);
+        YAZ_CHECK_EQ(r, len);
+        yaz_log(YLOG_LOG, "%s %d bytes incremental: %f s",
+                http ? "HTTP" : "BER", len, yaz_timing_get_real(t));
+        if (full)
+        {
+            yaz_timing_start(t);
+            for (i = 4096, r = 0; !r; i += 4096)
+                r = cs_complete_auto(buf, i > len ? len : i);
+            yaz_timing_stop(t);
+            YAZ_CHECK_EQ(r, len);
+            yaz_log(YLOG_LOG, "%s %d bytes full: %f s",
+                    http ? "HTTP" : "BER", len, yaz_timing_get_real(t));
+        }
+        yaz_timing_destroy(&t);
+        free(buf);
+    }
+}
+
 static void tst_cs_get_host_args(void)
 {
     const char *arg = 0;
@@ -499,16 +670,54 @@ static void tst_cs_get_error(void)
     cs_close(cs);
 }
 
+/* COMSTACK type without f_put_iov; every other put is incomplete */
+static int fake_put_calls;
+static char fake_put_data[100];
+static int fake_put(COMSTACK h, char *buf, int size)
+{
+    if (fake_put_calls++ % 2 == 0)
+        return 1;
+    strncat(fake_put_data, buf, size);
+    return 0;
+}
+
+static void tst_cs_put_iov_f_put(void)
+{
+    struct comstack cs;
+    struct cs_iovec iov[3];
+    int r, loops = 0;
+
+    memset(&cs, 0, sizeof(cs));
+    cs.f_put = fake_put;
+    iov[0].buf = "ab";
+    iov[0].len = 2;
+    iov[1].buf = "cde";
+    iov[1].len = 3;
+    iov[2].buf = "f";
+    iov[2].len = 1;
+    while ((r = cs_put_iov(&cs, iov, 3)) == 1 && ++loops < 10)
+        ;
+    YAZ_CHECK_EQ(r, 0);
+    YAZ_CHECK_EQ(fake_put_calls, 6);
+    YAZ_CHECK(!strcmp(fake_put_data, "abcdef"));
+    YAZ_CHECK_EQ(cs.put_iov_next, 0);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
-    if (argc == 2)
+    if (argc == 2 && !strcmp(argv[1], "bench"))
+        tst_complete_bench(50 * 1024 * 1024, 1);
+    else if (argc == 2)
        comstack_example(argv[1]);
     tst_http_request();
     tst_http_response();
+    tst_complete_incremental();
+    tst_complete_bench(1024 * 1024, 1);
     tst_cs_get_host_args();
     tst_cs_get_error();
+    tst_cs_put_iov_f_put();
     YAZ_CHECK_TERM;
 }
 
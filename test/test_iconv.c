@@ -13,6 +13,8 @@
 #include <yaz/yaz-util.h>
 #include <yaz/test.h>
 #include <yaz/snprintf.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
 
 #define ESC "\x1b"
 #define UTF8_ACUTE "\xCC\x81"
@@ -518,6 +520,17 @@ static void tst_utf8_to_marc8(const char *marc8_type)
     /** Pure ASCII. 13 characters (sizeof(outbuf)+1) */
     YAZ_CHECK(tst_convert(cd, "Cours de math.", "Cours de math."));
 
+    /** ASCII run ending in base character of combining acute */
+    YAZ_CHECK(tst_convert(cd, "Cours de mathe" UTF8_ACUTE "matiques",
+                          "Cours de math\xE2" "ematiques"));
+
+    /** Second half of DOUBLE INVERTED BREVE follows first ASCII char */
+    YAZ_CHECK(tst_convert(cd, "\xCD\xA1" "abc", "\xEB" "a\xEC" "bc"));
+
+    /** ASCII after Hebrew: back to G0 ASCII */
+    YAZ_CHECK(tst_convert(cd, "\xD7\x90" "abc de",
+                          ESC "(2" "`" ESC "(B" "abc de"));
+
     /** UPPERCASE SCANDINAVIAN O */
     YAZ_CHECK(tst_convert(cd, "S" UTF8_OSLASH, "S\xa2"));
 
@@ -696,6 +709,100 @@ static void tst_utf8_codes(void)
     YAZ_CHECK(utf8_check(100000000));
 }
 
+/* yaz_utf8_check as a loop over yaz_read_UTF8_char */
+static int utf8_check_ref(const char *str)
+{
+    const unsigned char *inp = (const unsigned char *) str;
+    size_t inbytesleft = strlen(str);
+
+    while (inbytesleft)
+    {
+        int error = 0;
+        size_t no_read;
+        yaz_read_UTF8_char(inp, inbytesleft, &no_read, &error);
+        if (error)
+            return 0;
+        inp += no_read;
+        inbytesleft -= no_read;
+    }
+    return 1;
+}
+
+static void tst_utf8_check(void)
+{
+    static const unsigned char third[] = { 0x20, 0x80, 0x8f, 0x9f, 0xa0,
+                                           0xbf, 0xc0, 0xe0 };
+    const char *ascii = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char buf[50];
+    int b0, b1, k, prefix, fail = 0;
+
+    YAZ_CHECK(yaz_utf8_check(""));
+    YAZ_CHECK(yaz_utf8_check(ascii));
+    YAZ_CHECK(yaz_utf8_check("Cours de math" UTF8_eACUTE "matiques"));
+    YAZ_CHECK(yaz_utf8_check("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E"));
+    YAZ_CHECK(yaz_utf8_check("\xF0\x9D\x84\x9E abc"));
+    YAZ_CHECK(yaz_utf8_check("\xF8\x88\x80\x80\x80"));  /* 5 bytes */
+    YAZ_CHECK(!yaz_utf8_check("abc\xC0\x80"));             /* overlong */
+    YAZ_CHECK(!yaz_utf8_check("\xE0\x80\x80"));
+    YAZ_CHECK(!yaz_utf8_check("\xF0\x80\x80\x80"));
+    YAZ_CHECK(!yaz_utf8_check("0123456789abcdefghij\xE6\x97"));
+    YAZ_CHECK(!yaz_utf8_check("0123456789abcdefghij\xFF"));
+    YAZ_CHECK(!yaz_utf8_check("0123456789abcdefghij\x80"));
+
+    /* all two byte sequences with some third bytes, after a short
+       and long ASCII prefix, must be judged as yaz_read_UTF8_char does */
+    for (prefix = 0; prefix <= 20; prefix += 20)
+        for (b0 = 0x80; b0 < 0x100; b0++)
+            for (b1 = 1; b1 < 0x100; b1++)
+                for (k = 0; k < (int) sizeof(third); k++)
+                {
+                    memcpy(buf, ascii, prefix);
+                    buf[prefix] = b0;
+                    buf[prefix + 1] = b1;
+                    buf[prefix + 2] = third[k];
+                    buf[prefix + 3] = third[k] & 0xbf;
+                    strcpy(buf + prefix + 4, "xyz");
+                    if (yaz_utf8_check(buf) != utf8_check_ref(buf))
+                        fail++;
+                }
+    YAZ_CHECK_EQ(fail, 0);
+}
+
+static void tst_utf8_to_ucs4(const char *tocode, int be)
+{
+    const char *text = "0123456789abcdefghijklmnopqrstuvwxyz" UTF8_eACUTE;
+    char expect[200], outbuf0[200];
+    char *inbuf = (char *) text, *outbuf = outbuf0;
+    size_t inbytesleft = strlen(text), outbytesleft = sizeof(outbuf0);
+    size_t i, r;
+    yaz_iconv_t cd = yaz_iconv_open(tocode, "UTF-8");
+
+    YAZ_CHECK(cd);
+    if (!cd)
+        return;
+    memset(expect, 0, sizeof(expect));
+    for (i = 0; i < 36; i++)
+        expect[i * 4 + (be ? 3 : 0)] = text[i];
+    expect[i * 4 + (be ? 3 : 0)] = (char) 0xe9;
+    r = yaz_iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+    YAZ_CHECK(r != (size_t) (-1));
+    YAZ_CHECK_EQ(outbuf - outbuf0, 37 * 4);
+    YAZ_CHECK(!memcmp(outbuf0, expect, 37 * 4));
+
+    /* room for 5 characters only */
+    inbuf = (char *) text;
+    inbytesleft = strlen(text);
+    outbuf = outbuf0;
+    outbytesleft = 22;
+    r = yaz_iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+    YAZ_CHECK(r == (size_t) (-1));
+    YAZ_CHECK_EQ(yaz_iconv_error(cd), YAZ_ICONV_E2BIG);
+    YAZ_CHECK_EQ(outbuf - outbuf0, 20);
+    YAZ_CHECK_EQ(inbuf - text, 5);
+    YAZ_CHECK(!memcmp(outbuf0, expect, 20));
+    yaz_iconv_close(cd);
+}
+
 static void tst_danmarc_to_utf8(void)
 {
     yaz_iconv_t cd = yaz_iconv_open("utf-8", "danmarc");
@@ -834,12 +941,134 @@ static void tst_utf8_to_danmarc2(void)
     yaz_iconv_close(cd);
 }
 
+static void tst_bench_pair(const char *tocode, const char *fromcode,
+                           const char *in_buf, size_t in_len, int loops)
+{
+    yaz_iconv_t cd = yaz_iconv_open(tocode, fromcode);
+    yaz_timing_t t = yaz_timing_create();
+    char out_buf[8192];
+    size_t total = 0;
+    int i;
+
+    YAZ_CHECK(cd);
+    if (!cd)
+        return;
+    yaz_timing_start(t);
+    for (i = 0; i < loops; i++)
+    {
+        char *inbuf = (char *) in_buf;
+        size_t inbytesleft = in_len;
+        char *outbuf = out_buf;
+        size_t outbytesleft = sizeof(out_buf);
+        size_t r = yaz_iconv(cd, &inbuf, &inbytesleft,
+                             &outbuf, &outbytesleft);
+        if (r == (size_t) (-1))
+            break;
+        r = yaz_iconv(cd, 0, 0, &outbuf, &outbytesleft);
+        if (r == (size_t) (-1))
+            break;
+        total += in_len;
+    }
+    yaz_timing_stop(t);
+    YAZ_CHECK_EQ(i, loops);
+    yaz_log(YLOG_LOG, "%s -> %s %d x %d bytes: %f s", fromcode, tocode,
+            loops, (int) in_len, yaz_timing_get_real(t));
+    yaz_timing_destroy(&t);
+    yaz_iconv_close(cd);
+}
+
+static void tst_bench_utf8_check(const char *name, const char *unit,
+                                 int expect, int loops)
+{
+    yaz_timing_t t = yaz_timing_create();
+    char buf[2048];
+    size_t len = strlen(unit), total = 0;
+    int i, ok = 0;
+
+    /* 1 KB from unit; cut at a character boundary */
+    while (total + len < 1024)
+    {
+        memcpy(buf + total, unit, len);
+        total += len;
+    }
+    buf[total] = '\0';
+    if (!expect)
+        strcat(buf, "\xC0\x80");
+    yaz_timing_start(t);
+    for (i = 0; i < loops; i++)
+        ok += yaz_utf8_check(buf);
+    yaz_timing_stop(t);
+    YAZ_CHECK_EQ(ok, expect ? loops : 0);
+    yaz_log(YLOG_LOG, "yaz_utf8_check %s %d x %d bytes: %f s", name,
+            loops, (int) strlen(buf), yaz_timing_get_real(t));
+    yaz_timing_destroy(&t);
+}
+
+/* mostly ASCII, as in bibliographic records, with a few accents */
+static void tst_bench(int loops)
+{
+    const char *text_utf8 =
+        "Cours de mathe" UTF8_ACUTE "matiques. Paris : Dunod, 1998. "
+        "xii, 347 p. : ill. ; 24 cm. Includes bibliographical references "
+        "and index. Mathematics -- Study and teaching (Higher). "
+        "Algebra, Linear. Calculus. M" UTF8_DIAERESIS "uller, Hans.";
+    const char *text_marc8 =
+        "Cours de math\xE2" "ematiques. Paris : Dunod, 1998. "
+        "xii, 347 p. : ill. ; 24 cm. Includes bibliographical references "
+        "and index. Mathematics -- Study and teaching (Higher). "
+        "Algebra, Linear. Calculus. M\xE8" "uller, Hans.";
+    const char *text_latin1 =
+        "Cours de math\xE9matiques. Paris : Dunod, 1998. "
+        "xii, 347 p. : ill. ; 24 cm. Includes bibliographical references "
+        "and index. Mathematics -- Study and teaching (Higher). "
+        "Algebra, Linear. Calculus. M\xFCller, Hans.";
+    char buf[2048];
+    size_t len;
+
+    /* same text 8 times to get a reasonably large input */
+    len = strlen(text_utf8);
+    memcpy(buf, text_utf8, len);
+    memcpy(buf + len, buf, len);
+    memcpy(buf + 2 * len, buf, 2 * len);
+    memcpy(buf + 4 * len, buf, 4 * len);
+    tst_bench_pair("MARC8", "UTF-8", buf, 8 * len, loops);
+    tst_bench_pair("ISO-8859-1", "UTF-8", buf, 8 * len, loops);
+    tst_bench_pair("UTF-8", "UTF-8", buf, 8 * len, loops);
+    tst_bench_pair("UCS4", "UTF-8", buf, 8 * len, loops);
+
+    len = strlen(text_marc8);
+    memcpy(buf, text_marc8, len);
+    memcpy(buf + len, buf, len);
+    memcpy(buf + 2 * len, buf, 2 * len);
+    memcpy(buf + 4 * len, buf, 4 * len);
+    tst_bench_pair("UTF-8", "MARC8", buf, 8 * len, loops);
+
+    len = strlen(text_latin1);
+    memcpy(buf, text_latin1, len);
+    memcpy(buf + len, buf, len);
+    memcpy(buf + 2 * len, buf, 2 * len);
+    memcpy(buf + 4 * len, buf, 4 * len);
+    tst_bench_pair("UTF-8", "ISO-8859-1", buf, 8 * len, loops);
+
+    tst_bench_utf8_check("ASCII", "Mathematics -- Study and teaching. ",
+                         1, loops);
+    tst_bench_utf8_check("Latin", "M" UTF8_eACUTE "moires d" UTF8_eACUTE
+                         "partementaux. ", 1, loops);
+    tst_bench_utf8_check("CJK", "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E"
+                         "\xE3\x81\xAE\xE6\x9B\xB8\xE7\xB1\x8D", 1, loops);
+    tst_bench_utf8_check("invalid", "Mathematics -- Study and teaching. ",
+                         0, loops);
+}
 
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
 
     tst_utf8_codes();
+    tst_utf8_check();
+    tst_utf8_to_ucs4("UCS4", 1);
+    tst_utf8_to_ucs4("UCS4LE", 0);
 
     tst_marc8_to_utf8();
 
@@ -869,6 +1098,11 @@ int main (int argc, char **argv)
     dconvert(1, "UCS4LE");
     dconvert(0, "CP865");
 
+    if (argc == 2 && !strcmp(argv[1], "bench"))
+        tst_bench(100000);
+    else
+        tst_bench(10);
+
     YAZ_CHECK_TERM;
 }
 /*
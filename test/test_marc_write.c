@@ -0,0 +1,358 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests yaz_marc_t writers. Run with argument bench for records/s */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <yaz/marcdisp.h>
+#include <yaz/wrbuf.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
+#include <yaz/yaz-iconv.h>
+
+#include <yaz/test.h>
+
+static const char *leader = "00000nam a2200000 a 4500";
+
+static void set_leader(yaz_marc_t mt)
+{
+    int indicator_length, identifier_length, base_address;
+    int length_data_entry, length_starting, length_implementation;
+
+    yaz_marc_set_leader(mt, leader, &indicator_length, &identifier_length,
+                        &base_address, &length_data_entry,
+                        &length_starting, &length_implementation);
+}
+
+static void add_record(yaz_marc_t mt, int extra_fields)
+{
+    int i;
+
+    yaz_marc_reset(mt);
+    set_leader(mt);
+    yaz_marc_add_controlfield(mt, "001", "12345678", 8);
+    yaz_marc_add_controlfield(mt, "008", "980101s1998    fr", 17);
+    yaz_marc_add_datafield(mt, "245", "10", 2);
+    yaz_marc_add_subfield(mt, "aCours de math", 14);
+    yaz_marc_add_subfield(mt, "bParis & \"Lyon\"", 15);
+    yaz_marc_add_datafield(mt, "650", " 0", 2);
+    yaz_marc_add_subfield(mt, "aMathematics", 12);
+    for (i = 0; i < extra_fields; i++)
+    {
+        char data[40];
+        sprintf(data, "anote %d", i);
+        yaz_marc_add_datafield(mt, "500", "  ", 2);
+        yaz_marc_add_subfield(mt, data, strlen(data));
+        yaz_marc_add_subfield(mt, "5DK", 3);
+    }
+}
+
+static void tst_line(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF w = wrbuf_alloc();
+
+    add_record(mt, 0);
+    YAZ_CHECK_EQ(yaz_marc_write_line(mt, w), 0);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w),
+                      "00000nam a2200000 a 4500\n"
+                      "001 12345678\n"
+                      "008 980101s1998    fr\n"
+                      "245 10 $a Cours de math $b Paris & \"Lyon\"\n"
+                      "650  0 $a Mathematics\n"
+                      "\n"));
+
+    /* subfield before any datafield is ignored */
+    yaz_marc_reset(mt);
+    set_leader(mt);
+    yaz_marc_add_subfield(mt, "ax", 2);
+    yaz_marc_add_datafield(mt, "100", "1 ", 2);
+    yaz_marc_add_comment(mt, "comment");
+    yaz_marc_add_subfield(mt, "aName", 5);
+    wrbuf_rewind(w);
+    YAZ_CHECK_EQ(yaz_marc_write_line(mt, w), 0);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w),
+                      "00000nam a2200000 a 4500\n"
+                      "100 1  $a Name\n"
+                      "(comment)\n"
+                      "\n"));
+
+    /* no leader */
+    yaz_marc_reset(mt);
+    wrbuf_rewind(w);
+    YAZ_CHECK_EQ(yaz_marc_write_line(mt, w), -1);
+
+    wrbuf_destroy(w);
+    yaz_marc_destroy(mt);
+}
+
+static void tst_marcxml_json(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF w = wrbuf_alloc();
+
+    add_record(mt, 0);
+    YAZ_CHECK_EQ(yaz_marc_write_marcxml(mt, w), 0);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w),
+                      "<record xmlns=\"http://www.loc.gov/MARC21/slim\">\n"
+                      "  <leader>00000nam a2200000 a 4500</leader>\n"
+                      "  <controlfield tag=\"001\">12345678</controlfield>\n"
+                      "  <controlfield tag=\"008\">980101s1998    fr"
+                      "</controlfield>\n"
+                      "  <datafield tag=\"245\" ind1=\"1\" ind2=\"0\">\n"
+                      "    <subfield code=\"a\">Cours de math</subfield>\n"
+                      "    <subfield code=\"b\">Paris &amp; &quot;Lyon&quot;"
+                      "</subfield>\n"
+                      "  </datafield>\n"
+                      "  <datafield tag=\"650\" ind1=\" \" ind2=\"0\">\n"
+                      "    <subfield code=\"a\">Mathematics</subfield>\n"
+                      "  </datafield>\n"
+                      "</record>\n"));
+
+    wrbuf_rewind(w);
+    YAZ_CHECK_EQ(yaz_marc_write_json(mt, w), 0);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w),
+                      "{\n"
+                      "  \"leader\": \"00000nam a2200000 a 4500\",\n"
+                      "  \"fields\": [\n"
+                      "    {\n"
+                      "      \"001\": \"12345678\"\n"
+                      "    },\n"
+                      "    {\n"
+                      "      \"008\": \"980101s1998    fr\"\n"
+                      "    },\n"
+                      "    {\n"
+                      "      \"245\": {\n"
+                      "        \"subfields\": [\n"
+                      "          {\n"
+                      "            \"a\": \"Cours de math\"\n"
+                      "          },\n"
+                      "          {\n"
+                      "            \"b\": \"Paris & \\\"Lyon\\\"\"\n"
+                      "          }\n"
+                      "        ],\n"
+                      "        \"ind1\": \"1\",\n"
+                      "        \"ind2\": \"0\"\n"
+                      "      }\n"
+                      "    },\n"
+                      "    {\n"
+                      "      \"650\": {\n"
+                      "        \"subfields\": [\n"
+                      "          {\n"
+                      "            \"a\": \"Mathematics\"\n"
+                      "          }\n"
+                      "        ],\n"
+                      "        \"ind1\": \" \",\n"
+                      "        \"ind2\": \"0\"\n"
+                      "      }\n"
+                      "    }\n"
+                      "  ]\n"
+                      "}\n"));
+    wrbuf_destroy(w);
+    yaz_marc_destroy(mt);
+}
+
+/* many fields and subfields: record is written and read back the same */
+static void tst_iso2709(void)
+{
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF w1 = wrbuf_alloc();
+    WRBUF w2 = wrbuf_alloc();
+    WRBUF iso = wrbuf_alloc();
+    int r;
+
+    add_record(mt, 300);
+    YAZ_CHECK_EQ(yaz_marc_write_line(mt, w1), 0);
+    YAZ_CHECK(strstr(wrbuf_cstr(w1), "500    $a note 299 $5 DK\n"));
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, iso), 0);
+
+    r = yaz_marc_read_iso2709(mt, wrbuf_buf(iso), wrbuf_len(iso));
+    YAZ_CHECK_EQ(r, (int) wrbuf_len(iso));
+    YAZ_CHECK_EQ(yaz_marc_write_line(mt, w2), 0);
+    /* leader gets lengths from writer */
+    YAZ_CHECK_EQ(wrbuf_len(w1), wrbuf_len(w2));
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w1) + 24, wrbuf_cstr(w2) + 24));
+
+    wrbuf_destroy(iso);
+    wrbuf_destroy(w2);
+    wrbuf_destroy(w1);
+    yaz_marc_destroy(mt);
+}
+
+/* direct ISO2709 conversion gives same output as read + write */
+static int cmp_decode(yaz_marc_t mt, int mode, const char *buf, int len)
+{
+    WRBUF w1 = wrbuf_alloc();
+    WRBUF w2 = wrbuf_alloc();
+    int r1, r2, ret = 0;
+
+    yaz_marc_xml(mt, mode);
+    r1 = yaz_marc_transcode_wrbuf(mt, buf, len, w1);
+    r2 = yaz_marc_read_iso2709(mt, buf, len);
+    if (r2 > 0 && yaz_marc_write_mode(mt, w2))
+        r2 = -1;
+    if (r1 == r2 && !strcmp(wrbuf_cstr(w1), wrbuf_cstr(w2)))
+        ret = 1;
+    else
+        yaz_log(YLOG_WARN, "mode %d: r1=%d r2=%d\n%s\n%s", mode, r1, r2,
+                wrbuf_cstr(w1), wrbuf_cstr(w2));
+    wrbuf_destroy(w2);
+    wrbuf_destroy(w1);
+    return ret;
+}
+
+static void tst_transcode(void)
+{
+    static const int modes[] = { YAZ_MARC_MARCXML, YAZ_MARC_TURBOMARC,
+                                 YAZ_MARC_XCHANGE, YAZ_MARC_JSON, -1 };
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF iso = wrbuf_alloc();
+    WRBUF w = wrbuf_alloc();
+    yaz_iconv_t cd;
+    char *sep;
+    int i;
+
+    add_record(mt, 20);
+    yaz_marc_add_datafield(mt, "100", "1 ", 2);
+    yaz_marc_add_subfield(mt, "aM\xfcller <J>", 11);
+    yaz_marc_write_iso2709(mt, iso);
+    for (i = 0; modes[i] != -1; i++)
+        YAZ_CHECK(cmp_decode(mt, modes[i], wrbuf_buf(iso), wrbuf_len(iso)));
+
+    cd = yaz_iconv_open("utf-8", "iso-8859-1");
+    YAZ_CHECK(cd);
+    yaz_marc_iconv(mt, cd);
+    for (i = 0; modes[i] != -1; i++)
+        YAZ_CHECK(cmp_decode(mt, modes[i], wrbuf_buf(iso), wrbuf_len(iso)));
+    yaz_marc_leader_spec(mt, "09=b");
+    for (i = 0; modes[i] != -1; i++)
+        YAZ_CHECK(cmp_decode(mt, modes[i], wrbuf_buf(iso), wrbuf_len(iso)));
+    yaz_marc_leader_spec(mt, 0);
+    yaz_marc_iconv(mt, 0);
+    yaz_iconv_close(cd);
+
+    /* yaz_marc_decode_wrbuf keeps the record in the handle */
+    yaz_marc_xml(mt, YAZ_MARC_MARCXML);
+    YAZ_CHECK(yaz_marc_decode_wrbuf(mt, wrbuf_buf(iso), wrbuf_len(iso), w) > 0);
+    wrbuf_rewind(w);
+    YAZ_CHECK_EQ(yaz_marc_write_iso2709(mt, w), 0);
+    YAZ_CHECK_EQ(wrbuf_len(w), wrbuf_len(iso));
+    YAZ_CHECK(!memcmp(wrbuf_buf(w), wrbuf_buf(iso), wrbuf_len(iso)));
+    wrbuf_rewind(w);
+
+    /* collection start tag is written once */
+    yaz_marc_xml(mt, YAZ_MARC_MARCXML);
+    yaz_marc_enable_collection(mt);
+    YAZ_CHECK(yaz_marc_transcode_wrbuf(mt, wrbuf_buf(iso), wrbuf_len(iso), w) > 0);
+    YAZ_CHECK(yaz_marc_transcode_wrbuf(mt, wrbuf_buf(iso), wrbuf_len(iso), w) > 0);
+    yaz_marc_write_trailer(mt, w);
+    YAZ_CHECK(!strncmp(wrbuf_cstr(w), "<collection xmlns=", 18));
+    YAZ_CHECK(!strstr(wrbuf_cstr(w) + 1, "<collection"));
+    YAZ_CHECK(strstr(wrbuf_cstr(w), "</collection>\n"));
+    yaz_marc_destroy(mt);
+
+    /* separator in field: read with comments as before */
+    mt = yaz_marc_create();
+    sep = strstr(wrbuf_buf(iso), "note 3");
+    YAZ_CHECK(sep);
+    if (sep)
+        *sep = ISO2709_FS;
+    for (i = 0; modes[i] != -1; i++)
+        YAZ_CHECK(cmp_decode(mt, modes[i], wrbuf_buf(iso), wrbuf_len(iso)));
+    yaz_marc_xml(mt, YAZ_MARC_MARCXML);
+    wrbuf_rewind(w);
+    YAZ_CHECK(yaz_marc_transcode_wrbuf(mt, wrbuf_buf(iso), wrbuf_len(iso), w) > 0);
+    YAZ_CHECK(strstr(wrbuf_cstr(w), "<!-- Separator but not at end"));
+
+    /* bad length */
+    for (i = 0; modes[i] != -1; i++)
+        YAZ_CHECK(cmp_decode(mt, modes[i], wrbuf_buf(iso), 30));
+
+    wrbuf_destroy(w);
+    wrbuf_destroy(iso);
+    yaz_marc_destroy(mt);
+}
+
+static void tst_bench(int loops)
+{
+    static const char *formats[] = { "line", "marcxml", "turbomarc", "json",
+                                     "marc", 0 };
+    static const int modes[] = { YAZ_MARC_LINE, YAZ_MARC_MARCXML,
+                                 YAZ_MARC_TURBOMARC, YAZ_MARC_JSON,
+                                 YAZ_MARC_ISO2709 };
+    yaz_marc_t mt = yaz_marc_create();
+    WRBUF iso = wrbuf_alloc();
+    WRBUF w = wrbuf_alloc();
+    int i, j, k;
+
+    add_record(mt, 30);
+    yaz_marc_write_iso2709(mt, iso);
+    for (j = 0; formats[j]; j++)
+    {
+        /* k=0: yaz_marc_transcode_wrbuf, k=1: read into handle and write */
+        for (k = 0; k < 2; k++)
+        {
+            yaz_timing_t t = yaz_timing_create();
+            double real;
+            int ok = 0;
+
+            yaz_marc_xml(mt, modes[j]);
+            yaz_timing_start(t);
+            for (i = 0; i < loops; i++)
+            {
+                wrbuf_rewind(w);
+                if (k == 0)
+                {
+                    if (yaz_marc_transcode_wrbuf(mt, wrbuf_buf(iso),
+                                                 wrbuf_len(iso), w) > 0)
+                        ok++;
+                }
+                else if (yaz_marc_read_iso2709(mt, wrbuf_buf(iso),
+                                               wrbuf_len(iso)) > 0
+                         && yaz_marc_write_mode(mt, w) == 0)
+                    ok++;
+            }
+            yaz_timing_stop(t);
+            YAZ_CHECK_EQ(ok, loops);
+            real = yaz_timing_get_real(t);
+            yaz_log(YLOG_LOG, "iso2709 -> %s %s %d x %d bytes: %f s, "
+                    "%.0f records/s", formats[j], k ? "read+write" : "transcode",
+                    loops, (int) wrbuf_len(iso), real,
+                    real > 0.0 ? loops / real : 0.0);
+            yaz_timing_destroy(&t);
+        }
+    }
+    wrbuf_destroy(w);
+    wrbuf_destroy(iso);
+    yaz_marc_destroy(mt);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_line();
+    tst_marcxml_json();
+    tst_iso2709();
+    tst_transcode();
+    if (argc == 2 && !strcmp(argv[1], "bench"))
+        tst_bench(100000);
+    else
+        tst_bench(10);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
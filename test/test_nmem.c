@@ -69,8 +69,8 @@ void tst_nmem_malloc(void)
         char stat_buf[200];
         const char *exp = "<nmem>\n"
             "  <handles>1</handles>\n"
-            "  <blocks>41</blocks>\n"
-            "  <allocated>223264</allocated>\n"
+            "  <blocks>6</blocks>\n"
+            "  <allocated>258048</allocated>\n"
             "</nmem>\n";
 
         nmem_get_status(stat_buf, sizeof stat_buf);
@@ -181,11 +181,76 @@ void tst_nmem_printf(void)
     nmem_destroy(nmem);
 }
 
+void tst_nmem_reset(void)
+{
+    NMEM n = nmem_create();
+    char *cp1, *cp2;
+    char stat_buf[200];
+    const char *exp = "<nmem>\n"
+        "  <handles>1</handles>\n"
+        "  <blocks>1</blocks>\n"
+        "  <allocated>4096</allocated>\n"
+        "</nmem>\n";
+
+    cp1 = (char *) nmem_malloc(n, 10);
+    nmem_malloc(n, 5000);
+    nmem_malloc(n, 100000);
+    nmem_reset(n);
+    YAZ_CHECK_EQ(nmem_total(n), 0);
+
+    /* first block kept */
+    nmem_get_status(stat_buf, sizeof stat_buf);
+    YAZ_CHECK(strcmp(exp, stat_buf) == 0);
+    cp2 = (char *) nmem_malloc(n, 10);
+    YAZ_CHECK(cp1 == cp2);
+
+    nmem_destroy(n);
+
+    /* recycled block */
+    n = nmem_create();
+    cp1 = (char *) nmem_malloc(n, 10);
+    YAZ_CHECK(cp1 == cp2);
+    nmem_destroy(n);
+}
+
+void tst_nmem_growth(void)
+{
+    NMEM n = nmem_create();
+    char *cp1, *cp2, *cp3;
+    char stat_buf[200];
+    const char *exp = "<nmem>\n"
+        "  <handles>1</handles>\n"
+        "  <blocks>1</blocks>\n"
+        "  <allocated>131072</allocated>\n"
+        "</nmem>\n";
+
+    /* large allocation gets own block; current block is still used */
+    cp1 = (char *) nmem_malloc(n, 10);
+    cp2 = (char *) nmem_malloc(n, 100000);
+    cp3 = (char *) nmem_malloc(n, 10);
+    YAZ_CHECK(cp2);
+    YAZ_CHECK(cp3 > cp1 && cp3 < cp1 + 4096);
+    YAZ_CHECK_EQ(nmem_total(n), 100020);
+    nmem_destroy(n);
+
+    /* one block of 128K for 100000 bytes */
+    n = nmem_create_with_hint(100000);
+    nmem_get_status(stat_buf, sizeof stat_buf);
+    YAZ_CHECK(strcmp(exp, stat_buf) == 0);
+    while (nmem_total(n) < 100000)
+        nmem_malloc(n, 1000);
+    nmem_get_status(stat_buf, sizeof stat_buf);
+    YAZ_CHECK(strcmp(exp, stat_buf) == 0);
+    nmem_destroy(n);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
     tst_nmem_malloc();
+    tst_nmem_reset();
+    tst_nmem_growth();
     tst_nmem_strsplit();
     tst_nmem_printf();
     YAZ_CHECK_TERM;
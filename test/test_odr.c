@@ -7,7 +7,10 @@
 #endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <yaz/oid_util.h>
+#include <yaz/oid_db.h>
+#include <yaz/proto.h>
 #include "test_odrcodec.h"
 
 #include <yaz/test.h>
@@ -312,6 +315,178 @@ static void tst_berint64(ODR encode, ODR decode)
 #endif
 }
 
+static void tst_encode_sized(ODR encode, ODR decode)
+{
+    int i, ret;
+    char *ber_buf;
+    int ber_len;
+    char big[300];
+    char small_buf[64];
+    ODR fixed;
+    Yc_MySequence *s = (Yc_MySequence *) odr_malloc(encode, sizeof(*s));
+    Yc_MySequence *t;
+
+    memset(big, 'x', sizeof(big));
+    s->first = odr_intdup(encode, 12345);
+    s->second = (Odr_oct *) odr_malloc(encode, sizeof(*s->second));
+    s->second->buf = big;
+    s->second->len = sizeof(big);
+    s->third = odr_booldup(encode, 1);
+    s->fourth = odr_nullval();
+    s->fifth = odr_intdup(encode, YC_MySequence_enum1);
+    s->myoid = odr_getoidbystr(encode, MYOID);
+
+    for (i = 0; i < 3; i++)
+    {   /* same stream more than once */
+        ret = odr_encode_sized(encode, (Odr_fun) yc_MySequence, &s, 0);
+        YAZ_CHECK(ret);
+        if (!ret)
+            return;
+        ber_buf = odr_getbuf(encode, &ber_len, 0);
+        /* SEQUENCE with definite long form length of 2 octets */
+        YAZ_CHECK_EQ((unsigned char) ber_buf[0], 0x30);
+        YAZ_CHECK_EQ((unsigned char) ber_buf[1], 0x82);
+        YAZ_CHECK_EQ(((unsigned char) ber_buf[2] << 8) +
+                     (unsigned char) ber_buf[3], ber_len - 4);
+        YAZ_CHECK_EQ(completeBER_n(ber_buf, ber_len, 0),
+                     ber_len);
+
+        odr_setbuf(decode, ber_buf, ber_len, 0);
+        ret = yc_MySequence(decode, &t, 0, 0);
+        YAZ_CHECK(ret);
+        if (!ret)
+            return;
+        YAZ_CHECK(t->first && *t->first == 12345);
+        YAZ_CHECK(t->second && t->second->len == sizeof(big) &&
+                  memcmp(t->second->buf, big, sizeof(big)) == 0);
+        YAZ_CHECK(t->myoid);
+        odr_reset(decode);
+    }
+
+    /* fixed buffer too small */
+    fixed = odr_createmem(ODR_ENCODE);
+    odr_setbuf(fixed, small_buf, sizeof(small_buf), 0);
+    ret = odr_encode_sized(fixed, (Odr_fun) yc_MySequence, &s, 0);
+    YAZ_CHECK(!ret);
+    YAZ_CHECK_EQ(odr_geterror(fixed), OSPACE);
+    odr_destroy(fixed);
+    odr_reset(encode);
+}
+
+static void tst_lazy_external(ODR encode, ODR decode)
+{
+    int ret;
+    char *ber_buf;
+    int ber_len;
+    Z_External *ext = (Z_External *) odr_malloc(encode, sizeof(*ext));
+    Z_OPACRecord *opac = (Z_OPACRecord *) odr_malloc(encode, sizeof(*opac));
+    Z_External *t;
+    NMEM nmem;
+
+    opac->bibliographicRecord = z_ext_record_usmarc(encode, "marc", 4);
+    opac->num_holdingsData = 0;
+    opac->holdingsData = 0;
+    ext->direct_reference = odr_oiddup(encode, yaz_oid_recsyn_opac);
+    ext->indirect_reference = 0;
+    ext->descriptor = 0;
+    ext->which = Z_External_OPAC;
+    ext->u.opac = opac;
+
+    ret = z_External(encode, &ext, 0, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    ber_buf = odr_getbuf(encode, &ber_len, 0);
+
+    /* usual decoding */
+    odr_setbuf(decode, ber_buf, ber_len, 0);
+    ret = z_External(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    YAZ_CHECK(ret && t->which == Z_External_OPAC);
+    odr_reset(decode);
+
+    /* lazy decoding: OPAC record left as BER */
+    odr_set_lazy(decode, 1);
+    YAZ_CHECK_EQ(odr_get_lazy(decode), 1);
+    odr_setbuf(decode, ber_buf, ber_len, 0);
+    ret = z_External(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    if (ret)
+    {
+        YAZ_CHECK_EQ(t->which, Z_External_single);
+        nmem = nmem_create();
+        YAZ_CHECK(z_External_resolve(nmem, t));
+        YAZ_CHECK_EQ(t->which, Z_External_OPAC);
+        YAZ_CHECK(t->u.opac->bibliographicRecord &&
+                  t->u.opac->bibliographicRecord->which == Z_External_octet &&
+                  t->u.opac->bibliographicRecord->u.octet_aligned->len == 4);
+        /* already decoded: nothing to do */
+        YAZ_CHECK(z_External_resolve(nmem, t));
+        YAZ_CHECK_EQ(t->which, Z_External_OPAC);
+        nmem_destroy(nmem);
+    }
+    odr_set_lazy(decode, 0);
+    odr_reset(decode);
+    odr_reset(encode);
+}
+
+static void tst_borrow(ODR encode, ODR decode)
+{
+    int ret;
+    char *ber_buf, *buf;
+    int ber_len;
+    Z_External *ext = z_ext_record_usmarc(encode, "00024marc", 9);
+    Z_External *t;
+    NMEM nmem;
+
+    ret = z_External(encode, &ext, 0, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    ber_buf = odr_getbuf(encode, &ber_len, 0);
+
+    /* octets refer to decode buffer */
+    odr_set_borrow(decode, 1);
+    YAZ_CHECK_EQ(odr_get_borrow(decode), 1);
+    odr_setbuf(decode, ber_buf, ber_len, 0);
+    ret = z_External(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    if (ret)
+    {
+        Odr_oct *oct = t->u.octet_aligned;
+        YAZ_CHECK_EQ(t->which, Z_External_octet);
+        YAZ_CHECK(oct->buf > ber_buf &&
+                  oct->buf + oct->len <= ber_buf + ber_len);
+        YAZ_CHECK(oct->len == 9 && !memcmp(oct->buf, "00024marc", 9));
+
+        nmem = nmem_create();
+        odr_oct_detach(nmem, oct);
+        YAZ_CHECK(oct->buf < ber_buf || oct->buf >= ber_buf + ber_len);
+        YAZ_CHECK(oct->len == 9 && !strcmp(oct->buf, "00024marc"));
+        nmem_destroy(nmem);
+    }
+    odr_reset(decode);
+
+    /* decode stream owns buffer given by odr_setbuf_adopt */
+    buf = (char *) xmalloc(ber_len);
+    memcpy(buf, ber_buf, ber_len);
+    odr_setbuf_adopt(decode, buf, ber_len);
+    ret = z_External(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    if (ret)
+    {
+        YAZ_CHECK(t->u.octet_aligned->buf > buf);
+        nmem = odr_extract_mem(decode);
+        /* data still valid when decode is reset */
+        odr_reset(decode);
+        YAZ_CHECK(!memcmp(t->u.octet_aligned->buf, "00024marc", 9));
+        nmem_destroy(nmem);
+    }
+    odr_set_borrow(decode, 0);
+    odr_reset(decode);
+    odr_reset(encode);
+}
+
 static void tst(void)
 {
     ODR odr_encode = odr_createmem(ODR_ENCODE);
@@ -327,6 +502,10 @@ static void tst(void)
     tst_berint32(odr_encode, odr_decode);
     tst_berint64(odr_encode, odr_decode);
 
+    tst_encode_sized(odr_encode, odr_decode);
+    tst_lazy_external(odr_encode, odr_decode);
+    tst_borrow(odr_encode, odr_decode);
+
     odr_destroy(odr_encode);
     odr_destroy(odr_decode);
 }
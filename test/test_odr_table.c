@@ -0,0 +1,309 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Compares the regular Z39.50 codecs of libyaz (z_) with table driven
+   codecs generated by yaz-asncomp -t (zt_, test_ztable.c), and checks
+   the table driven ILL codecs of libyaz. Run with argument bench for a
+   throughput comparison. */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <yaz/proto.h>
+#include <yaz/oid_db.h>
+#include <yaz/pquery.h>
+#include <yaz/ill.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
+#include "test_ztable.h"
+
+#include <yaz/test.h>
+
+static Z_APDU *search_request(ODR o)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_searchRequest);
+    Z_SearchRequest *req = apdu->u.searchRequest;
+
+    req->num_databaseNames = 1;
+    req->databaseNames = (char **) odr_malloc(o, sizeof(char *));
+    req->databaseNames[0] = odr_strdup(o, "Default");
+    req->preferredRecordSyntax = odr_oiddup(o, yaz_oid_recsyn_usmarc);
+    req->query = (Z_Query *) odr_malloc(o, sizeof(*req->query));
+    req->query->which = Z_Query_type_1;
+    req->query->u.type_1 = p_query_rpn(
+        o, "@and @attr 1=4 computer @or @attr 1=1003 knuth "
+        "@attr 1=1003 @attr 5=1 dijkstra");
+    return apdu;
+}
+
+static Z_APDU *present_response(ODR o, int num)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_presentResponse);
+    Z_PresentResponse *res = apdu->u.presentResponse;
+    Z_NamePlusRecordList *list = (Z_NamePlusRecordList *)
+        odr_malloc(o, sizeof(*list));
+    char rec[800];
+    int i;
+
+    memset(rec, 'x', sizeof(rec));
+    list->num_records = num;
+    list->records = (Z_NamePlusRecord **)
+        odr_malloc(o, num * sizeof(*list->records));
+    for (i = 0; i < num; i++)
+    {
+        Z_NamePlusRecord *npr = (Z_NamePlusRecord *)
+            odr_malloc(o, sizeof(*npr));
+        npr->databaseName = odr_strdup(o, "Default");
+        npr->which = Z_NamePlusRecord_databaseRecord;
+        npr->u.databaseRecord = z_ext_record_usmarc(o, rec, sizeof(rec));
+        list->records[i] = npr;
+    }
+    res->records = (Z_Records *) odr_malloc(o, sizeof(*res->records));
+    res->records->which = Z_Records_DBOSD;
+    res->records->u.databaseOrSurDiagnostics = list;
+    *res->numberOfRecordsReturned = num;
+    *res->nextResultSetPosition = num + 1;
+    return apdu;
+}
+
+static Z_APDU *scan_response(ODR o, int num)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_scanResponse);
+    Z_ScanResponse *res = apdu->u.scanResponse;
+    Z_ListEntries *ent = (Z_ListEntries *) odr_malloc(o, sizeof(*ent));
+    int i;
+
+    ent->num_entries = num;
+    ent->entries = (Z_Entry **) odr_malloc(o, num * sizeof(*ent->entries));
+    ent->num_nonsurrogateDiagnostics = 0;
+    ent->nonsurrogateDiagnostics = 0;
+    for (i = 0; i < num; i++)
+    {
+        char term[20];
+        Z_TermInfo *t = (Z_TermInfo *) odr_malloc(o, sizeof(*t));
+
+        memset(t, 0, sizeof(*t));
+        sprintf(term, "term%05d", i);
+        t->term = (Z_Term *) odr_malloc(o, sizeof(*t->term));
+        t->term->which = Z_Term_general;
+        t->term->u.general = odr_create_Odr_oct(o, term, strlen(term));
+        t->globalOccurrences = odr_intdup(o, i + 1);
+        ent->entries[i] = (Z_Entry *) odr_malloc(o, sizeof(Z_Entry));
+        ent->entries[i]->which = Z_Entry_termInfo;
+        ent->entries[i]->u.termInfo = t;
+    }
+    res->entries = ent;
+    *res->numberOfEntriesReturned = num;
+    return apdu;
+}
+
+static void tst_apdu(const char *what, Z_APDU *apdu, int loops)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    char *buf, *tbuf;
+    int len, tlen, i, r = 1;
+    Z_APDU *apdu_d;
+    Zt_APDU *tapdu = (Zt_APDU *) apdu;
+    yaz_timing_t t = yaz_timing_create();
+
+    /* encoding is the same */
+    YAZ_CHECK(z_APDU(enc, &apdu, 0, 0));
+    buf = odr_getbuf(enc, &len, 0);
+    odr_setbuf(enc, 0, 0, 1);
+    YAZ_CHECK(zt_APDU(enc, &tapdu, 0, 0));
+    tbuf = odr_getbuf(enc, &tlen, 0);
+    YAZ_CHECK_EQ(len, tlen);
+    YAZ_CHECK(len == tlen && memcmp(buf, tbuf, len) == 0);
+    odr_reset(enc);
+
+    /* decoding is the same: re-encode table decoded APDU */
+    odr_setbuf(dec, buf, len, 0);
+    YAZ_CHECK(zt_APDU(dec, &tapdu, 0, 0));
+    apdu_d = (Z_APDU *) tapdu;
+    YAZ_CHECK(z_APDU(enc, &apdu_d, 0, 0));
+    tbuf = odr_getbuf(enc, &tlen, 0);
+    YAZ_CHECK(len == tlen && memcmp(buf, tbuf, len) == 0);
+    odr_reset(enc);
+    odr_reset(dec);
+
+    yaz_timing_start(t);
+    for (i = 0; r && i < loops; i++)
+    {
+        r = z_APDU(enc, &apdu, 0, 0);
+        odr_reset(enc);
+        odr_setbuf(dec, buf, len, 0);
+        r = r && z_APDU(dec, &apdu_d, 0, 0);
+        odr_reset(dec);
+    }
+    yaz_timing_stop(t);
+    YAZ_CHECK(r);
+    yaz_log(YLOG_LOG, "%s %d bytes x %d: %f s", what, len, loops,
+            yaz_timing_get_real(t));
+
+    tapdu = (Zt_APDU *) apdu;
+    yaz_timing_start(t);
+    for (i = 0; r && i < loops; i++)
+    {
+        r = zt_APDU(enc, &tapdu, 0, 0);
+        odr_reset(enc);
+        odr_setbuf(dec, buf, len, 0);
+        r = r && zt_APDU(dec, &tapdu, 0, 0);
+        tapdu = (Zt_APDU *) apdu;
+        odr_reset(dec);
+    }
+    yaz_timing_stop(t);
+    YAZ_CHECK(r);
+    yaz_log(YLOG_LOG, "%s %d bytes x %d table: %f s", what, len, loops,
+            yaz_timing_get_real(t));
+
+    yaz_timing_destroy(&t);
+    xfree(buf);
+    odr_destroy(enc);
+    odr_destroy(dec);
+}
+
+/* elements for ill_get_APDU and ill_get_ItemRequest */
+static const char *ill_elements[] = {
+    "ill,transaction-id,initial-requester-id,"
+    "person-or-institution-symbol,institution", "INST1",
+    "ill,transaction-id,transaction-group-qualifier", "group",
+    "ill,transaction-id,transaction-qualifier", "12345",
+    "ill,requester-id,person-or-institution-symbol,person", "someone",
+    "ill,responder-id,name-of-person-or-institution,name-of-institution",
+    "Library",
+    "ill,service-date-time,this,time", "120000",
+    "ill,service-date-time,original,date", "19991231",
+    "ill,item-id,item-type", "2",
+    "ill,item-id,title", "Semantics of programming languages",
+    "ill,item-id,author", "Knuth",
+    "ill,item-id,publication-date", "1968",
+    "ill,item-id,iSBN", "0201038013",
+    "ill,client-id,client-name", "client",
+    "ill,requester-note", "note",
+    "ill,retry-flag", "1",
+    "ill,search-type,level-of-service", "x",
+    "ill,search-type,need-before-date", "20001201",
+    0, 0
+};
+
+static const char *ill_element(void *clientData, const char *element)
+{
+    int i;
+
+    for (i = 0; ill_elements[i]; i += 2)
+        if (!strcmp(ill_elements[i], element))
+            return ill_elements[i + 1];
+    return 0;
+}
+
+/* checks encoding against BER of the regular (non-table) codecs, and
+   that decoding it gives the same BER again */
+static void tst_ill_codec(Odr_fun fun, void *p, const char *ber, int ber_len)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    ODR dec = odr_createmem(ODR_DECODE);
+    char *buf;
+    int len;
+    void *p_d = 0;
+
+    YAZ_CHECK((*fun)(enc, (char **) &p, 0, 0));
+    buf = odr_getbuf(enc, &len, 0);
+    YAZ_CHECK_EQ(len, ber_len);
+    YAZ_CHECK(len == ber_len && memcmp(buf, ber, len) == 0);
+    odr_reset(enc);
+
+    odr_setbuf(dec, (char *) ber, ber_len, 0);
+    YAZ_CHECK((*fun)(dec, (char **) &p_d, 0, 0));
+    YAZ_CHECK((*fun)(enc, (char **) &p_d, 0, 0));
+    buf = odr_getbuf(enc, &len, 0);
+    YAZ_CHECK(len == ber_len && memcmp(buf, ber, len) == 0);
+    odr_destroy(enc);
+    odr_destroy(dec);
+}
+
+/* ILL codecs of libyaz are table driven */
+static void tst_ill(void)
+{
+    static const char apdu_ber[] =
+        "\x61\x80\x30\x80\x80\x01\x02\xa1\x1f\xa0\x0b\xa0\x09\xa1\x07\x1b"
+        "\x05\x49\x4e\x53\x54\x31\xa1\x07\x1b\x05\x67\x72\x6f\x75\x70\xa2"
+        "\x07\x1b\x05\x31\x32\x33\x34\x35\xa2\x20\xa0\x12\x80\x08\x32\x30"
+        "\x30\x30\x30\x31\x30\x31\x81\x06\x31\x32\x30\x30\x30\x30\xa1\x0a"
+        "\x80\x08\x31\x39\x39\x39\x31\x32\x33\x31\xa3\x0d\xa0\x0b\xa0\x09"
+        "\x1b\x07\x73\x6f\x6d\x65\x6f\x6e\x65\xa4\x0d\xa1\x0b\xa1\x09\x1b"
+        "\x07\x4c\x69\x62\x72\x61\x72\x79\x85\x01\x01\xa6\x04\xa0\x00\xa1"
+        "\x00\xa8\x04\xa0\x00\xa1\x00\xa9\x03\x0a\x01\x02\xab\x0c\x80\x01"
+        "\x00\x81\x01\x00\x82\x01\x01\x83\x01\x01\xac\x12\xa0\x03\x1b\x01"
+        "\x78\x81\x08\x32\x30\x30\x30\x31\x32\x30\x31\x82\x01\x03\x8e\x01"
+        "\x03\xaf\x0a\xa0\x08\x1b\x06\x63\x6c\x69\x65\x6e\x74\xb0\x3a\x80"
+        "\x01\x02\xa3\x07\x1b\x05\x4b\x6e\x75\x74\x68\xa4\x24\x1b\x22\x53"
+        "\x65\x6d\x61\x6e\x74\x69\x63\x73\x20\x6f\x66\x20\x70\x72\x6f\x67"
+        "\x72\x61\x6d\x6d\x69\x6e\x67\x20\x6c\x61\x6e\x67\x75\x61\x67\x65"
+        "\x73\xac\x06\x1b\x04\x31\x39\x36\x38\x95\x01\x01\x96\x01\x00\xbf"
+        "\x2e\x06\x1b\x04\x6e\x6f\x74\x65\x00\x00\x00\x00";
+    static const char item_request_ber[] =
+        "\x30\x80\x80\x01\x02\xa1\x1f\xa0\x0b\xa0\x09\xa1\x07\x1b\x05\x49"
+        "\x4e\x53\x54\x31\xa1\x07\x1b\x05\x67\x72\x6f\x75\x70\xa2\x07\x1b"
+        "\x05\x31\x32\x33\x34\x35\xa2\x20\xa0\x12\x80\x08\x32\x30\x30\x30"
+        "\x30\x31\x30\x31\x81\x06\x31\x32\x30\x30\x30\x30\xa1\x0a\x80\x08"
+        "\x31\x39\x39\x39\x31\x32\x33\x31\xa3\x0d\xa0\x0b\xa0\x09\x1b\x07"
+        "\x73\x6f\x6d\x65\x6f\x6e\x65\xa4\x0d\xa1\x0b\xa1\x09\x1b\x07\x4c"
+        "\x69\x62\x72\x61\x72\x79\x85\x01\x01\xa6\x04\xa0\x00\xa1\x00\xa8"
+        "\x04\xa0\x00\xa1\x00\xa9\x03\x0a\x01\x02\xab\x0c\x80\x01\x00\x81"
+        "\x01\x00\x82\x01\x01\x83\x01\x01\xac\x12\xa0\x03\x1b\x01\x78\x81"
+        "\x08\x32\x30\x30\x30\x31\x32\x30\x31\x82\x01\x03\x8e\x01\x03\xaf"
+        "\x0a\xa0\x08\x1b\x06\x63\x6c\x69\x65\x6e\x74\xb0\x3a\x80\x01\x02"
+        "\xa3\x07\x1b\x05\x4b\x6e\x75\x74\x68\xa4\x24\x1b\x22\x53\x65\x6d"
+        "\x61\x6e\x74\x69\x63\x73\x20\x6f\x66\x20\x70\x72\x6f\x67\x72\x61"
+        "\x6d\x6d\x69\x6e\x67\x20\x6c\x61\x6e\x67\x75\x61\x67\x65\x73\xac"
+        "\x06\x1b\x04\x31\x39\x36\x38\x95\x01\x01\x96\x01\x00\xbf\x2e\x06"
+        "\x1b\x04\x6e\x6f\x74\x65\x00\x00";
+    ODR o = odr_createmem(ODR_ENCODE);
+    struct ill_get_ctl ctl;
+
+    ctl.odr = o;
+    ctl.clientData = 0;
+    ctl.f = ill_element;
+    tst_ill_codec((Odr_fun) ill_APDU, ill_get_APDU(&ctl, "ill", 0),
+                  apdu_ber, sizeof(apdu_ber) - 1);
+    tst_ill_codec((Odr_fun) ill_ItemRequest,
+                  ill_get_ItemRequest(&ctl, "ill", 0),
+                  item_request_ber, sizeof(item_request_ber) - 1);
+    odr_destroy(o);
+}
+
+static void tst(int loops)
+{
+    ODR o = odr_createmem(ODR_ENCODE);
+
+    tst_apdu("searchRequest", search_request(o), loops * 10);
+    tst_apdu("presentResponse", present_response(o, 50), loops);
+    tst_apdu("scanResponse", scan_response(o, 50), loops);
+    odr_destroy(o);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_ill();
+    if (argc == 2 && !strcmp(argv[1], "bench"))
+        tst(20000);
+    else
+        tst(10);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
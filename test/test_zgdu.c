@@ -108,6 +108,45 @@ static void tst_http_response(void)
     odr_destroy(dec);
 }
 
+static void tst_http_response_head(void)
+{
+    ODR enc = odr_createmem(ODR_ENCODE);
+    Z_GDU *zgdu = z_get_HTTP_Response_server(enc, 200, 0, "test", 0);
+    Z_HTTP_Response *hres = zgdu->u.HTTP_Response;
+    char body[] = "0123456789";
+    char small_buf[20];
+    char *http_buf1;
+    int http_len1;
+    const char *http_buf2 =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 10\r\n" /* body is sent separately */
+        "Server: test\r\n"
+        "\r\n";
+
+    hres->content_buf = body;
+    hres->content_len = 10;
+    YAZ_CHECK_EQ(yaz_encode_http_response_head(enc, hres), 1);
+    http_buf1 = odr_getbuf(enc, &http_len1, 0);
+    YAZ_CHECK(http_len1 == strlen(http_buf2) &&
+              memcmp(http_buf1, http_buf2, http_len1) == 0);
+    YAZ_CHECK(hres->content_buf == body);
+    YAZ_CHECK_EQ(hres->content_len, 10);
+
+    /* encode failure leaves response as it was */
+    odr_setbuf(enc, small_buf, sizeof(small_buf), 0);
+    YAZ_CHECK_EQ(yaz_encode_http_response_head(enc, hres), 0);
+    YAZ_CHECK(hres->content_buf == body);
+    YAZ_CHECK_EQ(hres->content_len, 10);
+
+    /* so the complete response may still be encoded */
+    odr_setbuf(enc, 0, 0, 1);
+    YAZ_CHECK(z_GDU(enc, &zgdu, 0, 0));
+    http_buf1 = odr_getbuf(enc, &http_len1, 0);
+    YAZ_CHECK(http_len1 == strlen(http_buf2) + 10 &&
+              memcmp(http_buf1 + strlen(http_buf2), body, 10) == 0);
+    odr_destroy(enc);
+}
+
 static void tst_double_encoding(const char *buf_in, const char *buf_out, int request_type)
 {
     Z_GDU *zgdu;
@@ -144,6 +183,7 @@ int main (int argc, char **argv)
     YAZ_CHECK_LOG();
     tst_yaz_decode_http_response_first();
     tst_http_response();
+    tst_http_response_head();
     tst_double_encoding("POST / HTTP/1.1\r\n"
                         "Transfer-Encoding: chunked\r\n"
                         "\r\n"
@@ -0,0 +1,266 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests ZOOM event sets against a local Z39.50 server */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <yaz/gettimeofday.h>
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include "zoom-p.h"
+#include "test_zoom_server.h"
+
+#include <yaz/test.h>
+
+#define WAIT_MSEC 5000
+
+static ZOOM_connection search_async(int port, const char *timeout,
+                                    ZOOM_resultset *r)
+{
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection c;
+    char host[40];
+
+    ZOOM_options_set(o, "async", "1");
+    ZOOM_options_set(o, "timeout", timeout);
+    c = ZOOM_connection_create(o);
+    ZOOM_options_destroy(o);
+    sprintf(host, "tcp:localhost:%d", port);
+    ZOOM_connection_connect(c, host, 0);
+    *r = ZOOM_connection_search_pqf(c, "x");
+    return c;
+}
+
+/* processes events until none are pending. Returns 1 if so, 0 if
+   nothing happened within WAIT_MSEC or event of c_gone was returned */
+static int run_set(ZOOM_event_set es, int max, ZOOM_connection c_gone)
+{
+    ZOOM_connection cs[4];
+    int events[4];
+
+    while (1)
+    {
+        int i, n = ZOOM_event_set_wait(es, max, cs, events, WAIT_MSEC);
+        if (n == 0)
+            return 1;
+        if (n < 0)
+            return 0;
+        for (i = 0; i < n; i++)
+            if (cs[i] == c_gone)
+                return 0;
+    }
+}
+
+static void tst_add_remove(int port)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_connection c[4], cs[1], c_gone;
+    ZOOM_resultset r[4], r_gone;
+    int i, n;
+
+    for (i = 0; i < 3; i++)
+    {
+        c[i] = search_async(port, "30", r + i);
+        YAZ_CHECK_EQ(ZOOM_event_set_add(es, c[i]), 0);
+    }
+    YAZ_CHECK_EQ(ZOOM_event_set_add(es, c[0]), -1);
+
+    /* remove connection that is ready and add one while events remain */
+    n = ZOOM_event_set_wait(es, 1, cs, 0, WAIT_MSEC);
+    YAZ_CHECK_EQ(n, 1);
+    i = cs[0] == c[1] ? 2 : 1;
+    c_gone = c[i];
+    r_gone = r[i];
+    ZOOM_event_set_remove(es, c_gone);
+    YAZ_CHECK(!c_gone->event_entry);
+    c[3] = search_async(port, "30", r + 3);
+    YAZ_CHECK_EQ(ZOOM_event_set_add(es, c[3]), 0);
+    YAZ_CHECK(run_set(es, 4, c_gone));
+    for (i = 0; i < 4; i++)
+        if (c[i] != c_gone)
+        {
+            YAZ_CHECK_EQ(ZOOM_connection_errcode(c[i]), 0);
+            YAZ_CHECK_EQ(ZOOM_resultset_size(r[i]), 5);
+        }
+
+    /* removed connection is still usable on its own */
+    while (ZOOM_event(1, &c_gone))
+        ;
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r_gone), 5);
+
+    ZOOM_event_set_destroy(es);
+    for (i = 0; i < 4; i++)
+    {
+        YAZ_CHECK(!c[i]->event_entry);
+        ZOOM_resultset_destroy(r[i]);
+        ZOOM_connection_destroy(c[i]);
+    }
+}
+
+static void tst_timer(int port, int port_silent)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_resultset r, r_silent;
+    ZOOM_connection c = search_async(port, "1", &r);
+    ZOOM_connection c_silent = search_async(port_silent, "1", &r_silent);
+    struct timeval start, end;
+    double elapsed;
+
+    yaz_gettimeofday(&start);
+    ZOOM_event_set_add(es, c);
+    ZOOM_event_set_add(es, c_silent);
+    YAZ_CHECK(run_set(es, 4, 0));
+    yaz_gettimeofday(&end);
+    elapsed = end.tv_sec - start.tv_sec
+        + (end.tv_usec - start.tv_usec) / 1e6;
+    YAZ_CHECK(elapsed >= 0.9);
+    YAZ_CHECK(elapsed < 4.0);
+
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 5);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c_silent), ZOOM_ERROR_TIMEOUT);
+
+    ZOOM_event_set_destroy(es);
+    ZOOM_resultset_destroy(r);
+    ZOOM_resultset_destroy(r_silent);
+    ZOOM_connection_destroy(c);
+    ZOOM_connection_destroy(c_silent);
+}
+
+/* server closes after Init and Search; second search reconnects */
+static void tst_reconnect(int port_close, test_zoom_server_t s_close)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_resultset r;
+    ZOOM_connection c = search_async(port_close, "30", &r);
+    int serial;
+
+    ZOOM_event_set_add(es, c);
+    YAZ_CHECK(run_set(es, 4, 0));
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 5);
+    YAZ_CHECK_EQ(test_zoom_server_accepts(s_close), 1);
+    serial = c->cs_serial;
+
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_connect(c, 0, 0);
+    r = ZOOM_connection_search_pqf(c, "y");
+    YAZ_CHECK(run_set(es, 4, 0));
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 5);
+    YAZ_CHECK(c->cs_serial != serial);
+    YAZ_CHECK_EQ(test_zoom_server_accepts(s_close), 2);
+
+    ZOOM_event_set_destroy(es);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+}
+
+/* connection closed while waiting and connected to another server. Its
+   new socket may get the descriptor of the old one */
+static void tst_connect_again(int port, int port_silent)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_resultset r;
+    ZOOM_connection c = search_async(port_silent, "30", &r);
+    ZOOM_connection cs[1];
+    char host[40];
+    int serial;
+
+    ZOOM_event_set_add(es, c);
+    while (ZOOM_event_set_wait(es, 1, cs, 0, 200) > 0)
+        ;
+    YAZ_CHECK(c->cs);
+    serial = c->cs_serial;
+
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_close(c);
+    sprintf(host, "tcp:localhost:%d", port);
+    ZOOM_connection_connect(c, host, 0);
+    r = ZOOM_connection_search_pqf(c, "x");
+    YAZ_CHECK(run_set(es, 4, 0));
+    YAZ_CHECK(c->cs_serial != serial);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 5);
+
+    ZOOM_event_set_destroy(es);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+}
+
+static void tst_destroy(int port)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_resultset r1, r2, r3;
+    ZOOM_connection c1 = search_async(port, "30", &r1);
+    ZOOM_connection c2 = search_async(port, "30", &r2);
+    ZOOM_connection c3 = search_async(port, "30", &r3);
+    ZOOM_connection cs[1];
+
+    ZOOM_event_set_add(es, c1);
+    ZOOM_event_set_add(es, c2);
+    ZOOM_event_set_add(es, c3);
+    YAZ_CHECK_EQ(ZOOM_event_set_wait(es, 1, cs, 0, WAIT_MSEC), 1);
+
+    /* destroyed connections leave the set, ready or waiting */
+    ZOOM_resultset_destroy(r1);
+    ZOOM_connection_destroy(c1);
+    ZOOM_resultset_destroy(r2);
+    ZOOM_connection_destroy(c2);
+    YAZ_CHECK(run_set(es, 4, 0));
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c3), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r3), 5);
+
+    /* connection outlives its set */
+    ZOOM_event_set_destroy(es);
+    YAZ_CHECK(!c3->event_entry);
+    ZOOM_resultset_destroy(r3);
+    ZOOM_connection_destroy(c3);
+}
+
+int main(int argc, char **argv)
+{
+    struct test_zoom_server_conf conf;
+    test_zoom_server_t s, s_silent, s_close;
+    int port = 0, port_silent = 0, port_close = 0;
+
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+
+    memset(&conf, 0, sizeof(conf));
+    conf.hits = 5;
+    s = test_zoom_server_start(&conf, &port);
+    conf.silent = 1;
+    s_silent = test_zoom_server_start(&conf, &port_silent);
+    conf.silent = 0;
+    conf.close_after = 2;
+    s_close = test_zoom_server_start(&conf, &port_close);
+    if (s && s_silent && s_close)
+    {
+        tst_add_remove(port);
+        tst_timer(port, port_silent);
+        tst_reconnect(port_close, s_close);
+        tst_connect_again(port, port_silent);
+        tst_destroy(port);
+    }
+    test_zoom_server_stop(s);
+    test_zoom_server_stop(s_silent);
+    test_zoom_server_stop(s_close);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,248 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests ZOOM multi-target search against local Z39.50 servers */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "zoom-p.h"
+#include "test_zoom_server.h"
+
+#include <yaz/test.h>
+
+#define MAX_TARGETS 4
+
+/* record text is key */
+static const char *record_key(void *handle, ZOOM_record rec)
+{
+    WRBUF w = (WRBUF) handle;
+    int len;
+    const char *buf = ZOOM_record_get(rec, "raw", &len);
+
+    wrbuf_rewind(w);
+    if (buf)
+        wrbuf_write(w, buf, len);
+    return wrbuf_cstr(w);
+}
+
+struct multi_result {
+    int hits[MAX_TARGETS];
+    int failed[MAX_TARGETS];
+    int records[MAX_TARGETS];
+    char last[MAX_TARGETS][20];
+    int sorted;
+    int ret;       /* last return value of ZOOM_multi_next */
+};
+
+/* runs ZOOM_multi_next until it returns 0 (or -1) */
+static void multi_run(ZOOM_multi m, struct multi_result *res)
+{
+    WRBUF w = wrbuf_alloc();
+    char prev[20];
+    int type, target;
+    ZOOM_record rec;
+
+    memset(res, 0, sizeof(*res));
+    res->sorted = 1;
+    *prev = '\0';
+    while ((type = ZOOM_multi_next(m, &target, &rec)) > 0)
+    {
+        YAZ_CHECK(target >= 0 && target < MAX_TARGETS);
+        if (target < 0 || target >= MAX_TARGETS)
+            break;
+        if (type == ZOOM_MULTI_HITS)
+            res->hits[target]++;
+        else if (type == ZOOM_MULTI_FAILED)
+            res->failed[target]++;
+        else if (type == ZOOM_MULTI_RECORD)
+        {
+            const char *key = record_key(w, rec);
+            if (strcmp(prev, key) > 0)
+                res->sorted = 0;
+            strncpy(prev, key, sizeof(prev) - 1);
+            prev[sizeof(prev) - 1] = '\0';
+            strcpy(res->last[target], prev);
+            res->records[target]++;
+        }
+    }
+    res->ret = type;
+    wrbuf_destroy(w);
+}
+
+static void add_target(ZOOM_multi m, int port, ZOOM_options o)
+{
+    char host[40];
+
+    sprintf(host, "tcp:localhost:%d", port);
+    ZOOM_multi_add(m, host, o);
+}
+
+static void tst_merge(int port_even, int port_odd, int port_silent,
+                      int port_down)
+{
+    ZOOM_multi m = ZOOM_multi_create(0);
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_query q = ZOOM_query_create();
+    WRBUF w = wrbuf_alloc();
+    struct multi_result res;
+
+    ZOOM_multi_option_set(m, "count", "10");
+    ZOOM_multi_set_key_handler(m, record_key, w);
+    add_target(m, port_even, 0);
+    add_target(m, port_odd, 0);
+    ZOOM_options_set(o, "deadline", "0.5");
+    add_target(m, port_silent, o);
+    add_target(m, port_down, 0);
+    YAZ_CHECK_EQ(ZOOM_multi_size(m), 4);
+
+    ZOOM_query_prefix(q, "x");
+    ZOOM_multi_search(m, q);
+    multi_run(m, &res);
+    YAZ_CHECK_EQ(res.ret, 0);
+    YAZ_CHECK(res.sorted);
+    YAZ_CHECK_EQ(res.hits[0], 1);
+    YAZ_CHECK_EQ(res.hits[1], 1);
+    YAZ_CHECK_EQ(res.records[0], 10);
+    YAZ_CHECK_EQ(res.records[1], 10);
+    YAZ_CHECK(!strcmp(res.last[0], "000020"));
+    YAZ_CHECK(!strcmp(res.last[1], "000021"));
+    YAZ_CHECK_EQ(ZOOM_resultset_size(ZOOM_multi_resultset(m, 0)), 10);
+
+    /* deadline */
+    YAZ_CHECK_EQ(res.failed[2], 1);
+    YAZ_CHECK_EQ(res.records[2], 0);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(ZOOM_multi_connection(m, 2)),
+                 ZOOM_ERROR_TIMEOUT);
+
+    /* connection refused */
+    YAZ_CHECK_EQ(res.failed[3], 1);
+    YAZ_CHECK_EQ(res.records[3], 0);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(ZOOM_multi_connection(m, 3)),
+                 ZOOM_ERROR_CONNECT);
+
+    /* search again: targets that failed are connected again */
+    ZOOM_multi_search(m, q);
+    multi_run(m, &res);
+    YAZ_CHECK(res.sorted);
+    YAZ_CHECK_EQ(res.records[0], 10);
+    YAZ_CHECK_EQ(res.records[1], 10);
+    YAZ_CHECK_EQ(res.failed[2], 1);
+    YAZ_CHECK_EQ(res.failed[3], 1);
+
+    ZOOM_query_destroy(q);
+    ZOOM_options_destroy(o);
+    ZOOM_multi_destroy(m);
+    wrbuf_destroy(w);
+}
+
+/* records of a target that are gone from the cache when it is done
+   are skipped; the rest of its records still come */
+static void tst_missing(int port_even, int port_high)
+{
+    ZOOM_multi m = ZOOM_multi_create(0);
+    ZOOM_options o_slow = ZOOM_options_create();
+    ZOOM_options o_evict = ZOOM_options_create();
+    ZOOM_query q = ZOOM_query_create();
+    WRBUF w = wrbuf_alloc();
+    struct multi_result res;
+
+    ZOOM_multi_option_set(m, "count", "10");
+    ZOOM_multi_set_key_handler(m, record_key, w);
+    /* target 0: one record per Present; its keys are less than those
+       of target 1, whose records can only come when 0 is done */
+    ZOOM_options_set(o_slow, "step", "1");
+    add_target(m, port_even, o_slow);
+    /* target 1: each Present response evicts the one before */
+    ZOOM_options_set(o_evict, "step", "2");
+    ZOOM_options_set(o_evict, "recordCacheMax", "1");
+    add_target(m, port_high, o_evict);
+
+    ZOOM_query_prefix(q, "x");
+    ZOOM_multi_search(m, q);
+    multi_run(m, &res);
+    YAZ_CHECK_EQ(res.ret, 0);
+    YAZ_CHECK(res.sorted);
+    YAZ_CHECK_EQ(res.records[0], 10);
+    YAZ_CHECK(res.records[1] >= 2);
+    YAZ_CHECK(!strcmp(res.last[1], "001020"));
+
+    ZOOM_query_destroy(q);
+    ZOOM_options_destroy(o_slow);
+    ZOOM_options_destroy(o_evict);
+    ZOOM_multi_destroy(m);
+    wrbuf_destroy(w);
+}
+
+static void tst_event_set_wait(int port_silent)
+{
+    ZOOM_event_set es = ZOOM_event_set_create();
+    ZOOM_connection c = ZOOM_connection_create(0);
+    ZOOM_connection cs[4];
+    ZOOM_resultset r;
+    char host[40];
+    int n;
+
+    sprintf(host, "tcp:localhost:%d", port_silent);
+    ZOOM_connection_option_set(c, "async", "1");
+    ZOOM_connection_connect(c, host, 0);
+    r = ZOOM_connection_search_pqf(c, "x");
+    ZOOM_event_set_add(es, c);
+    /* connect, Init and sending of Search; then no answer */
+    while ((n = ZOOM_event_set_wait(es, 4, cs, 0, 100)) > 0)
+        ;
+    YAZ_CHECK_EQ(n, -2);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+
+    ZOOM_event_set_destroy(es);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+}
+
+int main(int argc, char **argv)
+{
+    struct test_zoom_server_conf conf;
+    test_zoom_server_t s_even, s_odd, s_high, s_silent, s_down;
+    int port_even = 0, port_odd = 0, port_high = 0, port_silent = 0;
+    int port_down = 0;
+
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+
+    memset(&conf, 0, sizeof(conf));
+    conf.hits = 10;
+    conf.stride = 2;
+    s_even = test_zoom_server_start(&conf, &port_even);
+    conf.offset = 1;
+    s_odd = test_zoom_server_start(&conf, &port_odd);
+    conf.offset = 1000;
+    s_high = test_zoom_server_start(&conf, &port_high);
+    conf.silent = 1;
+    s_silent = test_zoom_server_start(&conf, &port_silent);
+    /* nothing listens on port of stopped server */
+    s_down = test_zoom_server_start(&conf, &port_down);
+    test_zoom_server_stop(s_down);
+    if (s_even && s_odd && s_high && s_silent && s_down)
+    {
+        tst_merge(port_even, port_odd, port_silent, port_down);
+        tst_missing(port_even, port_high);
+        tst_event_set_wait(port_silent);
+    }
+    test_zoom_server_stop(s_even);
+    test_zoom_server_stop(s_odd);
+    test_zoom_server_stop(s_high);
+    test_zoom_server_stop(s_silent);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
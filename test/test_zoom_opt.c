@@ -0,0 +1,153 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests ZOOM_options. Run with argument bench for lookup timing */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <yaz/zoom.h>
+#include <yaz/timing.h>
+#include <yaz/log.h>
+
+#include <yaz/test.h>
+
+static const char *opt_callback(void *handle, const char *name)
+{
+    if (!strcmp(name, "callback"))
+        return (const char *) handle;
+    return 0;
+}
+
+static void tst_options(void)
+{
+    ZOOM_options p2 = ZOOM_options_create();
+    ZOOM_options p1 = ZOOM_options_create();
+    ZOOM_options o = ZOOM_options_create_with_parent2(p1, p2);
+    ZOOM_options d;
+    char name[20];
+    int i, len;
+
+    YAZ_CHECK(!ZOOM_options_get(o, "a"));
+    ZOOM_options_set(p2, "a", "p2");
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "a"), "p2"));
+    ZOOM_options_set(p1, "a", "p1");
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "a"), "p1"));
+    ZOOM_options_set(o, "a", "o");
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "a"), "o"));
+    /* null value: parents are consulted */
+    ZOOM_options_set(o, "a", 0);
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "a"), "p1"));
+    ZOOM_options_set(p1, "a", 0);
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "a"), "p2"));
+
+    ZOOM_options_setl(o, "bin", "x\0y", 3);
+    YAZ_CHECK(!memcmp(ZOOM_options_getl(o, "bin", &len), "x\0y", 3));
+    YAZ_CHECK_EQ(len, 3);
+
+    /* cached typed values follow changes */
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "n", 7), 7);
+    ZOOM_options_set_int(p2, "n", 10);
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "n", 7), 10);
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "n", 7), 10);
+    ZOOM_options_set_int(p2, "n", 11);
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "n", 7), 11);
+    ZOOM_options_set(p2, "n", "");
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "n", 7), 7);
+
+    YAZ_CHECK_EQ(ZOOM_options_get_bool(o, "b", 1), 1);
+    ZOOM_options_set(o, "b", "0");
+    YAZ_CHECK_EQ(ZOOM_options_get_bool(o, "b", 1), 0);
+    ZOOM_options_set(o, "b", "T");
+    YAZ_CHECK_EQ(ZOOM_options_get_bool(o, "b", 0), 1);
+
+    /* callback of parent overrides its entries, not those of child */
+    ZOOM_options_set(p1, "callback", "p1");
+    ZOOM_options_set_callback(p1, opt_callback, (void *) "cb");
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "callback"), "cb"));
+    ZOOM_options_set(o, "callback", "42");
+    YAZ_CHECK_EQ(ZOOM_options_get_int(o, "callback", 0), 42);
+    ZOOM_options_set(o, "callback", 0);
+    YAZ_CHECK(!strcmp(ZOOM_options_get(o, "callback"), "cb"));
+
+    /* many entries */
+    for (i = 0; i < 200; i++)
+    {
+        sprintf(name, "opt%d", i);
+        ZOOM_options_set_int(p1, name, i);
+    }
+    for (i = 0; i < 200; i++)
+    {
+        sprintf(name, "opt%d", i);
+        if (ZOOM_options_get_int(o, name, -1) != i)
+            break;
+    }
+    YAZ_CHECK_EQ(i, 200);
+
+    d = ZOOM_options_dup(o);
+    YAZ_CHECK(!strcmp(ZOOM_options_get(d, "b"), "T"));
+    YAZ_CHECK_EQ(ZOOM_options_get_int(d, "opt199", -1), 199);
+    ZOOM_options_destroy(d);
+
+    ZOOM_options_destroy(o);
+    ZOOM_options_destroy(p1);
+    ZOOM_options_destroy(p2);
+}
+
+static void tst_bench(int loops)
+{
+    static const char *names[] = {
+        "async", "count", "start", "presentChunk", "step", "timeout",
+        "elementSetName", "preferredRecordSyntax", "schema", "piggyback",
+        "smallSetUpperBound", "largeSetLowerBound", "mediumSetPresentNumber",
+        "setname", "databaseName", 0 };
+    ZOOM_options g = ZOOM_options_create();
+    ZOOM_options c = ZOOM_options_create_with_parent(g);
+    ZOOM_options r = ZOOM_options_create_with_parent(c);
+    yaz_timing_t t = yaz_timing_create();
+    int i, j, sum = 0;
+
+    for (j = 0; names[j]; j++)
+        ZOOM_options_set_int(g, names[j], j);
+    ZOOM_options_set(c, "implementationName", "bench");
+    ZOOM_options_set(r, "query", "computer");
+
+    yaz_timing_start(t);
+    for (i = 0; i < loops; i++)
+        for (j = 0; names[j]; j++)
+            sum += ZOOM_options_get_int(r, names[j], 0);
+    yaz_timing_stop(t);
+    YAZ_CHECK(sum > 0);
+    yaz_log(YLOG_LOG, "get_int %d x %d: %f s", loops, j,
+            yaz_timing_get_real(t));
+
+    yaz_timing_destroy(&t);
+    ZOOM_options_destroy(r);
+    ZOOM_options_destroy(c);
+    ZOOM_options_destroy(g);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_options();
+    if (argc == 2 && !strcmp(argv[1], "bench"))
+        tst_bench(1000000);
+    else
+        tst_bench(100);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
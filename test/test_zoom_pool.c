@@ -0,0 +1,212 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests ZOOM connection pool release and reuse */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#include <yaz/zgdu.h>
+#include <yaz/tcpip.h>
+#include "zoom-p.h"
+
+#include <yaz/test.h>
+
+#if HAVE_SYS_SOCKET_H && HAVE_NETINET_IN_H
+/* returns listening socket on localhost; *port is set to its port */
+static COMSTACK listen_local(int *port)
+{
+    COMSTACK l = cs_create(tcpip_type, 0, PROTO_HTTP);
+    struct sockaddr_storage sa;
+    YAZ_SOCKLEN_T len = sizeof(sa);
+    void *ad;
+
+    if (!l)
+        return 0;
+    ad = cs_straddr(l, "localhost:0");
+    if (!ad || cs_bind(l, ad, CS_SERVER) < 0
+        || getsockname(cs_fileno(l), (struct sockaddr *) &sa, &len) < 0)
+    {
+        cs_close(l);
+        return 0;
+    }
+    if (sa.ss_family == AF_INET6)
+        *port = ntohs(((struct sockaddr_in6 *) &sa)->sin6_port);
+    else
+        *port = ntohs(((struct sockaddr_in *) &sa)->sin_port);
+    return l;
+}
+
+/* returns number of cookies that c sends in a request */
+static int sent_cookies(ZOOM_connection c)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    Z_GDU *gdu = z_get_HTTP_Request(odr);
+    Z_HTTP_Header *h;
+    int n = 0;
+
+    yaz_cookies_request(c->cookies, odr, gdu->u.HTTP_Request);
+    for (h = gdu->u.HTTP_Request->headers; h; h = h->next)
+        if (!strcmp(h->name, "Cookie"))
+            n++;
+    odr_destroy(odr);
+    return n;
+}
+
+static void tst_release_reuse(void)
+{
+    int port = 0;
+    COMSTACK l = listen_local(&port);
+    ZOOM_connection_pool p;
+    ZOOM_options o;
+    ZOOM_connection c, c1;
+    char host[40];
+
+    YAZ_CHECK(l);
+    if (!l)
+        return;
+    sprintf(host, "http://localhost:%d", port);
+    p = ZOOM_connection_pool_create(0);
+    o = ZOOM_options_create();
+
+    c = ZOOM_connection_pool_get(p, o, host, 0);
+    YAZ_CHECK(c);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    YAZ_CHECK_EQ(c->state, STATE_ESTABLISHED);
+    YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 0);
+    if (c->state == STATE_ESTABLISHED)
+    {
+        /* session state left by the first user */
+        ODR odr = odr_createmem(ODR_ENCODE);
+        Z_GDU *gdu = z_get_HTTP_Response(odr, 200);
+
+        z_HTTP_header_add(odr, &gdu->u.HTTP_Response->headers,
+                          "Set-Cookie", "session=1");
+        yaz_cookies_response(c->cookies, gdu->u.HTTP_Response);
+        odr_destroy(odr);
+        YAZ_CHECK_EQ(sent_cookies(c), 1);
+        c->location = xstrdup("http://localhost/redirect");
+        ZOOM_connection_option_set(c, "saveAPDU", "1");
+        YAZ_CHECK(c->saveAPDU_wrbuf);
+
+        ZOOM_connection_pool_release(p, c);
+        YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 1);
+
+        /* different options, different key */
+        ZOOM_options_set(o, "user", "other");
+        c1 = ZOOM_connection_pool_get(p, o, host, 0);
+        YAZ_CHECK(c1 != c);
+        YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 1);
+        ZOOM_connection_destroy(c1);
+        ZOOM_options_set(o, "user", 0);
+
+        c1 = ZOOM_connection_pool_get(p, o, host, 0);
+        YAZ_CHECK(c1 == c);
+        YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 0);
+        YAZ_CHECK_EQ(sent_cookies(c1), 0);
+        YAZ_CHECK(!c1->location);
+        YAZ_CHECK(!c1->saveAPDU_wrbuf);
+        YAZ_CHECK_EQ(ZOOM_connection_errcode(c1), 0);
+        YAZ_CHECK_EQ(ZOOM_connection_last_event(c1), ZOOM_EVENT_NONE);
+        c = c1;
+    }
+    ZOOM_connection_pool_release(p, c);
+    ZOOM_connection_pool_destroy(p);
+    ZOOM_options_destroy(o);
+    cs_close(l);
+}
+
+static int option_is(ZOOM_connection c, const char *name, const char *val)
+{
+    const char *v = ZOOM_connection_option_get(c, name);
+    return v && !strcmp(v, val);
+}
+
+/* options given as name=value, prefixes of host string */
+static void tst_host_options(void)
+{
+    int port = 0;
+    COMSTACK l = listen_local(&port);
+    ZOOM_connection_pool p;
+    ZOOM_options o;
+    ZOOM_connection c, c1;
+    char host[80], host_other[80], host_plain[40];
+
+    YAZ_CHECK(l);
+    if (!l)
+        return;
+    sprintf(host, "user=admin,password=secret,http://localhost:%d", port);
+    sprintf(host_other, "user=other,password=secret,http://localhost:%d",
+            port);
+    sprintf(host_plain, "http://localhost:%d", port);
+    p = ZOOM_connection_pool_create(0);
+    o = ZOOM_options_create();
+
+    c = ZOOM_connection_pool_get(p, o, host, 0);
+    YAZ_CHECK_EQ(c->state, STATE_ESTABLISHED);
+    YAZ_CHECK(option_is(c, "user", "admin"));
+    ZOOM_connection_pool_release(p, c);
+    YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 1);
+
+    /* another user in host string: another connection */
+    c1 = ZOOM_connection_pool_get(p, o, host_other, 0);
+    YAZ_CHECK(c1 != c);
+    YAZ_CHECK(option_is(c1, "user", "other"));
+    ZOOM_connection_destroy(c1);
+
+    /* not the one of the host string either */
+    c1 = ZOOM_connection_pool_get(p, o, host_plain, 0);
+    YAZ_CHECK(c1 != c);
+    YAZ_CHECK(!ZOOM_connection_option_get(c1, "user"));
+    ZOOM_connection_destroy(c1);
+
+    /* same host string: reused with its options */
+    c1 = ZOOM_connection_pool_get(p, o, host, 0);
+    YAZ_CHECK(c1 == c);
+    YAZ_CHECK(option_is(c1, "user", "admin"));
+    YAZ_CHECK(option_is(c1, "password", "secret"));
+    YAZ_CHECK(option_is(c1, "host", host_plain));
+    ZOOM_connection_pool_release(p, c1);
+
+    /* same options given otherwise: same connection */
+    ZOOM_options_set(o, "user", "admin");
+    ZOOM_options_set(o, "password", "secret");
+    c1 = ZOOM_connection_pool_get(p, o, host_plain, 0);
+    YAZ_CHECK(c1 == c);
+    ZOOM_connection_pool_release(p, c1);
+
+    ZOOM_connection_pool_destroy(p);
+    ZOOM_options_destroy(o);
+    cs_close(l);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+#if HAVE_SYS_SOCKET_H && HAVE_NETINET_IN_H
+    tst_release_reuse();
+    tst_host_options();
+#endif
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
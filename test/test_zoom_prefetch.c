@@ -0,0 +1,134 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests ZOOM readahead (option prefetch) against a local Z39.50 server */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "zoom-p.h"
+#include "test_zoom_server.h"
+
+#include <yaz/test.h>
+
+/* record at position pos (0 for first) has text of pos + 1 */
+static int record_is(ZOOM_record rec, size_t pos)
+{
+    char expect[20];
+    const char *buf;
+    int len;
+
+    if (!rec)
+        return 0;
+    sprintf(expect, "%06d", (int) pos + 1);
+    buf = ZOOM_record_get(rec, "raw", &len);
+    return buf && len == (int) strlen(expect) && !memcmp(buf, expect, len);
+}
+
+/* reads all records in sequence; returns number of Present requests */
+static int scan(test_zoom_server_t s, int port,
+                const char *prefetch, const char *prefetch_max)
+{
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection c;
+    ZOOM_resultset r;
+    char host[40];
+    int presents = test_zoom_server_presents(s);
+    size_t i, ok = 0;
+
+    ZOOM_options_set(o, "prefetch", prefetch);
+    ZOOM_options_set(o, "prefetchMax", prefetch_max);
+    c = ZOOM_connection_create(o);
+    ZOOM_options_destroy(o);
+    sprintf(host, "tcp:localhost:%d", port);
+    ZOOM_connection_connect(c, host, 0);
+    r = ZOOM_connection_search_pqf(c, "x");
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 100);
+    for (i = 0; i < ZOOM_resultset_size(r); i++)
+        if (record_is(ZOOM_resultset_record(r, i), i))
+            ok++;
+    YAZ_CHECK_EQ(ok, 100);
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c), 0);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+    return test_zoom_server_presents(s) - presents;
+}
+
+static void tst_window(test_zoom_server_t s, int port)
+{
+    /* one Present for each record */
+    YAZ_CHECK_EQ(scan(s, port, "0", "256"), 100);
+    /* first record, then 8, 9, 17, 33 and the remaining 32 */
+    YAZ_CHECK_EQ(scan(s, port, "1", "256"), 6);
+    /* first record, 8, 9, then 8 at a time as half of window (16)
+       remains ahead */
+    YAZ_CHECK_EQ(scan(s, port, "1", "16"), 14);
+}
+
+/* a connection with readahead outstanding can go back to pool */
+static void tst_pool(int port)
+{
+    ZOOM_connection_pool p = ZOOM_connection_pool_create(0);
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection c, c1;
+    ZOOM_resultset r;
+    char host[40];
+    size_t i;
+
+    sprintf(host, "tcp:localhost:%d", port);
+    ZOOM_options_set(o, "prefetch", "1");
+    c = ZOOM_connection_pool_get(p, o, host, 0);
+    r = ZOOM_connection_search_pqf(c, "x");
+    for (i = 0; i < 3; i++)
+        YAZ_CHECK(record_is(ZOOM_resultset_record(r, i), i));
+    YAZ_CHECK(c->tasks);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_pool_release(p, c);
+    YAZ_CHECK_EQ(ZOOM_connection_pool_idle(p), 1);
+
+    /* next user gets responses to its own requests */
+    c1 = ZOOM_connection_pool_get(p, o, host, 0);
+    YAZ_CHECK(c1 == c);
+    r = ZOOM_connection_search_pqf(c1, "y");
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 100);
+    YAZ_CHECK(record_is(ZOOM_resultset_record(r, 50), 50));
+    YAZ_CHECK_EQ(ZOOM_connection_errcode(c1), 0);
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_pool_release(p, c1);
+
+    ZOOM_connection_pool_destroy(p);
+    ZOOM_options_destroy(o);
+}
+
+int main(int argc, char **argv)
+{
+    struct test_zoom_server_conf conf;
+    test_zoom_server_t s;
+    int port = 0;
+
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+
+    memset(&conf, 0, sizeof(conf));
+    conf.hits = 100;
+    s = test_zoom_server_start(&conf, &port);
+    if (s)
+    {
+        tst_window(s, port);
+        tst_pool(port);
+    }
+    test_zoom_server_stop(s);
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
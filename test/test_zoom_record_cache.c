@@ -0,0 +1,127 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/* Tests eviction of the ZOOM record cache */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "zoom-p.h"
+
+#include <yaz/test.h>
+
+/* caches records pos .. pos+num-1 referring to memory of one response */
+static void add_chunk(ZOOM_resultset r, int pos, int num)
+{
+    ODR o = odr_createmem(ODR_DECODE);
+    int i;
+
+    ZOOM_record_cache_chunk_begin(r);
+    for (i = 0; i < num; i++)
+    {
+        Z_NamePlusRecord *npr = (Z_NamePlusRecord *)
+            odr_malloc(o, sizeof(*npr));
+        char buf[20];
+
+        sprintf(buf, "rec%03d", pos + i);
+        npr->databaseName = "Default";
+        npr->which = Z_NamePlusRecord_databaseRecord;
+        npr->u.databaseRecord = z_ext_record_sutrs(o, buf, strlen(buf));
+        ZOOM_record_cache_add(r, npr, pos + i, 0, 0, 0, 0);
+    }
+    ZOOM_record_cache_chunk_end(r, odr_extract_mem(o));
+    odr_destroy(o);
+}
+
+static int cached(ZOOM_resultset r, int pos)
+{
+    return ZOOM_record_cache_lookup_i(r, pos, 0, 0, 0) != 0;
+}
+
+static int content_is(ZOOM_resultset r, int pos, const char *expect)
+{
+    ZOOM_record rec = ZOOM_record_cache_lookup_i(r, pos, 0, 0, 0);
+    const char *buf;
+    int len;
+
+    if (!rec)
+        return 0;
+    buf = ZOOM_record_get(rec, "raw", &len);
+    return buf && len == (int) strlen(expect) && !memcmp(buf, expect, len);
+}
+
+static void tst_evict(void)
+{
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection c;
+    ZOOM_resultset r, r2;
+    size_t chunk_bytes;
+
+    ZOOM_options_set(o, "async", "1");
+    c = ZOOM_connection_create(o);
+    ZOOM_options_destroy(o);
+    r = ZOOM_connection_search_pqf(c, "x");
+    r2 = ZOOM_connection_search_pqf(c, "y");
+
+    /* budget of result set: two chunks of two records */
+    add_chunk(r, 0, 2);
+    chunk_bytes = r->cache_bytes;
+    YAZ_CHECK(chunk_bytes > 0);
+    r->cache_max_bytes = 2 * chunk_bytes;
+    add_chunk(r, 2, 2);
+    YAZ_CHECK_EQ(r->record_hash_num, 4);
+    YAZ_CHECK_EQ(r->cache_evictions, 0);
+
+    /* use 0 so that 1 is least recently used; then 2, 3, 0 */
+    YAZ_CHECK(cached(r, 0));
+    add_chunk(r, 4, 2);
+    YAZ_CHECK_EQ(r->cache_evictions, 3);
+    YAZ_CHECK_EQ(r->record_hash_num, 3);
+    YAZ_CHECK(r->cache_bytes <= r->cache_max_bytes);
+    YAZ_CHECK(!cached(r, 1));
+    YAZ_CHECK(!cached(r, 2));
+    YAZ_CHECK(!cached(r, 3));
+    YAZ_CHECK(cached(r, 4));
+    YAZ_CHECK(cached(r, 5));
+    /* 0 keeps memory of first chunk alive, though 1 is gone */
+    YAZ_CHECK(content_is(r, 0, "rec000"));
+    YAZ_CHECK(content_is(r, 5, "rec005"));
+
+    /* global budget: cache of r and one chunk in r2 */
+    r2->cache_global_max_bytes = r->cache_bytes + chunk_bytes;
+    add_chunk(r2, 0, 2);
+    YAZ_CHECK_EQ(r2->cache_evictions, 0);
+    add_chunk(r2, 2, 2);
+    YAZ_CHECK_EQ(r2->cache_evictions, 2);
+    YAZ_CHECK(!cached(r2, 0));
+    YAZ_CHECK(!cached(r2, 1));
+    YAZ_CHECK(content_is(r2, 2, "rec002"));
+    YAZ_CHECK(content_is(r2, 3, "rec003"));
+    /* evictions of r2 do not touch r */
+    YAZ_CHECK_EQ(r->record_hash_num, 3);
+    YAZ_CHECK_EQ(r->cache_evictions, 3);
+
+    ZOOM_resultset_destroy(r);
+    ZOOM_resultset_destroy(r2);
+    ZOOM_connection_destroy(c);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_evict();
+    YAZ_CHECK_TERM;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,289 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file test_zoom_server.c
+ * \brief Z39.50 server for ZOOM tests.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#include <yaz/comstack.h>
+#include <yaz/tcpip.h>
+#include <yaz/proto.h>
+#include <yaz/poll.h>
+#include <yaz/mutex.h>
+#include <yaz/thread_create.h>
+#include <yaz/xmalloc.h>
+#include "test_zoom_server.h"
+
+#define SERVER_MAX_CLIENTS 16
+
+struct test_zoom_server {
+    struct test_zoom_server_conf conf;
+    COMSTACK l;
+    YAZ_MUTEX mutex;
+    yaz_thread_t thread;
+    int stop;
+    int accepts;
+    int presents;
+};
+
+struct server_client {
+    COMSTACK cs;
+    int requests;
+};
+
+static void server_count(test_zoom_server_t s, int *counter)
+{
+    yaz_mutex_enter(s->mutex);
+    (*counter)++;
+    yaz_mutex_leave(s->mutex);
+}
+
+static int server_get(test_zoom_server_t s, int *counter)
+{
+    int v;
+
+    yaz_mutex_enter(s->mutex);
+    v = *counter;
+    yaz_mutex_leave(s->mutex);
+    return v;
+}
+
+static Z_Records *server_records(test_zoom_server_t s, ODR o,
+                                 int start, int *num)
+{
+    Z_Records *rec = (Z_Records *) odr_malloc(o, sizeof(*rec));
+    Z_NamePlusRecordList *l = (Z_NamePlusRecordList *)
+        odr_malloc(o, sizeof(*l));
+    int i;
+
+    if (start < 1)
+        start = 1;
+    if (*num > s->conf.hits - start + 1)
+        *num = s->conf.hits - start + 1;
+    if (*num < 0)
+        *num = 0;
+    rec->which = Z_Records_DBOSD;
+    rec->u.databaseOrSurDiagnostics = l;
+    l->num_records = *num;
+    l->records = (Z_NamePlusRecord **)
+        odr_malloc(o, sizeof(*l->records) * (*num + 1));
+    for (i = 0; i < *num; i++)
+    {
+        Z_NamePlusRecord *npr = (Z_NamePlusRecord *)
+            odr_malloc(o, sizeof(*npr));
+        char buf[20];
+
+        sprintf(buf, "%06d", (start + i) * s->conf.stride + s->conf.offset);
+        npr->databaseName = "Default";
+        npr->which = Z_NamePlusRecord_databaseRecord;
+        npr->u.databaseRecord = z_ext_record_sutrs(o, buf, strlen(buf));
+        l->records[i] = npr;
+    }
+    return rec;
+}
+
+/* reads and answers one request. Returns 0 if connection must close */
+static int server_serve(test_zoom_server_t s, struct server_client *cl,
+                        ODR odr_in, ODR odr_out, char **buf, int *size)
+{
+    Z_APDU *req = 0, *res = 0;
+    int r = cs_get(cl->cs, buf, size);
+    int len;
+
+    if (r <= 0)
+        return 0;
+    if (r == 1)
+        return 1;  /* incomplete */
+    odr_reset(odr_in);
+    odr_setbuf(odr_in, *buf, r, 0);
+    if (!z_APDU(odr_in, &req, 0, 0))
+        return 0;
+    cl->requests++;
+    switch (req->which)
+    {
+    case Z_APDU_initRequest:
+        res = zget_APDU(odr_out, Z_APDU_initResponse);
+        ODR_MASK_SET(res->u.initResponse->options, Z_Options_search);
+        ODR_MASK_SET(res->u.initResponse->options, Z_Options_present);
+        ODR_MASK_SET(res->u.initResponse->options, Z_Options_namedResultSets);
+        ODR_MASK_SET(res->u.initResponse->protocolVersion,
+                     Z_ProtocolVersion_3);
+        break;
+    case Z_APDU_searchRequest:
+        if (s->conf.silent)
+            break;
+        res = zget_APDU(odr_out, Z_APDU_searchResponse);
+        *res->u.searchResponse->resultCount = s->conf.hits;
+        break;
+    case Z_APDU_presentRequest:
+        server_count(s, &s->presents);
+        res = zget_APDU(odr_out, Z_APDU_presentResponse);
+        len = (int) *req->u.presentRequest->numberOfRecordsRequested;
+        res->u.presentResponse->records =
+            server_records(s, odr_out,
+                           (int) *req->u.presentRequest->resultSetStartPoint,
+                           &len);
+        *res->u.presentResponse->numberOfRecordsReturned = len;
+        *res->u.presentResponse->nextResultSetPosition =
+            *req->u.presentRequest->resultSetStartPoint + len;
+        break;
+    }
+    if (res)
+    {
+        char *out;
+
+        if (!z_APDU(odr_out, &res, 0, 0))
+            return 0;
+        out = odr_getbuf(odr_out, &len, 0);
+        r = cs_put(cl->cs, out, len);
+        odr_reset(odr_out);
+        if (r < 0)
+            return 0;
+    }
+    if (s->conf.close_after && cl->requests >= s->conf.close_after)
+        return 0;
+    return 1;
+}
+
+static void *server_thread(void *p)
+{
+    test_zoom_server_t s = (test_zoom_server_t) p;
+    struct server_client clients[SERVER_MAX_CLIENTS];
+    struct yaz_poll_fd fds[SERVER_MAX_CLIENTS + 1];
+    ODR odr_in = odr_createmem(ODR_DECODE);
+    ODR odr_out = odr_createmem(ODR_ENCODE);
+    char *buf = 0;
+    int i, size = 0, num = 0;
+
+    while (!server_get(s, &s->stop))
+    {
+        fds[0].fd = cs_fileno(s->l);
+        fds[0].input_mask = yaz_poll_read;
+        for (i = 0; i < num; i++)
+        {
+            fds[i + 1].fd = cs_fileno(clients[i].cs);
+            fds[i + 1].input_mask = yaz_poll_read;
+        }
+        /* wake up now and then to see if we must stop */
+        if (yaz_poll(fds, num + 1, 0, 10000000) <= 0)
+            continue;
+        for (i = num; --i >= 0; )
+            if (fds[i + 1].output_mask & (yaz_poll_read | yaz_poll_except))
+            {
+                if (!server_serve(s, clients + i, odr_in, odr_out,
+                                  &buf, &size))
+                {
+                    cs_close(clients[i].cs);
+                    clients[i] = clients[--num];
+                }
+            }
+        if ((fds[0].output_mask & yaz_poll_read) &&
+            num < SERVER_MAX_CLIENTS && cs_listen(s->l, 0, 0) == 0)
+        {
+            COMSTACK cs = cs_accept(s->l);
+            if (cs)
+            {
+                clients[num].cs = cs;
+                clients[num].requests = 0;
+                num++;
+                server_count(s, &s->accepts);
+            }
+        }
+    }
+    for (i = 0; i < num; i++)
+        cs_close(clients[i].cs);
+    xfree(buf);
+    odr_destroy(odr_in);
+    odr_destroy(odr_out);
+    return 0;
+}
+
+test_zoom_server_t test_zoom_server_start(
+    const struct test_zoom_server_conf *conf, int *port)
+{
+#if YAZ_POSIX_THREADS && HAVE_SYS_SOCKET_H && HAVE_NETINET_IN_H
+    test_zoom_server_t s;
+    struct sockaddr_storage sa;
+    YAZ_SOCKLEN_T len = sizeof(sa);
+    COMSTACK l = cs_create(tcpip_type, 1, PROTO_Z3950);
+    void *ad;
+
+    if (!l)
+        return 0;
+    ad = cs_straddr(l, "localhost:0");
+    if (!ad || cs_bind(l, ad, CS_SERVER) < 0
+        || getsockname(cs_fileno(l), (struct sockaddr *) &sa, &len) < 0)
+    {
+        cs_close(l);
+        return 0;
+    }
+    if (sa.ss_family == AF_INET6)
+        *port = ntohs(((struct sockaddr_in6 *) &sa)->sin6_port);
+    else
+        *port = ntohs(((struct sockaddr_in *) &sa)->sin_port);
+    s = (test_zoom_server_t) xmalloc(sizeof(*s));
+    s->conf = *conf;
+    if (s->conf.stride == 0)
+        s->conf.stride = 1;
+    s->l = l;
+    s->mutex = 0;
+    yaz_mutex_create(&s->mutex);
+    s->stop = 0;
+    s->accepts = 0;
+    s->presents = 0;
+    s->thread = yaz_thread_create(server_thread, s);
+    if (!s->thread)
+    {
+        test_zoom_server_stop(s);
+        return 0;
+    }
+    return s;
+#else
+    return 0;
+#endif
+}
+
+void test_zoom_server_stop(test_zoom_server_t s)
+{
+    if (!s)
+        return;
+    if (s->thread)
+    {
+        server_count(s, &s->stop);
+        yaz_thread_join(&s->thread, 0);
+    }
+    cs_close(s->l);
+    yaz_mutex_destroy(&s->mutex);
+    xfree(s);
+}
+
+int test_zoom_server_accepts(test_zoom_server_t s)
+{
+    return server_get(s, &s->accepts);
+}
+
+int test_zoom_server_presents(test_zoom_server_t s)
+{
+    return server_get(s, &s->presents);
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
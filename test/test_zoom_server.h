@@ -0,0 +1,51 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file test_zoom_server.h
+ * \brief Z39.50 server for ZOOM tests.
+ *
+ * The server runs in a thread of the test, listening on localhost. It
+ * answers Init, Search and Present; the record at position p (1 for
+ * first) is SUTRS text of number p * stride + offset as %06d.
+ */
+#ifndef TEST_ZOOM_SERVER_H
+#define TEST_ZOOM_SERVER_H
+
+struct test_zoom_server_conf {
+    int hits;         /* result count of every search */
+    int stride;       /* record number step */
+    int offset;       /* record number of position 0 */
+    int silent;       /* do not answer Search */
+    int close_after;  /* close connection after this many requests; 0=no */
+};
+
+typedef struct test_zoom_server *test_zoom_server_t;
+
+/** \brief starts server
+    \param conf configuration (copied)
+    \param port set to port of server on localhost
+    \returns server or NULL on failure (or if threads are unavailable)
+*/
+test_zoom_server_t test_zoom_server_start(
+    const struct test_zoom_server_conf *conf, int *port);
+
+/** \brief stops server and closes its connections */
+void test_zoom_server_stop(test_zoom_server_t s);
+
+/** \brief returns number of connections accepted so far */
+int test_zoom_server_accepts(test_zoom_server_t s);
+
+/** \brief returns number of Present requests received so far */
+int test_zoom_server_presents(test_zoom_server_t s);
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
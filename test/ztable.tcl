@@ -0,0 +1,27 @@
+# Table driven (yaz-asncomp -t) copy of the Z39.50 core codecs, with
+# prefix zt_, for comparison with the codecs of libyaz (test_odr_table)
+source [file join [file dirname [info script]] ../src/z.tcl]
+
+set default-prefix {zt_ Zt_ ZT_}
+
+set m Z39-50-APDU-1995
+set filename($m) test_ztable
+set body($m,h) "
+#ifdef __cplusplus
+extern \"C\" \{
+#endif
+
+int zt_ANY_type_0 (ODR o, void **p, int opt);
+
+#ifdef __cplusplus
+\}
+#endif
+"
+set body($m,c) {
+
+int zt_ANY_type_0 (ODR o, void **p, int opt)
+{
+    return 0;
+}
+
+}
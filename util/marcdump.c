@@ -220,6 +220,7 @@ static long marcdump_read_iso2709(yaz_marc_t mt, const char *from, const char *t
     long marc_no;
     int split_file_no = -1;
     yaz_iconv_t cd = yaz_marc_get_iconv(mt);
+    WRBUF wrbuf;
     if (!inf)
     {
         fprintf(stderr, "%s: cannot open %s:%s\n",
@@ -228,6 +229,7 @@ static long marcdump_read_iso2709(yaz_marc_t mt, const char *from, const char *t
     }
     if (cfile)
         fprintf(cfile, "char *marc_records[] = {\n");
+    wrbuf = wrbuf_alloc();
     for (marc_no = 0L; marc_no - offset < limit; marc_no++)
     {
         const char *result = 0;
@@ -353,7 +355,10 @@ static long marcdump_read_iso2709(yaz_marc_t mt, const char *from, const char *t
             if (cd1)
                 yaz_marc_iconv(mt, cd1);
         }
-        r = yaz_marc_decode_buf(mt, buf, -1, &result, &len_result);
+        wrbuf_rewind(wrbuf);
+        r = yaz_marc_transcode_wrbuf(mt, buf, -1, wrbuf);
+        result = wrbuf_buf(wrbuf);
+        len_result = wrbuf_len(wrbuf);
 
         if (cd1)
         {
@@ -399,6 +404,7 @@ static long marcdump_read_iso2709(yaz_marc_t mt, const char *from, const char *t
     }
     if (cfile)
         fprintf(cfile, "};\n");
+    wrbuf_destroy(wrbuf);
     fclose(inf);
     return marc_no;
 }
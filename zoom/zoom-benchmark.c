@@ -32,6 +32,7 @@ static struct parameters_t {
     char proxy[1024];
     int piggypack;
     int gnuplot;
+    int event_set;
 } parameters;
 
 struct  event_line_t
@@ -148,6 +149,7 @@ void init_statics(void)
     strcpy(parameters.proxy, nullstring);
     parameters.gnuplot = 0;
     parameters.piggypack = 0;
+    parameters.event_set = 0;
 
     /* progress initializing */
     for (i = 0; i < 4096; i++){
@@ -201,6 +203,7 @@ void print_option_error(void)
             "[-n no_repeat] "
             "[-b (piggypack)] "
             "[-g (gnuplot outfile)] "
+            "[-e (use ZOOM_event_set)] "
             "[-p proxy] \n");
     /* "[-t timeout] \n"); */
     exit(1);
@@ -210,7 +213,7 @@ void print_option_error(void)
 void read_params(int argc, char **argv, struct parameters_t *p_parameters){
     char *arg;
     int ret;
-    while ((ret = options("h:q:c:t:p:bgn:", argv, argc, &arg)) != -2)
+    while ((ret = options("h:q:c:t:p:bgen:", argv, argc, &arg)) != -2)
     {
         switch (ret)
         {
@@ -237,6 +240,9 @@ void read_params(int argc, char **argv, struct parameters_t *p_parameters){
         case 'g':
             p_parameters->gnuplot = 1;
                     break;
+        case 'e':
+            p_parameters->event_set = 1;
+                    break;
         case 'n':
             p_parameters->repeat = atoi(arg);
                     break;
@@ -285,6 +291,35 @@ void print_table_header(void)
 }
 
 
+/* records event for connection i (1-based) of repeat k */
+void handle_event(struct time_type *time, int *elc, struct event_line_t *els,
+                  int k, int i, ZOOM_connection c, int event)
+{
+    const char *errmsg;
+    const char *addinfo;
+    int error = 0;
+
+    if (event == ZOOM_EVENT_SEND_DATA || event == ZOOM_EVENT_RECV_DATA)
+        return;
+
+    time_stamp(time);
+
+    error = ZOOM_connection_error(c, &errmsg, &addinfo);
+    if (error)
+        parameters.progress[i] = zoom_progress[ZOOM_EVENT_UNKNOWN];
+    else if (event == ZOOM_EVENT_CONNECT)
+        parameters.progress[i] = zoom_progress[event];
+    else
+        parameters.progress[i] += 1;
+
+    update_events(elc, els,
+                  k, i-1,
+                  time_sec(time), time_usec(time),
+                  parameters.progress[i],
+                  event, zoom_events[event],
+                  error, errmsg);
+}
+
 int main(int argc, char **argv)
 {
     struct time_type time;
@@ -349,33 +384,32 @@ int main(int argc, char **argv)
         for (i = 0; i < parameters.concurrent; i++)
             r[i] = ZOOM_connection_search_pqf (z[i], parameters.query);
 
-        /* network I/O. pass number of connections and array of connections */
-        while ((i = ZOOM_event (parameters.concurrent, z))){
-            int event = ZOOM_connection_last_event(z[i-1]);
-            const char *errmsg;
-            const char *addinfo;
-            int error = 0;
-
-            if (event == ZOOM_EVENT_SEND_DATA || event == ZOOM_EVENT_RECV_DATA)
-                continue;
-
-            time_stamp(&time);
-
-            error = ZOOM_connection_error(z[i-1] , &errmsg, &addinfo);
-            if (error)
-                parameters.progress[i] = zoom_progress[ZOOM_EVENT_UNKNOWN];
-            else if (event == ZOOM_EVENT_CONNECT)
-                parameters.progress[i] = zoom_progress[event];
-            else
-                parameters.progress[i] += 1;
-
-            update_events(elc, els,
-                          k, i-1,
-                          time_sec(&time), time_usec(&time),
-                          parameters.progress[i],
-                          event, zoom_events[event],
-                          error, errmsg);
+        if (parameters.event_set){
+            /* events of all ready connections per wakeup */
+            ZOOM_event_set es = ZOOM_event_set_create();
+            ZOOM_connection cs[64];
+            int events[64];
+            int n, j;
+
+            for (i = 0; i < parameters.concurrent; i++){
+                char no[20];
+
+                sprintf(no, "%d", i + 1);
+                ZOOM_connection_option_set(z[i], "benchmark-no", no);
+                ZOOM_event_set_add(es, z[i]);
+            }
+            while ((n = ZOOM_event_set_next(es, 64, cs, events)) > 0)
+                for (j = 0; j < n; j++)
+                    handle_event(&time, elc, els, k,
+                                 atoi(ZOOM_connection_option_get(
+                                          cs[j], "benchmark-no")),
+                                 cs[j], events[j]);
+            ZOOM_event_set_destroy(es);
         }
+        /* network I/O. pass number of connections and array of connections */
+        while ((i = ZOOM_event (parameters.concurrent, z)))
+            handle_event(&time, elc, els, k, i, z[i-1],
+                         ZOOM_connection_last_event(z[i-1]));
 
         /* destroy connections */
         for (i = 0; i<parameters.concurrent; i++)